@@ -0,0 +1,82 @@
+#pragma once
+/*
+Tiny in tree microbenchmark harness, no dependencies.
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// keeps the compiler from optimizing a value (and the work producing it) away
+template <typename T>
+inline void BENCH_donotoptimize(T const& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile T sink;
+    sink = value;
+#endif
+}
+// forces pending memory writes to be treated as observable
+inline void BENCH_clobbermemory() {
+#if defined(__GNUC__)
+    asm volatile("" : : : "memory");
+#endif
+}
+
+inline uint64_t BENCH_cycles() { // TSC (reference) cycles, 0 where there is no cheap cycle counter
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct BENCH_result {
+    std::string name;
+    double nsperop;
+    double cyclesperop;
+    uint64_t iterations; // per batch
+};
+
+#define BENCH_batches 7
+#define BENCH_minbatchns 20000000.0 // batches are grown until they take at least 20ms
+
+// runs body(i) with increasing i. warms up, sizes the batches, then reports the median batch.
+template <typename F>
+BENCH_result BENCH_measure(const std::string& name, F body) {
+    using clock = std::chrono::steady_clock;
+    uint64_t iterations = 1024;
+    uint64_t counter = 0;
+
+    // warm up caches, branch predictors and the cpu clock while sizing the batch
+    for (;;) {
+        auto start = clock::now();
+        for (uint64_t i=0;i<iterations;i++) {
+            body(counter++);
+        }
+        double ns = std::chrono::duration<double, std::nano>(clock::now()-start).count();
+        if (ns >= BENCH_minbatchns) {break;}
+        iterations *= ns < BENCH_minbatchns/8 ? 8 : 2;
+    }
+
+    std::vector<double> ns(BENCH_batches), cycles(BENCH_batches);
+    for (int batch=0;batch<BENCH_batches;batch++) {
+        auto start = clock::now();
+        uint64_t cyclestart = BENCH_cycles();
+        for (uint64_t i=0;i<iterations;i++) {
+            body(counter++);
+        }
+        uint64_t cycleend = BENCH_cycles();
+        ns[batch] = std::chrono::duration<double, std::nano>(clock::now()-start).count()/iterations;
+        cycles[batch] = (double)(cycleend-cyclestart)/iterations;
+    }
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+    return BENCH_result{name, ns[BENCH_batches/2], cycles[BENCH_batches/2], iterations};
+}
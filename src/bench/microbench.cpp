@@ -0,0 +1,120 @@
+/*
+Microbenchmarks for the ALU, memory and terminal primitives.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../argh.h"
+#include "bench.h"
+
+extern "C" {
+#include "../arithmetic.h"
+#include "../memory.h"
+#include "../terminal.h"
+}
+
+#define MB_operands 1024 // must be a power of 2
+
+static VM_word MB_a[MB_operands];
+static VM_word MB_b[MB_operands];
+
+static VM_word mb_readhook(void* ctx, uint16_t addr) {
+    (void)ctx;
+    return addr;
+}
+static void mb_writehook(void* ctx, VM_word val, uint16_t addr) {
+    (void)addr;
+    *(VM_word*)ctx = val;
+}
+
+// memory with hookamount read and write hooks, none of them covering plain RAM
+static VM_memory mb_memory(uint16_t hookamount, VM_word* sink) {
+    VM_memory memory = VM_newmemory(64, 128);
+    for (uint16_t i=0;i<hookamount;i++) {
+        VM_addrhook(&memory, 0xF000+i*2, mb_readhook, 0, sink);
+        VM_addwhook(&memory, 0xF000+i*2, mb_writehook, 0, sink);
+    }
+    return memory;
+}
+
+int main(int argc, char* argv[]) {
+    argh::parser cmdl(argc, argv);
+    bool json = cmdl["--json"];
+    std::string filter;
+    cmdl("--filter", "") >> filter;
+
+    uint32_t seed = 0x12345678;
+    for (int i=0;i<MB_operands;i++) { // xorshift, some operands get bits above the 16 bit ALU width
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        MB_a[i] = seed & (i & 8 ? 0x3FFFFFFF : 0xFFFF);
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        MB_b[i] = seed & (i & 4 ? 0x3FFFFFFF : 0xFFFF);
+    }
+
+    std::vector<BENCH_result> results;
+    auto run = [&](const std::string& name, auto body) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) {return;}
+        results.push_back(BENCH_measure(name, body));
+    };
+    VM_flags flags = 0;
+    #define MB_i (i & (MB_operands-1))
+
+    run("VM_add", [&](uint64_t i) {BENCH_donotoptimize(VM_add(MB_a[MB_i], MB_b[MB_i], &flags));});
+    run("VM_add/noflags", [&](uint64_t i) {BENCH_donotoptimize(VM_add(MB_a[MB_i], MB_b[MB_i], NULL));});
+    run("VM_adc", [&](uint64_t i) {BENCH_donotoptimize(VM_adc(MB_a[MB_i], MB_b[MB_i], &flags, i & 1));});
+    run("VM_sub", [&](uint64_t i) {BENCH_donotoptimize(VM_sub(MB_a[MB_i], MB_b[MB_i], &flags));});
+    run("VM_sbb", [&](uint64_t i) {BENCH_donotoptimize(VM_sbb(MB_a[MB_i], MB_b[MB_i], &flags, i & 1));});
+    run("VM_mul", [&](uint64_t i) {BENCH_donotoptimize(VM_mul(MB_a[MB_i], MB_b[MB_i]));});
+    run("VM_mulh", [&](uint64_t i) {BENCH_donotoptimize(VM_mulh(MB_a[MB_i], MB_b[MB_i]));});
+    run("VM_muls", [&](uint64_t i) {BENCH_donotoptimize(VM_muls(MB_a[MB_i], MB_b[MB_i]));});
+    run("VM_mulx", [&](uint64_t i) {BENCH_donotoptimize(VM_mulx(MB_a[MB_i], MB_b[MB_i]));});
+    run("VM_shl", [&](uint64_t i) {BENCH_donotoptimize(VM_shl(MB_a[MB_i], MB_b[MB_i], &flags));});
+    run("VM_shr", [&](uint64_t i) {BENCH_donotoptimize(VM_shr(MB_a[MB_i], MB_b[MB_i], &flags));});
+    run("VM_and", [&](uint64_t i) {BENCH_donotoptimize(VM_and(MB_a[MB_i], MB_b[MB_i], &flags));});
+    run("VM_or", [&](uint64_t i) {BENCH_donotoptimize(VM_or(MB_a[MB_i], MB_b[MB_i], &flags));});
+    run("VM_xor", [&](uint64_t i) {BENCH_donotoptimize(VM_xor(MB_a[MB_i], MB_b[MB_i], &flags));});
+    BENCH_donotoptimize(flags);
+
+    run("VM_generatecondtable", [&](uint64_t i) {
+        VM_word table[16];
+        VM_generatecondtable((VM_flags)(i & 0b1111), table);
+        BENCH_donotoptimize(table);
+        BENCH_clobbermemory();
+    });
+
+    VM_word sink = 0;
+    const uint16_t hookamounts[] = {0, 1, 8, 32};
+    for (uint16_t hookamount : hookamounts) {
+        VM_memory memory = mb_memory(hookamount, &sink);
+        std::string suffix = "/"+std::to_string(hookamount)+"hooks";
+        run("VM_memread"+suffix, [&](uint64_t i) {BENCH_donotoptimize(VM_memread(&memory, MB_a[MB_i] & 0x1FFF));});
+        run("VM_memwrite"+suffix, [&](uint64_t i) {
+            VM_memwrite(&memory, MB_a[MB_i] & 0x1FFF, MB_b[MB_i]);
+            BENCH_clobbermemory();
+        });
+        if (hookamount) {
+            run("VM_memread"+suffix+"/hit", [&](uint64_t i) {BENCH_donotoptimize(VM_memread(&memory, 0xF000+(i%hookamount)*2));});
+        }
+        VM_delmemory(&memory);
+    }
+    BENCH_donotoptimize(sink);
+
+    VM_term term = VM_newterm(12, 8);
+    run("VM_setchar", [&](uint64_t i) {
+        VM_setchar(&term, i & 0b1111, (i >> 4) & 0b1111, MB_a[MB_i] & 0x7F, i % 12, (i/12) % 8);
+        BENCH_clobbermemory();
+    });
+    VM_delterm(&term);
+
+    for (const BENCH_result& result : results) {
+        if (json) {
+            printf("{\"name\": \"%s\", \"ns_per_op\": %.3f, \"cycles_per_op\": %.2f, \"iterations\": %llu}\n",
+                result.name.c_str(), result.nsperop, result.cyclesperop, (unsigned long long)result.iterations);
+        } else {
+            printf("%-28s %10.3f ns/op %10.2f cycles/op\n", result.name.c_str(), result.nsperop, result.cyclesperop);
+        }
+    }
+    return 0;
+}
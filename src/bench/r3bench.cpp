@@ -0,0 +1,218 @@
+/*
+Headless benchmark over whole ROMs. Prints one JSON object per ROM so results can be tracked between releases.
+*/
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../argh.h"
+
+extern "C" {
+#include "../config.h"
+#include "../machine.h"
+#include "../snapshot.h"
+#include "../recording.h"
+}
+
+struct BENCH_run {
+    double seconds; // emulation + rendering
+    double renderseconds;
+    uint64_t cycles;
+    uint64_t frames;
+    uint8_t halted;
+    VM_word haltip;
+};
+
+static BENCH_run bench_once(const VM_machineconfig& config, const std::string& rom, const VM_snapshotfile& snapshot, const std::string& scriptpath, VM_replay* replay, uint64_t cycles, uint64_t updxframes, bool fusion, bool* ok) {
+    BENCH_run out = {};
+    VM_machine* machine = VM_newmachine(&config);
+    if (machine && machine->engine) {machine->engine->fusion = fusion;}
+    if (!machine || (!rom.empty() && !VM_loadrom(machine, rom.c_str())) || (snapshot.data && !VM_loadsnapshot(machine, snapshot.data, snapshot.size))) {
+        *ok = false;
+        VM_delmachine(machine);
+        return out;
+    }
+    VM_inputscript script = {};
+    if (!scriptpath.empty()) {
+        script = VM_loadinputscript(scriptpath.c_str());
+        VM_seekinput(&script, machine->instance.cycles);
+        machine->script = &script;
+    }
+    if (replay) { // recorded keys, the replay owns them
+        VM_seekinput(&replay->script, machine->instance.cycles);
+        machine->script = &replay->script;
+    }
+    std::vector<uint8_t> rgb((size_t)(8*config.charsnh)*(8*config.charsnv)*3);
+
+    // same shape as the frontend loop: emulate updxframes cycles, then render a frame
+    auto start = std::chrono::steady_clock::now();
+    while (out.cycles < cycles && !machine->instance.halted) {
+        uint64_t slice = cycles-out.cycles < updxframes ? cycles-out.cycles : updxframes;
+        out.cycles += VM_runmachine(machine, slice);
+
+        auto renderstart = std::chrono::steady_clock::now();
+        VM_termtorgb(&machine->term, rgb.data());
+        out.renderseconds += std::chrono::duration<double>(std::chrono::steady_clock::now()-renderstart).count();
+        out.frames ++;
+    }
+    out.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    out.halted = machine->instance.halted;
+    out.haltip = machine->instance.IP;
+
+    VM_delinputscript(&script);
+    machine->script = NULL;
+    VM_delmachine(machine);
+    *ok = true;
+    return out;
+}
+
+static std::string bench_escape(const std::string& text) { // for JSON strings
+    std::string out;
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') {out += '\\';}
+        out += ch;
+    }
+    return out;
+}
+static void bench_stats(const std::vector<double>& values, double* mean, double* stddev, double* min, double* max) {
+    *mean = 0;
+    *min = values.empty() ? 0 : values[0];
+    *max = *min;
+    for (double value : values) {
+        *mean += value;
+        *min = value < *min ? value : *min;
+        *max = value > *max ? value : *max;
+    }
+    *mean /= values.empty() ? 1 : values.size();
+    double sum = 0;
+    for (double value : values) {
+        sum += (value-*mean)*(value-*mean);
+    }
+    *stddev = values.size() > 1 ? std::sqrt(sum/(values.size()-1)) : 0;
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options] <input.bin>\n", prog);
+    printf("       %s [options] --replay=FILE\n", prog);
+    printf("Options:\n");
+    printf("  --cycles=N       Cycles to emulate per run (default: 100000)\n");
+    printf("  --runs=N         Timed runs (default: 5)\n");
+    printf("  --warmup=N       Untimed runs before measuring (default: 1)\n");
+    printf("  --updxframes=N   Cycles per rendered frame (default: %d)\n", DEFAULT_updxframes);
+    printf("  --cores=N        Number of cores (default: %d)\n", DEFAULT_coreamount);
+    printf("  --memrows=N      Memory rows (default: %d)\n", DEFAULT_memrows);
+    printf("  --script=FILE    Scripted keyboard input, \"<cycle> <key>\" per line\n");
+    printf("  --engine=NAME    Execution engine: reference, predecoded (default: reference)\n");
+    printf("  --no-fusion      Predecoded engine: run every instruction on its own, no fused pairs\n");
+    printf("  --snapshot=FILE  Start every run from this save state instead of the ROM's entry\n");
+    printf("  --replay=FILE    Use a recording from R3emu --record as the workload (start state and keys)\n");
+    printf("  --name=NAME      Name in the output (default: the ROM path)\n");
+}
+
+int main(int argc, char* argv[]) {
+    argh::parser cmdl(argc, argv);
+    std::string replaypath;
+    cmdl("--replay", "") >> replaypath;
+    bool norom = cmdl.size() < 2 && replaypath.empty();
+    if (cmdl[{"-h", "--help"}] || norom) {
+        print_usage(argv[0]);
+        return norom ? 1 : 0;
+    }
+    const std::string rom = cmdl.size() < 2 ? "" : cmdl[1];
+
+    uint64_t cycles, runs, warmup, updxframes;
+    int coreamount, memrows;
+    std::string scriptpath, name, enginename, snapshotpath;
+    cmdl("--cycles", 100000) >> cycles;
+    cmdl("--runs", 5) >> runs;
+    cmdl("--warmup", 1) >> warmup;
+    cmdl("--updxframes", DEFAULT_updxframes) >> updxframes;
+    cmdl("--cores", DEFAULT_coreamount) >> coreamount;
+    cmdl("--memrows", DEFAULT_memrows) >> memrows;
+    cmdl("--script", "") >> scriptpath;
+    cmdl("--name", rom.empty() ? replaypath : rom) >> name;
+    cmdl("--engine", "reference") >> enginename;
+    cmdl("--snapshot", "") >> snapshotpath;
+    bool fusion = !cmdl["--no-fusion"];
+    int engine = VM_findengine(enginename.c_str());
+    if (engine < 0) {
+        fprintf(stderr, "unknown engine '%s'\n", enginename.c_str());
+        return 1;
+    }
+    if (updxframes == 0) {updxframes = 1;}
+    if (runs == 0) {runs = 1;}
+
+    VM_machineconfig config = VM_defaultconfig();
+    config.coreamount = (uint8_t)coreamount;
+    config.memrows = (uint16_t)memrows;
+    config.engine = (uint8_t)engine;
+
+    VM_snapshotfile snapshot = {NULL, 0};
+    if (!snapshotpath.empty()) {
+        snapshot = VM_mapsnapshot(snapshotpath.c_str());
+        if (!VM_checksnapshot(snapshot.data, snapshot.size)) {
+            fprintf(stderr, "failed to load snapshot '%s'\n", snapshotpath.c_str());
+            return 2;
+        }
+    }
+
+    VM_replay replay = {};
+    if (!replaypath.empty()) {
+        if (!VM_loadreplay(replaypath.c_str(), &replay)) {
+            fprintf(stderr, "failed to load recording '%s'\n", replaypath.c_str());
+            return 2;
+        }
+        snapshot.data = replay.snapshots[0].blob;
+        snapshot.size = replay.snapshots[0].size;
+        config = VM_snapshotconfig(VM_checksnapshot(snapshot.data, snapshot.size));
+        config.engine = (uint8_t)engine;
+    }
+
+    bool ok = true;
+    for (uint64_t i=0;i<warmup && ok;i++) {
+        bench_once(config, rom, snapshot, scriptpath, replaypath.empty() ? NULL : &replay, cycles, updxframes, fusion, &ok);
+    }
+    std::vector<double> mips, nsperinst, nsperframe, rendernsperframe, fps, rendershare;
+    BENCH_run last = {};
+    for (uint64_t i=0;i<runs && ok;i++) {
+        last = bench_once(config, rom, snapshot, scriptpath, replaypath.empty() ? NULL : &replay, cycles, updxframes, fusion, &ok);
+        double instructions = (double)last.cycles*config.coreamount;
+        mips.push_back(instructions/last.seconds/1e6);
+        nsperinst.push_back(last.seconds*1e9/instructions);
+        nsperframe.push_back(last.seconds*1e9/last.frames);
+        rendernsperframe.push_back(last.renderseconds*1e9/last.frames);
+        fps.push_back(last.frames/last.seconds);
+        rendershare.push_back(last.renderseconds/last.seconds);
+    }
+    if (!replaypath.empty()) {
+        VM_delreplay(&replay);
+    } else {
+        VM_unmapsnapshot(&snapshot);
+    }
+    if (!ok) {
+        fprintf(stderr, "failed to load '%s'\n", rom.c_str());
+        return 2;
+    }
+
+    double mean, stddev, min, max;
+    printf("{\"name\": \"%s\", \"engine\": \"%s\", \"fusion\": %s, \"cycles\": %llu, \"instructions\": %llu, \"runs\": %llu, \"halted\": %s, \"halt_ip\": %u",
+        bench_escape(name).c_str(), enginename.c_str(), fusion ? "true" : "false", (unsigned long long)last.cycles, (unsigned long long)last.cycles*config.coreamount, (unsigned long long)runs,
+        last.halted ? "true" : "false", last.haltip);
+    bench_stats(mips, &mean, &stddev, &min, &max);
+    printf(", \"mips\": {\"mean\": %.4f, \"stddev\": %.4f, \"min\": %.4f, \"max\": %.4f}", mean, stddev, min, max);
+    bench_stats(nsperinst, &mean, &stddev, &min, &max);
+    printf(", \"ns_per_instruction\": {\"mean\": %.3f, \"stddev\": %.3f}", mean, stddev);
+    printf(", \"frames\": %llu", (unsigned long long)last.frames);
+    bench_stats(fps, &mean, &stddev, &min, &max);
+    printf(", \"frames_per_second\": {\"mean\": %.1f, \"stddev\": %.1f}", mean, stddev);
+    bench_stats(nsperframe, &mean, &stddev, &min, &max);
+    printf(", \"ns_per_frame\": {\"mean\": %.1f, \"stddev\": %.1f}", mean, stddev);
+    bench_stats(rendernsperframe, &mean, &stddev, &min, &max);
+    printf(", \"render_ns_per_frame\": {\"mean\": %.1f, \"stddev\": %.1f}", mean, stddev);
+    bench_stats(rendershare, &mean, &stddev, &min, &max);
+    printf(", \"render_share\": {\"mean\": %.4f, \"stddev\": %.4f}}\n", mean, stddev); // of the whole run time
+
+    return 0;
+}
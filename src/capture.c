@@ -0,0 +1,275 @@
+/*
+Frame capture to y4m or PNG, see capture.h.
+*/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+
+typedef struct VM_captureframebuf {
+    struct VM_captureframebuf* next;
+    uint8_t pixels[]; // color indices, width*height
+} VM_captureframebuf;
+
+struct VM_capture {
+    uint8_t png;
+    char path[512]; // the pattern for PNGs
+    FILE* video;
+    uint32_t width;
+    uint32_t height;
+
+    pthread_t thread;
+    pthread_mutex_t lock; // only held to link frames in and out, never while writing
+    pthread_cond_t wake;
+    VM_captureframebuf* head; // oldest queued frame
+    VM_captureframebuf* tail;
+    VM_captureframebuf* spare; // written frames, reused by VM_captureframe
+    uint8_t stopping;
+    uint8_t failed;
+    uint64_t written;
+
+    uint8_t yuv[16][3]; // per terminal color, BT.601 studio range
+    uint8_t* planes; // one y4m frame
+};
+
+static uint32_t VM_crctable[256];
+static void VM_makecrctable(void) {
+    for (uint32_t i=0;i<256;i++) {
+        uint32_t crc = i;
+        for (int bit=0;bit<8;bit++) {
+            crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+        VM_crctable[i] = crc;
+    }
+}
+static uint32_t VM_crc(uint32_t crc, const uint8_t* data, uint64_t size) {
+    crc = ~crc;
+    for (uint64_t i=0;i<size;i++) {
+        crc = VM_crctable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+static void VM_putbe32(uint8_t* out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+static uint8_t VM_pngchunk(FILE* file, const char* type, const uint8_t* data, uint32_t size) {
+    uint8_t header[8];
+    VM_putbe32(header, size);
+    memcpy(header+4, type, 4);
+    uint8_t crc[4];
+    VM_putbe32(crc, VM_crc(VM_crc(0, header+4, 4), data, size));
+    return fwrite(header, 1, 8, file) == 8 && (size == 0 || fwrite(data, 1, size, file) == size) && fwrite(crc, 1, 4, file) == 4;
+}
+static uint8_t VM_writepng(const VM_capture* capture, const uint8_t* pixels, uint64_t index) {
+    char path[600];
+    snprintf(path, sizeof(path), capture->path, (unsigned long long)index);
+    FILE* file = fopen(path, "wb");
+    if (!file) {return 0;}
+
+    uint8_t ihdr[13];
+    VM_putbe32(ihdr, capture->width);
+    VM_putbe32(ihdr+4, capture->height);
+    ihdr[8] = 8; // bits per index
+    ihdr[9] = 3; // palette
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    uint8_t plte[16*3];
+    memcpy(plte, VM_colortable, sizeof(plte));
+
+    // zlib stream of stored deflate blocks: every row is a filter byte (0, none) and the indices
+    uint64_t raw = (uint64_t)(capture->width+1)*capture->height;
+    uint64_t blocks = raw/65535+1;
+    uint8_t* idat = (uint8_t*)malloc(2+raw+blocks*5+4);
+    if (!idat) {
+        fclose(file);
+        return 0;
+    }
+    uint64_t at = 0, a = 1, b = 0, done = 0;
+    idat[at++] = 0x78;
+    idat[at++] = 0x01;
+    uint32_t x = 0, y = 0;
+    while (done < raw) {
+        uint32_t length = raw-done > 65535 ? 65535 : (uint32_t)(raw-done);
+        idat[at++] = done+length == raw; // BFINAL, stored
+        idat[at++] = length & 0xFF;
+        idat[at++] = length >> 8;
+        idat[at++] = ~length & 0xFF;
+        idat[at++] = (~length >> 8) & 0xFF;
+        for (uint32_t i=0;i<length;i++) {
+            uint8_t byte;
+            if (x == 0) {
+                byte = 0;
+            } else {
+                byte = pixels[y*capture->width+x-1] & 0b1111;
+            }
+            if (++x > capture->width) {
+                x = 0;
+                y ++;
+            }
+            idat[at++] = byte;
+            a = (a+byte) % 65521;
+            b = (b+a) % 65521;
+        }
+        done += length;
+    }
+    VM_putbe32(idat+at, (uint32_t)(b << 16 | a));
+    at += 4;
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t ok = fwrite(signature, 1, 8, file) == 8 && VM_pngchunk(file, "IHDR", ihdr, 13) && VM_pngchunk(file, "PLTE", plte, sizeof(plte)) &&
+        VM_pngchunk(file, "IDAT", idat, (uint32_t)at) && VM_pngchunk(file, "IEND", NULL, 0);
+    free(idat);
+    return fclose(file) == 0 && ok;
+}
+static uint8_t VM_writey4m(VM_capture* capture, const uint8_t* pixels) {
+    uint64_t amount = (uint64_t)capture->width*capture->height;
+    for (uint64_t i=0;i<amount;i++) {
+        const uint8_t* yuv = capture->yuv[pixels[i] & 0b1111];
+        capture->planes[i] = yuv[0];
+        capture->planes[amount+i] = yuv[1];
+        capture->planes[2*amount+i] = yuv[2];
+    }
+    return fwrite("FRAME\n", 1, 6, capture->video) == 6 && fwrite(capture->planes, 1, 3*amount, capture->video) == 3*amount;
+}
+
+static void* VM_capturethread(void* arg) {
+    VM_capture* capture = (VM_capture*)arg;
+    for (;;) {
+        pthread_mutex_lock(&capture->lock);
+        while (!capture->head && !capture->stopping) {
+            pthread_cond_wait(&capture->wake, &capture->lock);
+        }
+        VM_captureframebuf* frame = capture->head;
+        if (!frame) { // stopping and drained
+            pthread_mutex_unlock(&capture->lock);
+            return NULL;
+        }
+        capture->head = frame->next;
+        if (!capture->head) {capture->tail = NULL;}
+        pthread_mutex_unlock(&capture->lock);
+
+        if (!capture->failed) {
+            uint8_t ok = capture->png ? VM_writepng(capture, frame->pixels, capture->written) : VM_writey4m(capture, frame->pixels);
+            if (ok) {
+                capture->written ++;
+            } else {
+                capture->failed = 1;
+            }
+        }
+
+        pthread_mutex_lock(&capture->lock);
+        frame->next = capture->spare;
+        capture->spare = frame;
+        pthread_mutex_unlock(&capture->lock);
+    }
+}
+
+static uint8_t VM_endswith(const char* text, const char* end) {
+    size_t length = strlen(text), endlength = strlen(end);
+    return length >= endlength && strcmp(text+length-endlength, end) == 0;
+}
+static uint8_t VM_clampyuv(double value) {
+    return value < 0 ? 0 : value > 255 ? 255 : (uint8_t)(value+0.5);
+}
+
+VM_capture* VM_newcapture(const char* path, const VM_term* term, uint32_t fps) {
+    uint8_t png = VM_endswith(path, ".png");
+    if (!png && !VM_endswith(path, ".y4m")) {return NULL;}
+    if (strlen(path) >= sizeof(((VM_capture*)0)->path)) {return NULL;}
+    if (png) { // exactly one number conversion, made into %llu
+        const char* percent = strchr(path, '%');
+        if (!percent || strchr(percent+1, '%')) {return NULL;}
+    }
+
+    VM_capture* capture = (VM_capture*)calloc(1, sizeof(VM_capture));
+    if (!capture) {return NULL;}
+    capture->png = png;
+    capture->width = 8*(uint32_t)term->charsnh;
+    capture->height = 8*(uint32_t)term->charsnv;
+    if (png) {
+        const char* percent = strchr(path, '%');
+        const char* conversion = percent+1+strspn(percent+1, "0123456789");
+        if (*conversion != 'd' && *conversion != 'u') {
+            free(capture);
+            return NULL;
+        }
+        snprintf(capture->path, sizeof(capture->path), "%.*sllu%s", (int)(conversion-path), path, conversion+1);
+        VM_makecrctable();
+    } else {
+        capture->video = fopen(path, "wb");
+        capture->planes = (uint8_t*)malloc(3*(uint64_t)capture->width*capture->height);
+        if (!capture->video || !capture->planes) {
+            if (capture->video) {fclose(capture->video);}
+            free(capture->planes);
+            free(capture);
+            return NULL;
+        }
+        fprintf(capture->video, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", capture->width, capture->height, fps ? fps : 1);
+        for (int i=0;i<16;i++) {
+            double r = VM_colortable[i][0], g = VM_colortable[i][1], b = VM_colortable[i][2];
+            capture->yuv[i][0] = VM_clampyuv(16+(65.481*r+128.553*g+24.966*b)/255);
+            capture->yuv[i][1] = VM_clampyuv(128+(-37.797*r-74.203*g+112.0*b)/255);
+            capture->yuv[i][2] = VM_clampyuv(128+(112.0*r-93.786*g-18.214*b)/255);
+        }
+    }
+
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->wake, NULL);
+    if (pthread_create(&capture->thread, NULL, VM_capturethread, capture) != 0) {
+        pthread_mutex_destroy(&capture->lock);
+        pthread_cond_destroy(&capture->wake);
+        if (capture->video) {fclose(capture->video);}
+        free(capture->planes);
+        free(capture);
+        return NULL;
+    }
+    return capture;
+}
+void VM_captureframe(VM_capture* capture, const VM_term* term) {
+    uint64_t size = (uint64_t)capture->width*capture->height;
+    pthread_mutex_lock(&capture->lock);
+    VM_captureframebuf* frame = capture->spare;
+    if (frame) {capture->spare = frame->next;}
+    pthread_mutex_unlock(&capture->lock);
+    if (!frame) {
+        frame = (VM_captureframebuf*)malloc(sizeof(VM_captureframebuf)+size);
+        if (!frame) {return;}
+    }
+    memcpy(frame->pixels, term->pixbuf, size);
+    frame->next = NULL;
+
+    pthread_mutex_lock(&capture->lock);
+    if (capture->tail) {
+        capture->tail->next = frame;
+    } else {
+        capture->head = frame;
+    }
+    capture->tail = frame;
+    pthread_cond_signal(&capture->wake);
+    pthread_mutex_unlock(&capture->lock);
+}
+uint64_t VM_delcapture(VM_capture* capture, uint8_t* failed) {
+    if (!capture) {return 0;}
+    pthread_mutex_lock(&capture->lock);
+    capture->stopping = 1;
+    pthread_cond_signal(&capture->wake);
+    pthread_mutex_unlock(&capture->lock);
+    pthread_join(capture->thread, NULL);
+
+    while (capture->spare) {
+        VM_captureframebuf* next = capture->spare->next;
+        free(capture->spare);
+        capture->spare = next;
+    }
+    if (capture->video && fclose(capture->video) != 0) {capture->failed = 1;}
+    pthread_mutex_destroy(&capture->lock);
+    pthread_cond_destroy(&capture->wake);
+    uint64_t written = capture->written;
+    if (failed) {*failed = capture->failed;}
+    free(capture->planes);
+    free(capture);
+    return written;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+#include "terminal.h"
+
+// writes terminal frames to a y4m video or a numbered PNG sequence. VM_captureframe only copies the
+// frame into a queue, a background thread converts and writes it, so the emulation never waits on
+// the disk. the queue grows instead of dropping frames: every frame pushed ends up in the file.
+// PNGs are palette images (the 16 terminal colors) with stored deflate blocks, no zlib needed.
+typedef struct VM_capture VM_capture;
+
+// path ending in .y4m: one video, fps only goes into its header.
+// path ending in .png with a printf number in it (frames/%06d.png): one file per frame, counting from 0
+VM_capture* VM_newcapture(const char* path, const VM_term* term, uint32_t fps); // NULL if the path fits neither or can't be opened
+void VM_captureframe(VM_capture* capture, const VM_term* term);
+uint64_t VM_delcapture(VM_capture* capture, uint8_t* failed); // writes what is queued, returns the frames written. failed: a write failed and the rest was dropped
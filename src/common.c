@@ -23,5 +23,12 @@ VM_word readreg(VM_registers* regs, uint8_t index) {
 	}
 	return (*regs)[index-1];
 }
-
-
+uint64_t VM_hashbytes(const void* data, uint64_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint64_t hash = 0xCBF29CE484222325;
+	for (uint64_t i=0;i<size;i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3;
+	}
+	return hash;
+}
@@ -18,5 +18,6 @@ typedef uint16_t VM_aluword;
 void patchword(VM_word* word);
 void writereg(VM_registers* regs, uint8_t index, VM_word word);
 VM_word readreg(VM_registers* regs, uint8_t index);
+uint64_t VM_hashbytes(const void* data, uint64_t size); // FNV-1a, for comparing memory/framebuffers between runs
 
 
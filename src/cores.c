@@ -8,7 +8,7 @@ Written by Justus Wolff in very late 2025.
 #include "config.h"
 #include "memory.h"
 
-VM_vminstance VM_newinstance(uint8_t memsize, uint8_t coreamount, const uint8_t* coretypes, uint16_t rowsize, uint8_t allowsmul, uint8_t maketracedump, uint64_t tracesize) {
+VM_vminstance VM_newinstance(uint16_t memsize, uint8_t coreamount, const uint8_t* coretypes, uint16_t rowsize, uint8_t allowsmul, uint8_t maketracedump, uint64_t tracesize) {
     VM_vminstance out;
     memset(&out, 0, sizeof(out));
 
@@ -37,21 +37,42 @@ VM_vminstance VM_newinstance(uint8_t memsize, uint8_t coreamount, const uint8_t*
     return out;
 }
 void VM_delinstance(VM_vminstance inst) {
-    free(inst.memory.content);
+    VM_delmemory(&inst.memory);
     free(inst.backtrace);
     free(inst.backtraceaddrs);
     free(inst.backtraceop);
+    free(inst.ipcounts);
+    VM_delcallprof(inst.callprof);
+    free(inst.counters);
 }
-void VM_execinstruction(VM_vminstance* _inst, uint8_t coreindex) {
-    VM_vminstance inst = *_inst;
+void VM_attachcounters(VM_vminstance* inst, VM_counters* counters) { // NULL detaches
+    inst->counters = counters;
+    inst->memory.rhcounts = counters ? counters->hookreads : NULL;
+    inst->memory.whcounts = counters ? counters->hookwrites : NULL;
+}
+const VM_counters* VM_getcounters(const VM_vminstance* inst) { // live view, NULL if not counting
+    return inst->counters;
+}
+void VM_execinstruction(VM_vminstance* inst, uint8_t coreindex) {
     // fetch instruction from memory
-    if (inst.IP > VM_getsize(inst.memory.rows, inst.memory.rowsize)) {inst.IP = VM_nullword;} // reset IP
+    inst->IP &= 0xFFFF; // the IP wraps around the address space, memory mirrors through all of it
 
-    VM_word instruction = VM_memread(inst.memory, inst.IP);
+    VM_word instruction = VM_memread(&inst->memory, inst->IP);
+
+    if (inst->samplepoint) {
+        *inst->samplepoint = (inst->IP & 0xFFFF) | ((uint32_t)coreindex << 16);
+    }
+    if (inst->ipcounts) {
+        inst->ipcounts[inst->IP & 0xFFFF] ++;
+    }
+    if (inst->callprof) {
+        VM_proftick(inst->callprof);
+    }
 
-    if (inst.maketracedump) {
-        inst.backtrace[inst.tracesize] = instruction;
-        inst.backtraceaddrs[inst.tracesize] = inst.IP;
+    uint8_t tracing = inst->maketracedump && inst->tracesize < inst->maxtracesize; // stop recording once the trace buffer is full
+    if (tracing) {
+        inst->backtrace[inst->tracesize] = instruction;
+        inst->backtraceaddrs[inst->tracesize] = inst->IP;
     }
 
     uint8_t moi = instruction >> 31; // msb operation index
@@ -63,15 +84,15 @@ void VM_execinstruction(VM_vminstance* _inst, uint8_t coreindex) {
 	uint16_t rawssrcreg = ssrcreg;
 
     if (!soii) {
-        ssrcreg = readreg(&inst.regs, ssrcreg);
+        ssrcreg = readreg(&inst->regs, ssrcreg);
     }
 
     patchword((VM_word*)&ssrcreg);
 
-    if (inst.maketracedump) {
-        inst.backtraceop[inst.tracesize][0] = destreg;
-        inst.backtraceop[inst.tracesize][1] = readreg(&inst.regs, psrcreg);
-        inst.backtraceop[inst.tracesize++][2] = ssrcreg;
+    if (tracing) {
+        inst->backtraceop[inst->tracesize][0] = destreg;
+        inst->backtraceop[inst->tracesize][1] = readreg(&inst->regs, psrcreg);
+        inst->backtraceop[inst->tracesize++][2] = ssrcreg;
     }
 
     // jmp conditions
@@ -80,9 +101,14 @@ void VM_execinstruction(VM_vminstance* _inst, uint8_t coreindex) {
 
 
 
-    VM_registers* regs = &inst.regs;
-    VM_flags* flags = &inst.flags;
-    uint8_t coretype = inst.cores[coreindex];
+    if (inst->counters) {
+        inst->counters->ops[moi][loi] ++;
+        inst->counters->slotinstructions[coreindex] ++;
+    }
+
+    VM_registers* regs = &inst->regs;
+    VM_flags* flags = &inst->flags;
+    uint8_t coretype = inst->cores[coreindex];
     uint8_t skipins = 0;
 
     switch (loi) {
@@ -115,64 +141,78 @@ void VM_execinstruction(VM_vminstance* _inst, uint8_t coreindex) {
             writereg(regs, destreg, VM_and(readreg(regs, psrcreg), ssrcreg, moi ? flags : 0x00));
             break;
         case 13: // hlt
-            inst.halted = 1;
+            inst->halted = 1;
             break;
         case 14: // mul or muls
             // check if core is multiply capable or else skip instruction.
             if (moi == 0) {
-                if ((coretype == 1 && inst.allowsmul) || coretype == 2) {
+                if ((coretype == 1 && inst->allowsmul) || coretype == 2) {
                     writereg(regs, destreg, VM_mul(readreg(regs, psrcreg), ssrcreg));
                 } else {
                     skipins = 1;
+                    if (inst->counters) {inst->counters->mulskipped ++;}
                 }
             } else {
-                if ((coretype == 1 && inst.allowsmul) || coretype == 2) {
+                if ((coretype == 1 && inst->allowsmul) || coretype == 2) {
                     writereg(regs, destreg, VM_muls(readreg(regs, psrcreg), ssrcreg));
                 } else {
                     skipins = 1;
+                    if (inst->counters) {inst->counters->mulskipped ++;}
                 }
             }
             break;
         case 15: // mulh or mulx
             // check if core is multiply capable or else skip instruction.
             if (moi == 0) {
-                if ((coretype == 1 && inst.allowsmul) || coretype == 2) {
+                if ((coretype == 1 && inst->allowsmul) || coretype == 2) {
                     writereg(regs, destreg, VM_mulh(readreg(regs, psrcreg), ssrcreg));
                 } else {
                     skipins = 1;
+                    if (inst->counters) {inst->counters->mulskipped ++;}
                 }
             } else {
-                if ((coretype == 1 && inst.allowsmul) || coretype == 2) {
+                if ((coretype == 1 && inst->allowsmul) || coretype == 2) {
                     writereg(regs, destreg, VM_mulx(readreg(regs, psrcreg), ssrcreg));
                 } else {
                     skipins = 1;
+                    if (inst->counters) {inst->counters->mulskipped ++;}
                 }
             }
             break;
         case 1: // jmp...
             VM_word condtable[16];
-            VM_generatecondtable(inst.flags, condtable);
+            VM_generatecondtable(inst->flags, condtable);
+            if (inst->counters) {
+                if (condtable[condindex]) {
+                    inst->counters->jmptaken ++;
+                } else {
+                    inst->counters->jmpnottaken ++;
+                }
+            }
             if (condtable[condindex]) {
                 skipins = 1;
-                if (!sync || (sync && coreindex != (inst.coreamount))) {
-                    writereg(regs, destreg, inst.IP+1);
-                    inst.IP = ssrcreg;
+                if (!sync || (sync && coreindex != (inst->coreamount))) {
+                    writereg(regs, destreg, inst->IP+1);
+                    if (inst->callprof) {
+                        VM_profjump(inst->callprof, inst->IP, ssrcreg, destreg, !soii);
+                    }
+                    inst->IP = ssrcreg;
                 }
             }
             break;
         case 2: // ld
-            inst.sch_mode = 0x0;
-            inst.sch_addr = VM_aluwordlimit(readreg(&inst.regs, psrcreg))+VM_aluwordlimit(ssrcreg);
-            inst.sch_reg = destreg;
+            inst->sch_mode = 0x0;
+            inst->sch_addr = VM_aluwordlimit(readreg(&inst->regs, psrcreg))+VM_aluwordlimit(ssrcreg);
+            inst->sch_reg = destreg;
             break;
         case 10: // st
-            inst.sch_mode = 0x1;
-            inst.sch_addr = VM_aluwordlimit(readreg(&inst.regs, psrcreg))+VM_aluwordlimit(ssrcreg);
-            inst.sch_reg = destreg;
+            inst->sch_mode = 0x1;
+            inst->sch_addr = VM_aluwordlimit(readreg(&inst->regs, psrcreg))+VM_aluwordlimit(ssrcreg);
+            inst->sch_reg = destreg;
             break;
         default: // mov/exh
             if (loi == 0) {
-                VM_word newval = ((readreg(&inst.regs, psrcreg)>>16)<<16)|(ssrcreg&0xFFFF);
+                VM_word newval = ((readreg(&inst->regs, psrcreg)>>16)<<16)|(ssrcreg&0xFFFF);
                 patchword(&newval);
                 writereg(regs, destreg, newval);
                 if (moi) {
@@ -182,7 +222,7 @@ void VM_execinstruction(VM_vminstance* _inst, uint8_t coreindex) {
                 }
                 break;
             } else { // exh
-                VM_word newval2 = (readreg(&inst.regs, psrcreg)<<16)|(ssrcreg>>16);
+                VM_word newval2 = (readreg(&inst->regs, psrcreg)<<16)|(ssrcreg>>16);
                 patchword(&newval2);
                 writereg(regs, destreg, newval2);
                 if (moi) {
@@ -196,30 +236,35 @@ void VM_execinstruction(VM_vminstance* _inst, uint8_t coreindex) {
     }
 
     if (!skipins) {
-        inst.IP ++;
+        inst->IP ++;
     }
-
-    *_inst = inst;
 }
 void VM_handleschmem(VM_vminstance* inst) {
+    if (inst->counters && inst->sch_mode < 0x2) {
+        if (inst->sch_mode == 0x0) {
+            inst->counters->loads ++;
+        } else {
+            inst->counters->stores ++;
+        }
+    }
     if (inst->sch_mode == 0x0) { // memread
-        writereg(&inst->regs, inst->sch_reg, VM_memread(inst->memory, inst->sch_addr));
+        writereg(&inst->regs, inst->sch_reg, VM_memread(&inst->memory, inst->sch_addr));
     }
     if (inst->sch_mode == 0x1) { // memwrite
         VM_memwrite(&inst->memory, inst->sch_addr, readreg(&inst->regs, inst->sch_reg));
     }
     inst->sch_mode = 0x2;
 }
-void VM_instcycle(VM_vminstance* _inst) {
-    VM_vminstance inst = *_inst;
-
-    for (uint8_t i=0;i<inst.coreamount;i++) {
-        VM_handleschmem(&inst);
-        if (inst.halted) {break;}
-        VM_execinstruction(&inst, i);
+void VM_instcycle(VM_vminstance* inst) {
+    if (inst->counters) {
+        inst->counters->cycles ++;
     }
-    VM_handleschmem(&inst);
-
-    *_inst = inst;
+    for (uint8_t i=0;i<inst->coreamount;i++) {
+        VM_handleschmem(inst);
+        if (inst->halted) {break;}
+        VM_execinstruction(inst, i);
+    }
+    VM_handleschmem(inst);
+    inst->cycles ++;
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "memory.h"
+#include "profiler.h"
+#include "counters.h"
 #include <stdint.h>
 
 typedef struct {
@@ -17,6 +19,7 @@ typedef struct {
     VM_flags flags;
     VM_word IP;
     uint8_t halted;
+    uint64_t cycles; // VM_instcycle calls so far
 
     uint16_t sch_addr; // schedule addr
     uint8_t sch_mode; // schedule mode
@@ -30,8 +33,17 @@ typedef struct {
     VM_word* backtraceaddrs;
     VM_word (*backtraceop)[3];
     uint64_t tracesize;
+
+    uint64_t* ipcounts; // per address execution counters (see profiler.h), NULL if not profiling
+    VM_callprof* callprof; // call graph profiler, NULL if not profiling
+    VM_counters* counters; // performance counters, NULL if not counting. attach with VM_attachcounters
+    volatile uint32_t* samplepoint; // receives IP | coreslot<<16 for the sampling profiler, NULL if not sampling
 } VM_vminstance;
 
-VM_vminstance VM_newinstance(uint8_t memsize, uint8_t coreamount, const uint8_t* coretypes, uint16_t rowsize, uint8_t allowsmul, uint8_t maketracedump, uint64_t tracesize);
+VM_vminstance VM_newinstance(uint16_t memsize, uint8_t coreamount, const uint8_t* coretypes, uint16_t rowsize, uint8_t allowsmul, uint8_t maketracedump, uint64_t tracesize);
 void VM_delinstance(VM_vminstance inst);
 void VM_instcycle(VM_vminstance* _inst);
+void VM_execinstruction(VM_vminstance* _inst, uint8_t coreindex); // one core slot, without the pending ld/st
+void VM_handleschmem(VM_vminstance* inst); // runs the ld/st scheduled by the previous slot
+void VM_attachcounters(VM_vminstance* inst, VM_counters* counters);
+const VM_counters* VM_getcounters(const VM_vminstance* inst);
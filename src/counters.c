@@ -0,0 +1,74 @@
+/*
+Performance counters.
+*/
+#include <stdlib.h>
+#include "counters.h"
+#include "engine.h"
+
+const char VM_opnames[2][16][5] = { // [moi][loi], same names the disassembler uses. "sh" counts shl and shr together
+    {"mov", "jmp", "ld", "exh", "subs", "sbbs", "adds", "adcs", "xors", "ors", "st", "shs", "ands", "hlt", "mul", "mulh"},
+    {"movf", "jmp", "ld", "exh", "sub", "sbb", "add", "adc", "xor", "or", "st", "sh", "and", "hlt", "muls", "mulx"},
+};
+
+VM_counters* VM_newcounters(void) {
+    return (VM_counters*)calloc(1, sizeof(VM_counters));
+}
+void VM_writecountersjson(FILE* out, const VM_counters* counters, const VM_memory* memory) {
+    uint64_t instructions = 0;
+    for (uint8_t i=0;i<50;i++) {
+        instructions += counters->slotinstructions[i];
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"cycles\": %llu,\n", (unsigned long long)counters->cycles);
+    fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long)instructions);
+
+    fprintf(out, "  \"slots\": [");
+    uint8_t lastslot = 0;
+    for (uint8_t i=0;i<50;i++) {
+        if (counters->slotinstructions[i]) {lastslot = i;}
+    }
+    for (uint8_t i=0;i<=lastslot;i++) {
+        fprintf(out, i ? ", %llu" : "%llu", (unsigned long long)counters->slotinstructions[i]);
+    }
+    fprintf(out, "],\n");
+
+    fprintf(out, "  \"ops\": {");
+    uint8_t first = 1;
+    for (uint8_t moi=0;moi<2;moi++) {
+        for (uint8_t loi=0;loi<16;loi++) {
+            if (!counters->ops[moi][loi]) {continue;}
+            fprintf(out, "%s\n    \"%s\": %llu", first ? "" : ",", VM_opnames[moi][loi], (unsigned long long)counters->ops[moi][loi]);
+            first = 0;
+        }
+    }
+    fprintf(out, "%s},\n", first ? "" : "\n  ");
+
+    fprintf(out, "  \"jumps\": {\"taken\": %llu, \"nottaken\": %llu},\n", (unsigned long long)counters->jmptaken, (unsigned long long)counters->jmpnottaken);
+    fprintf(out, "  \"memory\": {\"loads\": %llu, \"stores\": %llu},\n", (unsigned long long)counters->loads, (unsigned long long)counters->stores);
+    fprintf(out, "  \"mulskipped\": %llu,\n", (unsigned long long)counters->mulskipped);
+
+    // pairs, each one covers two of the instructions above
+    uint64_t fused = 0;
+    fprintf(out, "  \"fused\": {");
+    for (uint8_t i=VM_fuse_none+1;i<VM_fuseamount;i++) {
+        fprintf(out, "%s\"%s\": %llu", i == VM_fuse_none+1 ? "" : ", ", VM_fusename(i), (unsigned long long)counters->fused[i]);
+        fused += counters->fused[i];
+    }
+    fprintf(out, ", \"rate\": %.4f},\n", instructions ? 2.0*fused/instructions : 0.0);
+
+    fprintf(out, "  \"mmio\": [");
+    first = 1;
+    for (uint16_t i=0;i<memory->rha;i++) {
+        fprintf(out, "%s\n    {\"kind\": \"read\", \"from\": %u, \"to\": %u, \"count\": %llu}", first ? "" : ",",
+            memory->rhaddrf[i], memory->rhaddrt[i], (unsigned long long)counters->hookreads[i]);
+        first = 0;
+    }
+    for (uint16_t i=0;i<memory->wha;i++) {
+        fprintf(out, "%s\n    {\"kind\": \"write\", \"from\": %u, \"to\": %u, \"count\": %llu}", first ? "" : ",",
+            memory->whaddrf[i], memory->whaddrt[i], (unsigned long long)counters->hookwrites[i]);
+        first = 0;
+    }
+    fprintf(out, "%s]\n", first ? "" : "\n  ");
+    fprintf(out, "}\n");
+}
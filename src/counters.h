@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "memory.h"
+
+// performance counters, only updated while attached to an instance
+typedef struct {
+    uint64_t cycles; // VM_instcycle calls
+    uint64_t slotinstructions[50]; // instructions executed per core slot
+    uint64_t ops[2][16]; // [moi][loi]
+    uint64_t jmptaken;
+    uint64_t jmpnottaken;
+    uint64_t loads; // ld handled by VM_handleschmem
+    uint64_t stores; // st handled by VM_handleschmem
+    uint64_t mulskipped; // mul* on cores that cant multiply
+    uint64_t fused[8]; // instruction pairs run as one op by the predecoded engine, per VM_fuse_* kind (engine.h)
+    uint64_t hookreads[32]; // per read hook (device range) of the memory
+    uint64_t hookwrites[32]; // per write hook
+} VM_counters;
+
+VM_counters* VM_newcounters(void);
+void VM_writecountersjson(FILE* out, const VM_counters* counters, const VM_memory* memory);
@@ -0,0 +1,371 @@
+/*
+Breakpoints and watchpoints, see debugger.h.
+*/
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debugger.h"
+
+enum {
+    VM_dx_const, VM_dx_reg, VM_dx_flag, VM_dx_ip, VM_dx_cycle, VM_dx_mem, VM_dx_not, VM_dx_neg, VM_dx_inv,
+    VM_dx_mul, VM_dx_div, VM_dx_mod, VM_dx_add, VM_dx_sub, VM_dx_and, VM_dx_or, VM_dx_xor, VM_dx_shl, VM_dx_shr,
+    VM_dx_eq, VM_dx_ne, VM_dx_lt, VM_dx_le, VM_dx_gt, VM_dx_ge, VM_dx_land, VM_dx_lor
+};
+
+// recursive descent with C precedence, emits postfix
+typedef struct {
+    const char* at;
+    VM_debugexpr* out;
+    uint8_t ok;
+} VM_exprparser;
+
+static void VM_emit(VM_exprparser* p, uint8_t op, uint32_t value) {
+    if (p->out->amount >= sizeof(p->out->ops)) {
+        p->ok = 0;
+        return;
+    }
+    p->out->ops[p->out->amount] = op;
+    p->out->values[p->out->amount++] = value;
+}
+static uint8_t VM_accept(VM_exprparser* p, const char* token, char notnext) { // notnext: the token must not be followed by it ('&' vs '&&')
+    while (isspace((unsigned char)*p->at)) {p->at++;}
+    size_t length = strlen(token);
+    if (strncmp(p->at, token, length) != 0) {return 0;}
+    if (notnext && p->at[length] == notnext) {return 0;}
+    p->at += length;
+    return 1;
+}
+
+static void VM_parseor(VM_exprparser* p);
+static void VM_parseprimary(VM_exprparser* p) {
+    while (isspace((unsigned char)*p->at)) {p->at++;}
+    if (VM_accept(p, "(", 0)) {
+        VM_parseor(p);
+        if (!VM_accept(p, ")", 0)) {p->ok = 0;}
+        return;
+    }
+    if (VM_accept(p, "[", 0)) {
+        VM_parseor(p);
+        if (!VM_accept(p, "]", 0)) {p->ok = 0;}
+        VM_emit(p, VM_dx_mem, 0);
+        return;
+    }
+    if (isdigit((unsigned char)*p->at)) {
+        char* end;
+        unsigned long value = strtoul(p->at, &end, 0);
+        p->at = end;
+        VM_emit(p, VM_dx_const, (uint32_t)value);
+        return;
+    }
+    char name[16];
+    uint8_t length = 0;
+    while (isalnum((unsigned char)*p->at) && length < sizeof(name)-1) {
+        name[length++] = (char)tolower((unsigned char)*p->at++);
+    }
+    name[length] = 0;
+    static const char* flags[4] = {"zf", "sf", "cf", "of"}; // VM_setflag indices
+    for (uint8_t i=0;i<4;i++) {
+        if (strcmp(name, flags[i]) == 0) {
+            VM_emit(p, VM_dx_flag, i);
+            return;
+        }
+    }
+    if (strcmp(name, "ip") == 0) {
+        VM_emit(p, VM_dx_ip, 0);
+    } else if (strcmp(name, "cycle") == 0) {
+        VM_emit(p, VM_dx_cycle, 0);
+    } else if (name[0] == 'r' && length > 1 && length <= 3 && isdigit((unsigned char)name[1]) && isdigit((unsigned char)name[length-1]) && atoi(name+1) < 32) {
+        VM_emit(p, VM_dx_reg, (uint32_t)atoi(name+1));
+    } else {
+        p->ok = 0;
+    }
+}
+static void VM_parseunary(VM_exprparser* p) {
+    if (VM_accept(p, "!", '=')) {
+        VM_parseunary(p);
+        VM_emit(p, VM_dx_not, 0);
+    } else if (VM_accept(p, "-", 0)) {
+        VM_parseunary(p);
+        VM_emit(p, VM_dx_neg, 0);
+    } else if (VM_accept(p, "~", 0)) {
+        VM_parseunary(p);
+        VM_emit(p, VM_dx_inv, 0);
+    } else {
+        VM_parseprimary(p);
+    }
+}
+
+// one precedence level: operands from next, the operators in tokens, longest first
+typedef struct {
+    const char* token;
+    char notnext;
+    uint8_t op;
+} VM_exprop;
+static void VM_parselevel(VM_exprparser* p, void (*next)(VM_exprparser*), const VM_exprop* ops, uint8_t amount) {
+    next(p);
+    while (p->ok) {
+        uint8_t found = 0;
+        for (uint8_t i=0;i<amount && !found;i++) {
+            if (VM_accept(p, ops[i].token, ops[i].notnext)) {
+                next(p);
+                VM_emit(p, ops[i].op, 0);
+                found = 1;
+            }
+        }
+        if (!found) {return;}
+    }
+}
+static void VM_parsemul(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"*", 0, VM_dx_mul}, {"/", 0, VM_dx_div}, {"%", 0, VM_dx_mod}};
+    VM_parselevel(p, VM_parseunary, ops, 3);
+}
+static void VM_parseadd(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"+", 0, VM_dx_add}, {"-", 0, VM_dx_sub}};
+    VM_parselevel(p, VM_parsemul, ops, 2);
+}
+static void VM_parseshift(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"<<", 0, VM_dx_shl}, {">>", 0, VM_dx_shr}};
+    VM_parselevel(p, VM_parseadd, ops, 2);
+}
+static void VM_parserel(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"<=", 0, VM_dx_le}, {">=", 0, VM_dx_ge}, {"<", '<', VM_dx_lt}, {">", '>', VM_dx_gt}};
+    VM_parselevel(p, VM_parseshift, ops, 4);
+}
+static void VM_parseeq(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"==", 0, VM_dx_eq}, {"!=", 0, VM_dx_ne}};
+    VM_parselevel(p, VM_parserel, ops, 2);
+}
+static void VM_parsebitand(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"&", '&', VM_dx_and}};
+    VM_parselevel(p, VM_parseeq, ops, 1);
+}
+static void VM_parsebitxor(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"^", 0, VM_dx_xor}};
+    VM_parselevel(p, VM_parsebitand, ops, 1);
+}
+static void VM_parsebitor(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"|", '|', VM_dx_or}};
+    VM_parselevel(p, VM_parsebitxor, ops, 1);
+}
+static void VM_parseand(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"&&", 0, VM_dx_land}};
+    VM_parselevel(p, VM_parsebitor, ops, 1);
+}
+static void VM_parseor(VM_exprparser* p) {
+    static const VM_exprop ops[] = {{"||", 0, VM_dx_lor}};
+    VM_parselevel(p, VM_parseand, ops, 1);
+}
+
+uint8_t VM_parsedebugexpr(const char* text, VM_debugexpr* out) {
+    VM_exprparser p = {text, out, 1};
+    out->amount = 0;
+    VM_parseor(&p);
+    while (isspace((unsigned char)*p.at)) {p.at++;}
+    if (!p.ok || *p.at) {
+        out->amount = 0;
+        return 0;
+    }
+    return 1;
+}
+VM_word VM_evaldebugexpr(const VM_debugexpr* expr, const VM_vminstance* inst) {
+    uint32_t stack[64];
+    uint8_t depth = 0;
+    for (uint8_t i=0;i<expr->amount;i++) {
+        uint8_t op = expr->ops[i];
+        if (op >= VM_dx_mul) {
+            uint32_t b = stack[--depth];
+            uint32_t a = stack[depth-1];
+            uint32_t out;
+            switch (op) {
+                case VM_dx_mul: out = a*b; break;
+                case VM_dx_div: out = b ? a/b : 0; break;
+                case VM_dx_mod: out = b ? a%b : 0; break;
+                case VM_dx_add: out = a+b; break;
+                case VM_dx_sub: out = a-b; break;
+                case VM_dx_and: out = a&b; break;
+                case VM_dx_or: out = a|b; break;
+                case VM_dx_xor: out = a^b; break;
+                case VM_dx_shl: out = b < 32 ? a << b : 0; break;
+                case VM_dx_shr: out = b < 32 ? a >> b : 0; break;
+                case VM_dx_eq: out = a == b; break;
+                case VM_dx_ne: out = a != b; break;
+                case VM_dx_lt: out = a < b; break;
+                case VM_dx_le: out = a <= b; break;
+                case VM_dx_gt: out = a > b; break;
+                case VM_dx_ge: out = a >= b; break;
+                case VM_dx_land: out = a && b; break;
+                default: out = a || b; break;
+            }
+            stack[depth-1] = out;
+            continue;
+        }
+        switch (op) {
+            case VM_dx_const: stack[depth++] = expr->values[i]; break;
+            case VM_dx_reg: stack[depth++] = expr->values[i] ? inst->regs[expr->values[i]-1] : 0; break;
+            case VM_dx_flag: stack[depth++] = (inst->flags >> expr->values[i]) & 1; break;
+            case VM_dx_ip: stack[depth++] = inst->IP; break;
+            case VM_dx_cycle: stack[depth++] = (uint32_t)inst->cycles; break;
+            case VM_dx_mem: {
+                uint32_t addr = stack[depth-1];
+                VM_word value = addr <= 0xFFFF ? VM_mempeek(&inst->memory, (uint16_t)addr) : VM_nullword;
+                patchword(&value);
+                stack[depth-1] = value;
+                break;
+            }
+            case VM_dx_not: stack[depth-1] = !stack[depth-1]; break;
+            case VM_dx_neg: stack[depth-1] = -stack[depth-1]; break;
+            default: stack[depth-1] = ~stack[depth-1]; break;
+        }
+    }
+    return depth ? stack[depth-1] : 1;
+}
+
+VM_debugger* VM_newdebugger(VM_machine* machine) {
+    if (!machine->engine || machine->engine->type != VM_engine_predecoded) {return NULL;}
+    VM_debugger* out = (VM_debugger*)calloc(1, sizeof(VM_debugger));
+    if (!out) {return NULL;}
+    out->machine = machine;
+    out->nextid = 1;
+    machine->engine->debugger = out;
+    VM_engineremark(machine->engine);
+    return out;
+}
+void VM_deldebugger(VM_debugger* debugger) {
+    if (!debugger) {return;}
+    debugger->machine->engine->debugger = NULL;
+    VM_engineremark(debugger->machine->engine);
+    free(debugger);
+}
+
+static VM_debugpoint* VM_newpoint(VM_debugger* debugger) {
+    if (debugger->amount >= sizeof(debugger->points)/sizeof(debugger->points[0])) {return NULL;}
+    VM_debugpoint* point = &debugger->points[debugger->amount];
+    memset(point, 0, sizeof(VM_debugpoint));
+    return point;
+}
+uint32_t VM_addbreakpoint(VM_debugger* debugger, uint16_t addr, const char* condition) {
+    VM_debugpoint* point = VM_newpoint(debugger);
+    if (!point) {return 0;}
+    if (condition && *condition) {
+        if (!VM_parsedebugexpr(condition, &point->condition)) {return 0;}
+        strncpy(point->text, condition, sizeof(point->text)-1);
+    }
+    point->from = addr;
+    point->to = addr;
+    point->id = debugger->nextid++;
+    debugger->amount ++;
+    VM_engineremark(debugger->machine->engine);
+    return point->id;
+}
+uint32_t VM_addwatchpoint(VM_debugger* debugger, uint16_t from, uint16_t to, uint8_t watch) {
+    VM_debugpoint* point = VM_newpoint(debugger);
+    if (!point || from > to || !(watch & (VM_watch_read | VM_watch_write))) {return 0;}
+    point->watch = watch & (VM_watch_read | VM_watch_write);
+    point->from = from;
+    point->to = to;
+    point->id = debugger->nextid++;
+    debugger->amount ++;
+    VM_engineremark(debugger->machine->engine);
+    return point->id;
+}
+uint8_t VM_removedebugpoint(VM_debugger* debugger, uint32_t id) {
+    for (uint8_t i=0;i<debugger->amount;i++) {
+        if (debugger->points[i].id != id) {continue;}
+        memmove(&debugger->points[i], &debugger->points[i+1], (debugger->amount-i-1)*sizeof(VM_debugpoint));
+        debugger->amount --;
+        VM_engineremark(debugger->machine->engine);
+        return 1;
+    }
+    return 0;
+}
+
+VM_stopreason VM_debugrun(VM_debugger* debugger, uint64_t cycles, uint64_t slots) {
+    VM_machine* machine = debugger->machine;
+    VM_vminstance* inst = &machine->instance;
+    uint64_t finished = 0, ran = 0;
+    debugger->reason = VM_stop_none;
+    debugger->running = 1;
+    for (;;) {
+        if (debugger->slot == 0) {
+            if (inst->halted) {
+                debugger->reason = VM_stop_halt;
+                break;
+            }
+            if (cycles && finished >= cycles) {
+                debugger->reason = VM_stop_budget;
+                break;
+            }
+            if (debugger->interrupt) {
+                debugger->interrupt = 0;
+                debugger->reason = VM_stop_interrupt;
+                break;
+            }
+            if (machine->script) {
+                VM_feedinput(machine->script, inst->cycles, &machine->keyboard);
+            }
+        }
+        if (debugger->slot < inst->coreamount) {
+            if (slots && ran >= slots) {
+                debugger->reason = VM_stop_budget;
+                break;
+            }
+            uint8_t resuming = debugger->resuming; // VM_debugfetch lets the instruction of the last stop through
+            uint8_t ok = VM_engineslot(machine->engine, inst, debugger->slot);
+            if (resuming) {debugger->resuming = 0;}
+            if (!ok && debugger->reason) {break;} // stopped before running the slot, it runs again next time
+            if (ok) {
+                debugger->slot ++;
+                ran ++;
+            } else { // halted, the cycle still ends like in VM_enginecycle
+                debugger->slot = inst->coreamount;
+            }
+            continue;
+        }
+        VM_enginefinish(machine->engine, inst);
+        debugger->slot = 0;
+        finished ++;
+        if (debugger->reason) {break;} // watchpoint on the last ld/st of the cycle
+    }
+    debugger->running = 0;
+    return debugger->reason;
+}
+
+uint8_t VM_debugfetch(VM_debugger* debugger, const VM_vminstance* inst, uint16_t addr) {
+    if (!debugger->running || debugger->resuming) {return 0;}
+    for (uint8_t i=0;i<debugger->amount;i++) {
+        VM_debugpoint* point = &debugger->points[i];
+        if (point->watch || point->from != addr) {continue;}
+        if (point->condition.amount && !VM_evaldebugexpr(&point->condition, inst)) {continue;}
+        point->hits ++;
+        debugger->reason = VM_stop_break;
+        debugger->pointid = point->id;
+        debugger->addr = addr;
+        debugger->value = 0;
+        debugger->resuming = 1;
+        return 1;
+    }
+    return 0;
+}
+uint8_t VM_debugaccess(VM_debugger* debugger, uint16_t addr, VM_word value, uint8_t write) {
+    if (!debugger->running) {return 0;}
+    for (uint8_t i=0;i<debugger->amount;i++) {
+        VM_debugpoint* point = &debugger->points[i];
+        if (!(point->watch & (write ? VM_watch_write : VM_watch_read)) || addr < point->from || addr > point->to) {continue;}
+        point->hits ++;
+        debugger->reason = write ? VM_stop_write : VM_stop_read;
+        debugger->pointid = point->id;
+        debugger->addr = addr;
+        debugger->value = value;
+        return 1;
+    }
+    return 0;
+}
+void VM_debugmark(const VM_debugger* debugger, uint8_t* rbitmap, uint8_t* wbitmap) {
+    for (uint8_t i=0;i<debugger->amount;i++) {
+        const VM_debugpoint* point = &debugger->points[i];
+        for (uint32_t addr=point->from;addr<=point->to;addr++) {
+            if (!point->watch || (point->watch & VM_watch_read)) {rbitmap[addr >> 3] |= 1 << (addr & 7);} // fetches go through the read bitmap
+            if (point->watch & VM_watch_write) {wbitmap[addr >> 3] |= 1 << (addr & 7);}
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include "machine.h"
+
+// breakpoints and watchpoints for the predecoded engine. their addresses are marked in the engine's hook
+// bitmaps (engine.h), so only fetches and ld/st of marked addresses take the slow path that looks at the
+// debugger, everything else runs exactly as without one. attaching one costs nothing until something is set.
+// VM_debugrun drives the machine one core slot at a time through VM_engineslot, so it can stop in the
+// middle of a cycle: before the instruction of a breakpoint, or right after the ld/st of a watchpoint.
+// the next run picks up at that slot.
+
+// conditions are C like expressions over r1..r31 (r0 is 0), the flags zf sf cf of, ip, cycle and
+// [addr] for a word of memory (read without triggering hooks), with numbers in decimal or 0x hex.
+// everything is unsigned 32 bit, comparisons and ! && || give 0 or 1, division by 0 gives 0.
+typedef struct {
+    uint8_t ops[64];
+    uint32_t values[64];
+    uint8_t amount; // 0: no condition, always true
+} VM_debugexpr;
+
+enum {VM_watch_read = 1, VM_watch_write = 2};
+typedef struct {
+    uint32_t id;
+    uint8_t watch; // 0 for a breakpoint, VM_watch_* bits for a watchpoint
+    uint16_t from;
+    uint16_t to; // inclusive, same as from for breakpoints
+    VM_debugexpr condition; // breakpoints only
+    char text[128]; // the condition as typed
+    uint64_t hits;
+} VM_debugpoint;
+
+typedef enum {
+    VM_stop_none = 0,
+    VM_stop_break,
+    VM_stop_read,
+    VM_stop_write,
+    VM_stop_halt,
+    VM_stop_budget, // ran the cycles or slots asked for
+    VM_stop_interrupt, // interrupt was set
+} VM_stopreason;
+
+typedef struct VM_debugger {
+    VM_machine* machine; // not owned
+    VM_debugpoint points[64];
+    uint8_t amount;
+    uint32_t nextid;
+
+    uint8_t slot; // next core slot VM_debugrun runs, coreamount: only the end of the cycle is left
+    uint8_t running; // inside VM_debugrun, breakpoints only stop it then
+    uint8_t resuming; // stopped at a breakpoint, its instruction runs first on the next run
+    volatile uint8_t interrupt; // set from anywhere (a signal handler) to stop VM_debugrun at the next cycle, cleared when it does
+
+    // the last stop
+    VM_stopreason reason;
+    uint32_t pointid;
+    uint16_t addr; // breakpoint address or accessed address
+    VM_word value; // read or written word
+} VM_debugger;
+
+VM_debugger* VM_newdebugger(VM_machine* machine); // NULL unless the machine runs on the predecoded engine
+void VM_deldebugger(VM_debugger* debugger); // detaches it
+
+uint8_t VM_parsedebugexpr(const char* text, VM_debugexpr* out); // 0 on a syntax error
+VM_word VM_evaldebugexpr(const VM_debugexpr* expr, const VM_vminstance* inst);
+
+// return the new id, 0 if the table is full or the condition doesn't parse
+uint32_t VM_addbreakpoint(VM_debugger* debugger, uint16_t addr, const char* condition); // condition may be NULL
+uint32_t VM_addwatchpoint(VM_debugger* debugger, uint16_t from, uint16_t to, uint8_t watch);
+uint8_t VM_removedebugpoint(VM_debugger* debugger, uint32_t id);
+
+// cycles: whole cycles to finish before stopping with VM_stop_budget, a partial cycle left from
+// the last stop counts as one. slots: the same in core slots (single stepping), 0 for no limit
+VM_stopreason VM_debugrun(VM_debugger* debugger, uint64_t cycles, uint64_t slots);
+
+// called by the predecoded engine for marked addresses, return 1 to stop
+uint8_t VM_debugfetch(VM_debugger* debugger, const VM_vminstance* inst, uint16_t addr);
+uint8_t VM_debugaccess(VM_debugger* debugger, uint16_t addr, VM_word value, uint8_t write);
+void VM_debugmark(const VM_debugger* debugger, uint8_t* rbitmap, uint8_t* wbitmap);
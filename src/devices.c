@@ -0,0 +1,157 @@
+/*
+Terminal and keyboard mapped into memory.
+*/
+#include "devices.h"
+
+VM_word hook_getkey(void* ctx, uint16_t addr) {
+    ((VM_devices*)ctx)->mmioreads ++;
+    (void)addr;
+    return VM_getkey(((VM_devices*)ctx)->keyboard);
+}
+void hook_colreg(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    (void)addr;
+    ((VM_devices*)ctx)->term->colors = newval;
+}
+void hook_hrangereg(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    (void)addr;
+    ((VM_devices*)ctx)->term->hrange = newval;
+}
+void hook_vrangereg(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    (void)addr;
+    ((VM_devices*)ctx)->term->vrange = newval;
+}
+void hook_cursorreg(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    (void)addr;
+    ((VM_devices*)ctx)->term->cursor = newval;
+}
+void hook_nlcharreg(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    (void)addr;
+    ((VM_devices*)ctx)->term->nlchar = newval;
+}
+void hook_scrollmaskreg(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    (void)addr;
+    ((VM_devices*)ctx)->term->scrollmask = newval;
+}
+void hook_char0oddreg(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    (void)addr;
+    ((VM_devices*)ctx)->term->char0odd = newval;
+}
+void hook_char0evenreg(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    (void)addr;
+    ((VM_devices*)ctx)->term->char0even = newval;
+}
+void hook_scrollprint(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    VM_term* term = ((VM_devices*)ctx)->term;
+    VM_textterm* text = ((VM_devices*)ctx)->text; // no pixels at all if set
+    uint8_t nlchar = addr >> 5 & 1;
+    uint8_t tmscroll = addr >> 4 & 1;
+    //uint8_t scrollm = addr >> 3 & 1;
+    uint8_t roprint = addr >> 2 & 1;
+    uint8_t cfdata = addr >> 1 & 1;
+    uint8_t etmode = addr & 1;
+    uint8_t column = term->cursor & 0b11111;
+    uint8_t row = (term->cursor>>5) & 0b11111;
+    uint8_t* pdir = roprint ? &column : &row;
+    uint8_t* sdir = !roprint ? &column : &row;
+    uint16_t* prange = roprint ? &term->hrange : &term->vrange;
+    uint16_t* srange = !roprint ? &term->hrange : &term->vrange;
+    uint8_t forecolor = !cfdata ? term->colors & 0b1111 : newval>>8&0b1111;
+    uint8_t backcolor = !cfdata ? (term->colors >> 4) & 0b1111 : newval>>13&0b1111;
+    uint8_t charindex = newval & 0b11111111;
+
+    if (nlchar && charindex == term->nlchar) {
+        (*pdir) = ((*prange)>>5&0b11111)+1;
+    }
+
+    if (etmode == 1) {
+        uint8_t wrapped = 0;
+        if (*pdir > ((*prange)>>5&0b11111)) {
+            *pdir = 0;
+            (*sdir) ++;
+            wrapped = 1;
+        }
+        if (*sdir > ((*srange)>>5&0b11111)) {
+            if (tmscroll && text) {
+                VM_textforget(text);
+                (*sdir) --;
+            } else if (tmscroll) {
+                // copy prev lines aka. scroll
+                for (uint8_t y=(*srange)&0b11111;y<=((*srange)>>5&0b11111);y++) {
+                    for (uint8_t x=(*prange)&0b11111;x<=((*prange)>>5&0b11111);x++) {
+                        VM_copycharpix(term, x, y+1, x, y);
+                    }
+                }
+                // fill up space
+                for (uint8_t x=(*prange)&0b11111;x<=((*prange)>>5&0b11111);x++) {
+                    VM_setchar(term, forecolor, backcolor, term->nlchar, x, ((*srange)>>5&0b11111));
+                }
+                (*sdir) --;
+            } else {
+                (*sdir) = (*srange)&0b11111;
+            }
+        }
+
+        if (text && wrapped) {
+            VM_textwrap(text, *pdir, *sdir);
+        }
+
+        if (!(nlchar && charindex == term->nlchar)) {
+            if (text) {
+                VM_textput(text, charindex, *pdir, *sdir);
+            } else {
+                VM_setchar(term, forecolor, backcolor, charindex, column, row);
+            }
+            (*pdir) ++;
+        }
+    } else if (text) {
+        VM_textscroll(text);
+    } else {
+        if (1) {
+            for (uint8_t y=(*srange)&0b11111;y<((*srange)>>5&0b11111);y++) {
+                for (uint8_t x=(*prange)&0b11111;x<=((*prange)>>5&0b11111);x++) {
+                    VM_copycharpix(term, x, y+1, x, y);
+                }
+            }
+        }
+        //VM_setchar(term, forecolor, backcolor, charindex, column, row);
+        // fill up space
+        for (uint8_t x=(*prange)&0b11111;x<=((*prange)>>5&0b11111);x++) {
+            VM_setchar(term, forecolor, backcolor, charindex, x, ((*srange)>>5&0b11111));
+        }
+    }
+
+    term->cursor = column+(row<<5);
+}
+void hook_plotpix(void* ctx, VM_word newval, uint16_t addr) {
+    ((VM_devices*)ctx)->mmiowrites ++;
+    VM_devices* devices = (VM_devices*)ctx;
+    if (!devices->haspixplot || devices->text) {return;} // pixel plotter not available
+
+    uint8_t colorindex = addr & 0b1111;
+    uint8_t row = (newval>>8) & 0b11111111;
+    uint8_t column = newval & 0b11111111;
+
+    VM_setpix(devices->term, column, row, colorindex);
+}
+void VM_attachdevices(VM_memory* memory, VM_devices* devices, uint16_t baseaddr) {
+    VM_addrhook(memory, baseaddr, hook_getkey, 0, devices); // input register
+    VM_addwhook(memory, baseaddr+0x46, hook_colreg, 0, devices); // color register
+    VM_addwhook(memory, baseaddr+0x42, hook_hrangereg, 0, devices); // hrange register
+    VM_addwhook(memory, baseaddr+0x43, hook_vrangereg, 0, devices); // vrange register
+    VM_addwhook(memory, baseaddr+0x44, hook_cursorreg, 0, devices); // cursor register
+    VM_addwhook(memory, baseaddr+0x45, hook_nlcharreg, 0, devices); // nlchar register
+    VM_addwhook(memory, baseaddr+0x47, hook_scrollmaskreg, 0, devices); // scrollmask register
+    VM_addwhook(memory, baseaddr+0x40, hook_char0oddreg, 0, devices); // char0odd register
+    VM_addwhook(memory, baseaddr+0x41, hook_char0evenreg, 0, devices); // char0even register
+    VM_addwhook(memory, baseaddr, hook_scrollprint, 0x3F, devices); // scrollprint
+    VM_addwhook(memory, baseaddr+0x60, hook_plotpix, 0x1F, devices); // plotpix
+}
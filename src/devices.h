@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include "memory.h"
+#include "keyboard.h"
+#include "terminal.h"
+#include "textterm.h"
+
+#define VM_termbase 0x9F80 // where the terminal is usually mapped
+
+typedef struct {
+    VM_term* term;
+    VM_keyboard* keyboard;
+    uint8_t haspixplot;
+    VM_textterm* text; // text only backend, NULL to draw into the terminal (see textterm.h)
+    uint64_t mmioreads; // register accesses through the hooks below, for live stats (stats.h)
+    uint64_t mmiowrites;
+} VM_devices;
+
+void VM_attachdevices(VM_memory* memory, VM_devices* devices, uint16_t baseaddr);
@@ -1,4 +1,5 @@
 #include "common.h"
+#include "disassembler.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -17,7 +18,7 @@ char regnames[33][4] = {
     "r25", "r26", "r27", "r28", "r29",
     "r30", "r31", "rXX"
 };
-char tempbuf[32];
+_Thread_local char tempbuf[32]; // thread local so dumps can disassemble on worker threads
 char jmpnames[16][4] = {
     "mp", "be", "l", "le", "s",
     "z", "o", "c", "n", "nbe",
@@ -48,6 +49,10 @@ char* CORE_itoa(VM_word n) {
 char* VM_disasminstruction(VM_word instruction) {
     char* buf = (char*)malloc(sizeof(char)*128);
     if (!buf) {return NULL;}
+    VM_disasmto(instruction, buf);
+    return buf;
+}
+void VM_disasmto(VM_word instruction, char* buf) { // buf needs to hold at least 128 chars
     buf[0] = 0x00;
 
 
@@ -67,7 +72,7 @@ char* VM_disasminstruction(VM_word instruction) {
             strcat(buf, "dw ");
             CORE_itoa(instruction);
             strcat(buf, tempbuf);
-            return buf;
+            return;
         }
     }
 
@@ -288,5 +293,4 @@ char* VM_disasminstruction(VM_word instruction) {
             strcat(buf, soii ? tempbuf : regnames[ssrcreg]);
             break;
     }
-    return buf;
 }
\ No newline at end of file
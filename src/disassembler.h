@@ -1,3 +1,4 @@
 void CORE_reverse(char s[]);
 char* CORE_itoa(VM_word n);
 char* VM_disasminstruction(VM_word instruction);
+void VM_disasmto(VM_word instruction, char* buf);
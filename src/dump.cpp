@@ -0,0 +1,116 @@
+/*
+Buffered memory/trace dump writers.
+*/
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dump.h"
+
+extern "C" {
+#include "disassembler.h"
+}
+
+#define DUMP_iobufsize (1 << 20) // stdio buffer for dump files
+#define DUMP_chunksize 4096 // lines formatted per worker job
+
+bool VM_dumpbinary(const std::string& path, const VM_word* words, uint64_t count) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {return false;}
+
+    // convert in blocks so the output is little endian regardless of the host
+    uint8_t block[DUMP_chunksize*sizeof(VM_word)];
+    bool ok = true;
+    for (uint64_t base=0;base<count && ok;base+=DUMP_chunksize) {
+        uint64_t n = count-base < DUMP_chunksize ? count-base : DUMP_chunksize;
+        for (uint64_t i=0;i<n;i++) {
+            VM_word word = words[base+i];
+            block[i*4+0] = word & 0xFF;
+            block[i*4+1] = (word >> 8) & 0xFF;
+            block[i*4+2] = (word >> 16) & 0xFF;
+            block[i*4+3] = (word >> 24) & 0xFF;
+        }
+        ok = fwrite(block, sizeof(VM_word), n, file) == n;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+template <typename Formatter>
+static bool VM_dumptext(const std::string& path, uint64_t count, Formatter format) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {return false;}
+    setvbuf(file, NULL, _IOFBF, DUMP_iobufsize);
+    fputs("%include \"common\"\n", file);
+
+    uint64_t chunks = (count+DUMP_chunksize-1)/DUMP_chunksize;
+    std::vector<std::string> out(chunks);
+    std::vector<uint8_t> ready(chunks, 0);
+    std::atomic<uint64_t> next(0);
+    std::mutex lock;
+    std::condition_variable cond;
+
+    auto worker = [&]() {
+        char line[192];
+        for (;;) {
+            uint64_t chunk = next++;
+            if (chunk >= chunks) {return;}
+            uint64_t end = (chunk+1)*DUMP_chunksize < count ? (chunk+1)*DUMP_chunksize : count;
+            std::string text;
+            text.reserve(DUMP_chunksize*48);
+            for (uint64_t index=chunk*DUMP_chunksize;index<end;index++) {
+                format(index, line);
+                text += line;
+            }
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                out[chunk] = std::move(text);
+                ready[chunk] = 1;
+            }
+            cond.notify_all();
+        }
+    };
+
+    unsigned threadamount = std::thread::hardware_concurrency();
+    if (threadamount == 0) {threadamount = 1;}
+    if (threadamount > chunks) {threadamount = chunks;}
+    std::vector<std::thread> pool;
+    for (unsigned i=0;i<threadamount;i++) {
+        pool.emplace_back(worker);
+    }
+
+    // write chunks in order while the pool keeps formatting the following ones
+    bool ok = true;
+    for (uint64_t chunk=0;chunk<chunks;chunk++) {
+        std::string text;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [&]() {return ready[chunk] != 0;});
+            text = std::move(out[chunk]);
+        }
+        if (ok) {
+            ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+        }
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    return fclose(file) == 0 && ok;
+}
+
+bool VM_dumpdisasm(const std::string& path, const VM_word* words, uint64_t count) {
+    return VM_dumptext(path, count, [&](uint64_t index, char* line) {
+        VM_disasmto(words[index], line);
+        strcat(line, "\n");
+    });
+}
+bool VM_dumptracedisasm(const std::string& path, const VM_word* trace, const VM_word* addrs, const VM_word (*ops)[3], uint64_t count) {
+    return VM_dumptext(path, count, [&](uint64_t index, char* line) {
+        char temp[128];
+        VM_disasmto(trace[index], temp);
+        snprintf(line, 192, "%u: %s    %u/%u/%u\n", addrs[index], temp, ops[index][0], ops[index][1], ops[index][2]);
+    });
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+extern "C" {
+#include "common.h"
+}
+
+// raw little endian image, same layout the loader expects for .bin files
+bool VM_dumpbinary(const std::string& path, const VM_word* words, uint64_t count);
+
+// disassembled listings. formatting is split into chunks and done on a worker pool,
+// the chunks get written out in order as soon as they are ready.
+bool VM_dumpdisasm(const std::string& path, const VM_word* words, uint64_t count);
+bool VM_dumptracedisasm(const std::string& path, const VM_word* trace, const VM_word* addrs, const VM_word (*ops)[3], uint64_t count);
@@ -0,0 +1,454 @@
+/*
+Execution engines. The predecoded engine runs the same state machine as cores.c, but
+works on the instance through a pointer, caches decoded instructions per address and
+only walks the hook tables for addresses that actually have hooks.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+#include "arithmetic.h"
+#include "debugger.h"
+
+static const char* VM_enginenames[VM_engineamount] = {"reference", "predecoded"};
+static const char* VM_fusenames[VM_fuseamount] = {"none", "constant", "address", "branch", "loop", "loaduse"};
+
+VM_engine* VM_newengine(VM_enginetype type) {
+    VM_engine* out = (VM_engine*)calloc(1, sizeof(VM_engine));
+    if (!out) {return NULL;}
+    out->type = type;
+    out->fusion = 1;
+    if (type == VM_engine_predecoded) {
+        out->cache = (VM_decoded*)calloc(65536, sizeof(VM_decoded));
+        out->rhooked = (uint8_t*)calloc(65536/8, 1);
+        out->whooked = (uint8_t*)calloc(65536/8, 1);
+        if (!out->cache || !out->rhooked || !out->whooked) {
+            VM_delengine(out);
+            return NULL;
+        }
+    }
+    return out;
+}
+void VM_delengine(VM_engine* engine) {
+    if (!engine) {return;}
+    free(engine->cache);
+    free(engine->rhooked);
+    free(engine->whooked);
+    free(engine);
+}
+const char* VM_enginename(VM_enginetype type) {
+    return type < VM_engineamount ? VM_enginenames[type] : "unknown";
+}
+const char* VM_fusename(uint8_t kind) {
+    return kind < VM_fuseamount ? VM_fusenames[kind] : "unknown";
+}
+int VM_findengine(const char* name) {
+    for (int i=0;i<VM_engineamount;i++) {
+        if (strcmp(name, VM_enginenames[i]) == 0) {return i;}
+    }
+    return -1;
+}
+
+static void VM_markhooks(uint8_t* bitmap, const uint16_t* from, const uint16_t* to, uint16_t amount) {
+    memset(bitmap, 0, 65536/8);
+    for (uint16_t i=0;i<amount;i++) {
+        for (uint32_t addr=from[i];addr<=to[i];addr++) { // same inclusive range the hook scan uses
+            bitmap[addr >> 3] |= 1 << (addr & 7);
+        }
+    }
+}
+static void VM_markunmapped(uint8_t* bitmap, const VM_memory* memory) { // writes there go through VM_memwrite, which drops them
+    uint32_t size = VM_getsize(memory->rows, memory->rowsize);
+    if (size > memory->mask) {return;} // a power of two, everything is mapped
+    for (uint32_t addr=0;addr<65536;addr++) {
+        if ((addr & memory->mask) >= size) {bitmap[addr >> 3] |= 1 << (addr & 7);}
+    }
+}
+static inline void VM_checkhooks(VM_engine* engine, const VM_memory* memory) {
+    if (engine->hookedmemory == memory && engine->hookedrha == memory->rha && engine->hookedwha == memory->wha) {return;}
+    VM_markhooks(engine->rhooked, memory->rhaddrf, memory->rhaddrt, memory->rha);
+    VM_markhooks(engine->whooked, memory->whaddrf, memory->whaddrt, memory->wha);
+    VM_markunmapped(engine->whooked, memory);
+    if (engine->debugger) {
+        VM_debugmark(engine->debugger, engine->rhooked, engine->whooked);
+    }
+    engine->hookedmemory = memory;
+    engine->hookedrha = memory->rha;
+    engine->hookedwha = memory->wha;
+}
+static inline uint8_t VM_ishooked(const uint8_t* bitmap, uint16_t addr) {
+    return (bitmap[addr >> 3] >> (addr & 7)) & 1;
+}
+
+static inline VM_word VM_fastread(VM_engine* engine, VM_memory* memory, uint16_t addr) {
+    if (VM_ishooked(engine->rhooked, addr)) {
+        VM_word value = VM_memread(memory, addr);
+        if (engine->debugger) {VM_debugaccess(engine->debugger, addr, value, 0);}
+        return value;
+    }
+    VM_word temp = memory->content[addr & memory->mask]; // mirrors by masking, unmapped words are 0
+    patchword(&temp);
+    return temp;
+}
+static inline void VM_fastwrite(VM_engine* engine, VM_memory* memory, uint16_t addr, VM_word newval) {
+    if (VM_ishooked(engine->whooked, addr)) {
+        VM_memwrite(memory, addr, newval);
+        if (engine->debugger) {VM_debugaccess(engine->debugger, addr, newval, 1);}
+        return;
+    }
+    addr &= memory->mask; // unmapped words are marked hooked, VM_memwrite drops them
+    patchword(&newval);
+    memory->content[addr] = newval;
+    if (memory->dirtyrows) {memory->dirtyrows[addr/memory->rowsize] = 1;}
+}
+
+static void VM_decode(VM_word instruction, VM_decoded* out) {
+    uint8_t moi = instruction >> 31;
+    uint8_t loi = (instruction >> 16) & 0b1111;
+    uint16_t ssrc = instruction & 0xFFFF;
+    static const uint8_t ops[16] = {
+        VM_dop_mov, VM_dop_jmp, VM_dop_ld, VM_dop_exh, VM_dop_sub, VM_dop_sbb, VM_dop_add, VM_dop_adc,
+        VM_dop_xor, VM_dop_or, VM_dop_st, VM_dop_shl, VM_dop_and, VM_dop_hlt, VM_dop_mul, VM_dop_mulh
+    };
+
+    out->raw = instruction;
+    out->valid = 1;
+    out->moi = moi;
+    out->soii = (instruction >> 30) & 0x1;
+    out->dest = (instruction >> 25) & 0b11111;
+    out->psrc = (instruction >> 20) & 0b11111;
+    out->cond = out->psrc & 0b1111;
+    out->ssrc = ssrc;
+    out->op = ops[loi];
+    if (loi == 11 && (ssrc >> 15)) {out->op = VM_dop_shr;} // direction comes from the raw field, even for registers
+    if (loi == 14 && moi) {out->op = VM_dop_muls;}
+    if (loi == 15 && moi) {out->op = VM_dop_mulx;}
+}
+
+const VM_decoded* VM_enginefetch(VM_engine* engine, VM_memory* memory, uint16_t addr, VM_decoded* scratch) {
+    if (VM_ishooked(engine->rhooked, addr)) { // executing mmio, never cached
+        VM_decode(VM_memread(memory, addr), scratch);
+        return scratch;
+    }
+    VM_word instruction = memory->content[addr & memory->mask];
+    patchword(&instruction);
+    if (engine->shared && engine->shared[addr].raw == instruction) {return &engine->shared[addr];}
+    VM_decoded* ins = &engine->cache[addr];
+    if (!ins->valid || ins->raw != instruction) {
+        VM_decode(instruction, ins);
+    }
+    return ins;
+}
+VM_decoded* VM_newdecodetable(const VM_word* words, uint32_t amount, uint16_t mask) {
+    VM_decoded* out = (VM_decoded*)malloc(65536*sizeof(VM_decoded));
+    if (!out) {return NULL;}
+    for (uint32_t addr=0;addr<65536;addr++) {
+        VM_word instruction = (addr & mask) < amount ? words[addr & mask] : VM_nullword;
+        patchword(&instruction);
+        VM_decode(instruction, &out[addr]);
+    }
+    return out;
+}
+void VM_enginehooks(VM_engine* engine, const VM_memory* memory) {
+    VM_checkhooks(engine, memory);
+}
+void VM_engineremark(VM_engine* engine) {
+    engine->hookedmemory = NULL;
+}
+VM_word VM_engineread(VM_engine* engine, VM_memory* memory, uint16_t addr) {
+    return VM_fastread(engine, memory, addr);
+}
+void VM_enginewrite(VM_engine* engine, VM_memory* memory, uint16_t addr, VM_word newval) {
+    VM_fastwrite(engine, memory, addr, newval);
+}
+
+static inline void VM_predecodedschmem(VM_engine* engine, VM_vminstance* inst) {
+    if (inst->sch_mode >= 0x2) {return;}
+    if (inst->sch_mode == 0x0) { // memread
+        if (inst->counters) {inst->counters->loads ++;}
+        writereg(&inst->regs, inst->sch_reg, VM_fastread(engine, &inst->memory, inst->sch_addr));
+    } else { // memwrite
+        if (inst->counters) {inst->counters->stores ++;}
+        VM_fastwrite(engine, &inst->memory, inst->sch_addr, readreg(&inst->regs, inst->sch_reg));
+    }
+    inst->sch_mode = 0x2;
+}
+
+// everything but memory, jumps, multiplies and hlt: the ops fused pairs run back to back
+static inline void VM_predecodedalu(VM_registers* regs, VM_flags* flags, const VM_decoded* ins, VM_word psrc, uint16_t ssrc) {
+    VM_flags* flagsout = ins->moi ? flags : 0x00;
+    uint8_t dest = ins->dest;
+    switch (ins->op) {
+        case VM_dop_sub: writereg(regs, dest, VM_sub(ssrc, psrc, flagsout)); break;
+        case VM_dop_sbb: writereg(regs, dest, VM_sbb(ssrc, psrc, flagsout, VM_getflag(*flags, 2))); break;
+        case VM_dop_add: writereg(regs, dest, VM_add(psrc, ssrc, flagsout)); break;
+        case VM_dop_adc: writereg(regs, dest, VM_adc(psrc, ssrc, flagsout, VM_getflag(*flags, 2))); break;
+        case VM_dop_xor: writereg(regs, dest, VM_xor(psrc, ssrc, flagsout)); break;
+        case VM_dop_or: writereg(regs, dest, VM_or(psrc, ssrc, flagsout)); break;
+        case VM_dop_shl: writereg(regs, dest, VM_shl(psrc, ssrc & 0b1111, flagsout)); break;
+        case VM_dop_shr: writereg(regs, dest, VM_shr(psrc, ssrc & 0b1111, flagsout)); break;
+        case VM_dop_and: writereg(regs, dest, VM_and(psrc, ssrc, flagsout)); break;
+        default: { // mov/exh
+            VM_word newval = ins->op == VM_dop_mov ? ((psrc>>16)<<16)|ssrc : psrc<<16;
+            patchword(&newval);
+            writereg(regs, dest, newval);
+            if (ins->moi) {
+                VM_setflag(flags, 0, newval==0x00);
+                VM_setflag(flags, 1, newval>>31);
+                VM_setflag(flags, 2, 0);
+            }
+            break;
+        }
+    }
+}
+static inline uint8_t VM_isalu(uint8_t op) {
+    return op != VM_dop_jmp && op != VM_dop_ld && op != VM_dop_st && op < VM_dop_hlt;
+}
+// one entry of VM_generatecondtable, without building the other 15
+static inline uint8_t VM_condition(VM_flags flags, uint8_t cond) {
+    uint8_t zf = flags & 1, sf = (flags >> 1) & 1, cf = (flags >> 2) & 1, of = (flags >> 3) & 1;
+    uint8_t out;
+    switch (cond & 0b111) {
+        case 0: out = 1; break;
+        case 1: out = cf | zf; break;
+        case 2: out = sf ^ of; break;
+        case 3: out = zf | (sf ^ of); break;
+        case 4: out = sf; break;
+        case 5: out = zf; break;
+        case 6: out = of; break;
+        default: out = cf; break;
+    }
+    return cond & 0b1000 ? !out : out;
+}
+
+// ops that start one of the idioms, checked before fetching the next instruction
+static inline uint8_t VM_canfuse(const VM_decoded* first) {
+    return first->op == VM_dop_mov || first->op == VM_dop_exh || first->op == VM_dop_ld || first->op == VM_dop_add || (first->moi && VM_isalu(first->op));
+}
+static inline uint8_t VM_reads(const VM_decoded* ins, uint8_t reg) {
+    return reg && (ins->psrc == reg || (!ins->soii && ins->ssrc == reg));
+}
+// which idiom two neighbouring instructions form, VM_fuse_none if they don't
+static uint8_t VM_fusekind(const VM_decoded* first, const VM_decoded* second) {
+    switch (first->op) {
+        case VM_dop_mov: case VM_dop_exh: // halves of a 32 bit constant
+            if ((second->op == VM_dop_mov || second->op == VM_dop_exh) && second->op != first->op && second->dest == first->dest) {return VM_fuse_constant;}
+            break;
+        case VM_dop_ld: // load and use, the keyboard polling loops
+            if (VM_isalu(second->op) && VM_reads(second, first->dest)) {return VM_fuse_loaduse;}
+            return VM_fuse_none;
+        case VM_dop_add: // address computation
+            if ((second->op == VM_dop_ld || second->op == VM_dop_st) && VM_reads(second, first->dest)) {return VM_fuse_address;}
+            break;
+        default: break;
+    }
+    if (first->moi && VM_isalu(first->op) && second->op == VM_dop_jmp) {
+        if ((first->op == VM_dop_add || first->op == VM_dop_sub) && first->soii && first->dest && first->dest == first->psrc &&
+            (second->cond & 0b111) == 5) {
+            return VM_fuse_loop; // counter step, jz/jnz
+        }
+        return VM_fuse_branch; // compare and jump
+    }
+    return VM_fuse_none;
+}
+
+// runs the instructions at IP and IP+1 as one op when they form an idiom, for slots coreindex and coreindex+1.
+// the first one is ld or an alu op, so the pending access in between is handled exactly where the next slot would.
+// 0 if nothing ran, the caller runs a plain slot then and the next slot can take *next instead of fetching again
+static uint8_t VM_predecodedfused(VM_engine* engine, VM_vminstance* inst, uint8_t coreindex, const VM_decoded* first, const VM_decoded** next) {
+    VM_memory* memory = &inst->memory;
+    uint16_t IP = inst->IP;
+    if (!VM_canfuse(first) || IP == 0xFFFF || VM_ishooked(engine->rhooked, IP+1)) {return 0;}
+    const VM_decoded* second = VM_enginefetch(engine, memory, IP+1, NULL);
+    uint8_t kind = VM_fusekind(first, second);
+    if (kind == VM_fuse_none) {
+        if (first->op != VM_dop_ld) {*next = second;} // an alu op leaves nothing pending that could touch memory before the next slot
+        return 0;
+    }
+
+    if (inst->samplepoint) {
+        *inst->samplepoint = IP | ((uint32_t)coreindex << 16);
+    }
+    if (inst->ipcounts) {
+        inst->ipcounts[IP] ++;
+        inst->ipcounts[IP+1] ++;
+    }
+    VM_counters* counters = inst->counters;
+    if (counters) {
+        counters->ops[first->moi][(first->raw >> 16) & 0b1111] ++;
+        counters->ops[second->moi][(second->raw >> 16) & 0b1111] ++;
+        counters->slotinstructions[coreindex] ++;
+        counters->slotinstructions[coreindex+1] ++;
+        counters->fused[kind] ++;
+    }
+
+    VM_registers* regs = &inst->regs;
+    VM_flags* flags = &inst->flags;
+    VM_word psrc = readreg(regs, first->psrc);
+    uint16_t ssrc = first->soii ? first->ssrc : (uint16_t)readreg(regs, first->ssrc);
+    if (first->op == VM_dop_ld) {
+        inst->sch_mode = 0x0;
+        inst->sch_addr = VM_aluwordlimit(psrc)+VM_aluwordlimit(ssrc);
+        inst->sch_reg = first->dest;
+        VM_predecodedschmem(engine, inst);
+    } else {
+        VM_predecodedalu(regs, flags, first, psrc, ssrc);
+    }
+
+    psrc = readreg(regs, second->psrc);
+    ssrc = second->soii ? second->ssrc : (uint16_t)readreg(regs, second->ssrc);
+    switch (second->op) {
+        case VM_dop_jmp:
+            if (VM_condition(*flags, second->cond)) {
+                if (counters) {counters->jmptaken ++;}
+                writereg(regs, second->dest, IP+2);
+                inst->IP = ssrc;
+                return 1;
+            }
+            if (counters) {counters->jmpnottaken ++;}
+            break;
+        case VM_dop_ld: case VM_dop_st:
+            inst->sch_mode = second->op == VM_dop_ld ? 0x0 : 0x1;
+            inst->sch_addr = VM_aluwordlimit(psrc)+VM_aluwordlimit(ssrc);
+            inst->sch_reg = second->dest;
+            break;
+        default:
+            VM_predecodedalu(regs, flags, second, psrc, ssrc);
+            break;
+    }
+    inst->IP = IP+2;
+    return 1;
+}
+
+// returns the slots used: 2 when fuse is set and the instruction fused with the next one, 0 at a breakpoint.
+// next carries an entry a failed fusion already fetched for the following slot, NULL when not fusing
+static uint8_t VM_predecodedslot(VM_engine* engine, VM_vminstance* inst, uint8_t coreindex, uint8_t fuse, const VM_decoded** next) {
+    VM_memory* memory = &inst->memory;
+    inst->IP &= 0xFFFF; // wraps around the address space, memory mirrors through all of it
+    uint16_t IP = inst->IP;
+
+    VM_decoded hooked;
+    const VM_decoded* ins;
+    if (next && *next) {
+        ins = *next;
+        *next = NULL;
+    } else {
+        ins = VM_enginefetch(engine, memory, IP, &hooked);
+    }
+    if (ins == &hooked && engine->debugger && VM_debugfetch(engine->debugger, inst, IP)) {return 0;} // breakpoint, nothing ran
+    if (fuse && ins != &hooked && VM_predecodedfused(engine, inst, coreindex, ins, next)) {return 2;}
+
+    if (inst->samplepoint) {
+        *inst->samplepoint = IP | ((uint32_t)coreindex << 16);
+    }
+    if (inst->ipcounts) {
+        inst->ipcounts[IP] ++;
+    }
+    if (inst->callprof) {
+        VM_proftick(inst->callprof);
+    }
+
+    VM_registers* regs = &inst->regs;
+    VM_flags* flags = &inst->flags;
+    uint8_t dest = ins->dest;
+    VM_word psrc = readreg(regs, ins->psrc);
+    uint16_t ssrc = ins->soii ? ins->ssrc : (uint16_t)readreg(regs, ins->ssrc);
+
+    if (inst->maketracedump && inst->tracesize < inst->maxtracesize) {
+        inst->backtrace[inst->tracesize] = ins->raw;
+        inst->backtraceaddrs[inst->tracesize] = inst->IP;
+        inst->backtraceop[inst->tracesize][0] = dest;
+        inst->backtraceop[inst->tracesize][1] = psrc;
+        inst->backtraceop[inst->tracesize++][2] = ssrc;
+    }
+    if (inst->counters) {
+        inst->counters->ops[ins->moi][(ins->raw >> 16) & 0b1111] ++;
+        inst->counters->slotinstructions[coreindex] ++;
+    }
+
+    uint8_t canmul = inst->cores[coreindex] == 2 || (inst->cores[coreindex] == 1 && inst->allowsmul);
+    switch (ins->op) {
+        case VM_dop_hlt: inst->halted = 1; break;
+        case VM_dop_mul: case VM_dop_muls: case VM_dop_mulh: case VM_dop_mulx:
+            if (!canmul) { // not multiply capable, skipped without advancing IP
+                if (inst->counters) {inst->counters->mulskipped ++;}
+                return 1;
+            }
+            writereg(regs, dest, ins->op == VM_dop_mul ? VM_mul(psrc, ssrc) : ins->op == VM_dop_muls ? VM_muls(psrc, ssrc) :
+                ins->op == VM_dop_mulh ? VM_mulh(psrc, ssrc) : VM_mulx(psrc, ssrc));
+            break;
+        case VM_dop_jmp: {
+            uint8_t taken = VM_condition(*flags, ins->cond);
+            if (inst->counters) {
+                if (taken) {
+                    inst->counters->jmptaken ++;
+                } else {
+                    inst->counters->jmpnottaken ++;
+                }
+            }
+            if (taken) {
+                // the reference only holds back synced jumps on slot coreamount, which never runs
+                writereg(regs, dest, inst->IP+1);
+                if (inst->callprof) {
+                    VM_profjump(inst->callprof, inst->IP, ssrc, dest, !ins->soii);
+                }
+                inst->IP = ssrc;
+                return 1;
+            }
+            break;
+        }
+        case VM_dop_ld: case VM_dop_st:
+            inst->sch_mode = ins->op == VM_dop_ld ? 0x0 : 0x1;
+            inst->sch_addr = VM_aluwordlimit(psrc)+VM_aluwordlimit(ssrc);
+            inst->sch_reg = dest;
+            break;
+        default:
+            VM_predecodedalu(regs, flags, ins, psrc, ssrc);
+            break;
+    }
+    inst->IP ++;
+    return 1;
+}
+uint8_t VM_engineslot(VM_engine* engine, VM_vminstance* inst, uint8_t coreindex) {
+    if (!engine || engine->type == VM_engine_reference) {
+        VM_handleschmem(inst);
+        if (inst->halted) {return 0;}
+        VM_execinstruction(inst, coreindex);
+        return 1;
+    }
+    VM_checkhooks(engine, &inst->memory);
+    VM_predecodedschmem(engine, inst);
+    if (inst->halted) {return 0;}
+    if (engine->debugger && engine->debugger->running && engine->debugger->reason) {return 0;} // a watchpoint on the ld/st just handled
+    return VM_predecodedslot(engine, inst, coreindex, 0, NULL) != 0;
+}
+void VM_enginefinish(VM_engine* engine, VM_vminstance* inst) {
+    if (!engine || engine->type == VM_engine_reference) {
+        VM_handleschmem(inst);
+    } else {
+        VM_predecodedschmem(engine, inst);
+    }
+    if (inst->counters) {
+        inst->counters->cycles ++;
+    }
+    inst->cycles ++;
+}
+void VM_enginecycle(VM_engine* engine, VM_vminstance* inst) {
+    if (!engine || engine->type == VM_engine_reference) {
+        VM_instcycle(inst);
+        return;
+    }
+    VM_checkhooks(engine, &inst->memory);
+    if (inst->counters) {
+        inst->counters->cycles ++;
+    }
+    // per instruction traces and the call profiler see every slot on its own, fusion stays off for them
+    uint8_t fuse = engine->fusion && !inst->callprof && !(inst->maketracedump && inst->tracesize < inst->maxtracesize);
+    const VM_decoded* next = NULL;
+    for (uint8_t i=0;i<inst->coreamount;) {
+        VM_predecodedschmem(engine, inst);
+        if (inst->halted) {break;}
+        i += VM_predecodedslot(engine, inst, i, fuse && i+1 < inst->coreamount, fuse ? &next : NULL);
+    }
+    VM_predecodedschmem(engine, inst);
+    inst->cycles ++;
+}
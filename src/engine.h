@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include "cores.h"
+
+// execution engines. all of them run the same VM_vminstance, cores.c is the reference
+// every other engine has to match (check with --verify-against=reference, see verify.h).
+typedef enum {
+    VM_engine_reference = 0, // cores.c, the instance gets copied around by value
+    VM_engine_predecoded = 1, // works through pointers, caches decoded instructions per address
+    VM_engineamount
+} VM_enginetype;
+
+// one predecoded instruction. checked against the word in memory on every fetch,
+// so self modifying code just decodes again.
+typedef struct {
+    VM_word raw; // (patched) word this entry was decoded from
+    uint8_t valid;
+    uint8_t op; // VM_dop_*
+    uint8_t moi; // updates flags
+    uint8_t soii; // ssrc is an immediate, not a register index
+    uint8_t dest;
+    uint8_t psrc;
+    uint8_t cond; // jmp condition index
+    uint16_t ssrc; // immediate value or register index
+} VM_decoded;
+
+enum {
+    VM_dop_mov, VM_dop_exh, VM_dop_jmp, VM_dop_ld, VM_dop_sub, VM_dop_sbb, VM_dop_add, VM_dop_adc,
+    VM_dop_xor, VM_dop_or, VM_dop_st, VM_dop_shl, VM_dop_shr, VM_dop_and, VM_dop_hlt,
+    VM_dop_mul, VM_dop_muls, VM_dop_mulh, VM_dop_mulx
+};
+
+// instruction pairs the predecoded engine runs as one op, counted per kind in VM_counters.fused.
+// pairs never span two cycles and the ld/st access between them happens where it would unfused.
+enum {
+    VM_fuse_none,
+    VM_fuse_constant, // mov+exh or exh+mov into the same register
+    VM_fuse_address, // add, then ld/st through the sum
+    VM_fuse_branch, // flag setting alu op, then jmp
+    VM_fuse_loop, // add/sub of an immediate to a register in place, then jz/jnz
+    VM_fuse_loaduse, // ld, then an alu op on the loaded register
+    VM_fuseamount
+};
+const char* VM_fusename(uint8_t kind);
+
+typedef struct {
+    VM_enginetype type;
+    uint8_t fusion; // predecoded only, on by default
+    VM_decoded* cache; // one entry per address, predecoded only
+    const VM_decoded* shared; // read only table for a ROM image (see romimage.h), checked before cache. may be NULL
+
+    // addresses covered by hooks, those go through VM_memread/VM_memwrite.
+    // rebuilt when the hook amount or the memory changes, hooks are only ever appended.
+    uint8_t* rhooked; // bitmaps, 65536 bits each
+    uint8_t* whooked;
+    // breakpoint and watchpoint addresses get marked in them too (see debugger.h)
+    const VM_memory* hookedmemory;
+    uint16_t hookedrha;
+    uint16_t hookedwha;
+    struct VM_debugger* debugger; // attached by VM_newdebugger, NULL otherwise
+} VM_engine;
+
+VM_engine* VM_newengine(VM_enginetype type);
+void VM_delengine(VM_engine* engine);
+const char* VM_enginename(VM_enginetype type);
+int VM_findengine(const char* name); // -1 if unknown
+
+void VM_enginecycle(VM_engine* engine, VM_vminstance* inst); // same as VM_instcycle, NULL runs the reference
+
+// a cycle split up for single stepping: VM_engineslot for every core slot until it returns 0 (halted),
+// then VM_enginefinish. runs exactly what VM_enginecycle would. with a debugger attached VM_engineslot also
+// returns 0 when a breakpoint or watchpoint stopped it, the debugger then calls it for the same slot again.
+uint8_t VM_engineslot(VM_engine* engine, VM_vminstance* inst, uint8_t coreindex);
+void VM_enginefinish(VM_engine* engine, VM_vminstance* inst);
+
+// every address of an image decoded up front, 65536 entries mirrored with mask like memory (words past amount
+// hold VM_nullword). engines can share one through engine->shared, entries are still checked against memory on every fetch.
+VM_decoded* VM_newdecodetable(const VM_word* words, uint32_t amount, uint16_t mask);
+
+// building blocks for runners that drive several instances through one predecoded engine (see lanes.h).
+// the hook bitmaps come from one memory, every memory passed in afterwards needs the same hook layout.
+void VM_enginehooks(VM_engine* engine, const VM_memory* memory);
+void VM_engineremark(VM_engine* engine); // the debugger's points changed, rebuild the bitmaps before the next instruction
+const VM_decoded* VM_enginefetch(VM_engine* engine, VM_memory* memory, uint16_t addr, VM_decoded* scratch); // scratch holds mmio fetches, those are never cached
+VM_word VM_engineread(VM_engine* engine, VM_memory* memory, uint16_t addr);
+void VM_enginewrite(VM_engine* engine, VM_memory* memory, uint16_t addr, VM_word newval);
@@ -0,0 +1,177 @@
+/*
+Coroutine host, see host.h.
+*/
+#include <climits>
+#include "host.h"
+
+// wake a parked session, session->lock held
+static void VM_hostwake(VM_session* session) {
+    std::coroutine_handle<> handle = session->parked;
+    session->parked = {};
+    session->state = VM_session_runnable;
+    session->host->parked --;
+    VM_hostscheduler* scheduler = session->scheduler;
+    {
+        std::lock_guard<std::mutex> guard(scheduler->lock);
+        scheduler->ready.push_back(handle);
+    }
+    scheduler->wake.notify_one();
+}
+
+struct VM_parkawaiter {
+    VM_session* session;
+    VM_sessionstate reason;
+    bool await_ready() {return false;}
+    bool await_suspend(std::coroutine_handle<> handle) {
+        std::lock_guard<std::mutex> guard(session->lock);
+        if (reason == VM_session_input && !session->input.empty()) {return false;} // arrived in the meantime
+        if (reason == VM_session_budget && session->budget > 0) {return false;}
+        session->state = reason;
+        session->parked = handle;
+        session->parkedat = std::chrono::steady_clock::now();
+        session->host->parked ++;
+        return true;
+    }
+    void await_resume() {}
+};
+struct VM_yieldawaiter {
+    VM_hostscheduler* scheduler;
+    bool await_ready() {return false;}
+    void await_suspend(std::coroutine_handle<> handle) { // same thread, only the queue needs the lock
+        std::lock_guard<std::mutex> guard(scheduler->lock);
+        scheduler->ready.push_back(handle);
+    }
+    void await_resume() {}
+};
+
+// hands the next queued key to the program, it just found the keyboard empty
+static bool VM_sessionfeed(VM_session* session) {
+    std::lock_guard<std::mutex> guard(session->lock);
+    if (session->input.empty()) {return false;}
+    VM_registerkeypress(&session->machine->keyboard, session->input.front());
+    session->input.pop_front();
+    return true;
+}
+
+static VM_sessiontask VM_sessionrun(VM_session* session) {
+    VM_machine* machine = session->machine;
+    for (;;) {
+        uint64_t allowance;
+        {
+            std::lock_guard<std::mutex> guard(session->lock);
+            session->resumes ++;
+            allowance = session->budget < session->scheduler->slice ? session->budget : session->scheduler->slice;
+        }
+
+        uint64_t ran = 0;
+        bool starved = false;
+        while (ran < allowance && !machine->instance.halted) {
+            uint64_t emptyreads = machine->keyboard.emptyreads;
+            if (machine->script) {
+                VM_feedinput(machine->script, machine->instance.cycles, &machine->keyboard);
+            }
+            VM_enginecycle(machine->engine, &machine->instance);
+            ran ++;
+            if (machine->keyboard.emptyreads != emptyreads && !VM_sessionfeed(session)) {
+                starved = true;
+                break;
+            }
+        }
+        bool spent;
+        {
+            std::lock_guard<std::mutex> guard(session->lock);
+            if (session->budget != UINT64_MAX) {session->budget -= ran;}
+            if (machine->instance.halted) {session->state = VM_session_halted;}
+            spent = session->budget == 0;
+        }
+
+        if (machine->instance.halted) {
+            session->host->halted ++;
+            co_return;
+        }
+        if (starved) {
+            co_await VM_parkawaiter{session, VM_session_input};
+        } else if (spent) {
+            co_await VM_parkawaiter{session, VM_session_budget};
+        } else {
+            co_await VM_yieldawaiter{session->scheduler};
+        }
+    }
+}
+
+static void VM_schedulerloop(VM_hostscheduler* scheduler) {
+    for (;;) {
+        std::coroutine_handle<> handle;
+        {
+            std::unique_lock<std::mutex> guard(scheduler->lock);
+            scheduler->wake.wait(guard, [&]() {return scheduler->stopping || !scheduler->ready.empty();});
+            if (scheduler->stopping) {return;}
+            handle = scheduler->ready.front();
+            scheduler->ready.pop_front();
+        }
+        handle.resume(); // runs a slice, comes back parked, yielded or done
+    }
+}
+
+VM_host* VM_newhost(unsigned threads, uint64_t slice) {
+    VM_host* out = new VM_host();
+    out->halted = 0;
+    out->parked = 0;
+    for (unsigned i=0;i<(threads ? threads : 1);i++) {
+        std::unique_ptr<VM_hostscheduler> scheduler(new VM_hostscheduler());
+        scheduler->stopping = false;
+        scheduler->slice = slice ? slice : 1;
+        out->schedulers.push_back(std::move(scheduler));
+    }
+    return out;
+}
+void VM_delhost(VM_host* host) {
+    for (auto& scheduler : host->schedulers) {
+        {
+            std::lock_guard<std::mutex> guard(scheduler->lock);
+            scheduler->stopping = true;
+        }
+        scheduler->wake.notify_all();
+        if (scheduler->thread.joinable()) {scheduler->thread.join();}
+    }
+    for (auto& session : host->sessions) { // suspended or done, either way safe to destroy now
+        session->task.handle.destroy();
+    }
+    delete host;
+}
+VM_session* VM_hostadd(VM_host* host, VM_machine* machine, uint64_t budget) {
+    std::unique_ptr<VM_session> session(new VM_session());
+    session->machine = machine;
+    session->host = host;
+    session->scheduler = host->schedulers[host->sessions.size() % host->schedulers.size()].get();
+    session->user = NULL;
+    session->budget = budget;
+    session->state = VM_session_runnable;
+    session->resumes = 0;
+    session->task = VM_sessionrun(session.get());
+    session->scheduler->ready.push_back(session->task.handle);
+    host->sessions.push_back(std::move(session));
+    return host->sessions.back().get();
+}
+void VM_hoststart(VM_host* host) {
+    for (auto& scheduler : host->schedulers) {
+        scheduler->thread = std::thread(VM_schedulerloop, scheduler.get());
+    }
+}
+
+void VM_postkey(VM_host* host, VM_session* session, char key) {
+    (void)host;
+    std::lock_guard<std::mutex> guard(session->lock);
+    session->input.push_back(key);
+    if (session->state == VM_session_input) {VM_hostwake(session);}
+}
+void VM_grantcycles(VM_host* host, VM_session* session, uint64_t cycles) {
+    (void)host;
+    std::lock_guard<std::mutex> guard(session->lock);
+    session->budget = UINT64_MAX-session->budget < cycles ? UINT64_MAX : session->budget+cycles;
+    if (session->state == VM_session_budget) {VM_hostwake(session);}
+}
+VM_sessionstate VM_sessionstatus(VM_session* session) {
+    std::lock_guard<std::mutex> guard(session->lock);
+    return session->state;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "machine.h"
+}
+
+// hosts many machines on a few threads. every machine runs as a coroutine on one scheduler thread and
+// suspends when it reads the keyboard with no key queued, when its cycle budget runs out and when it halts,
+// so parked machines cost nothing until a key or more cycles arrive. runnable machines take turns a slice
+// of cycles at a time. keys are handed over only when the program polls, so a session's result depends
+// on its keys alone, not on the timing of the threads.
+enum VM_sessionstate {
+    VM_session_runnable,
+    VM_session_input, // parked until VM_postkey
+    VM_session_budget, // parked until VM_grantcycles
+    VM_session_halted,
+};
+
+struct VM_sessiontask {
+    struct promise_type {
+        VM_sessiontask get_return_object() {return {std::coroutine_handle<promise_type>::from_promise(*this)};}
+        std::suspend_always initial_suspend() noexcept {return {};}
+        std::suspend_always final_suspend() noexcept {return {};}
+        void return_void() {}
+        void unhandled_exception() {std::terminate();}
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+struct VM_host;
+struct VM_hostscheduler;
+
+struct VM_session {
+    VM_machine* machine; // not owned
+    VM_host* host;
+    VM_hostscheduler* scheduler;
+    VM_sessiontask task;
+    void* user; // free for the embedder
+
+    std::mutex lock; // guards everything below, keys and cycles come in from other threads
+    std::deque<char> input;
+    uint64_t budget; // cycles left, UINT64_MAX for no limit
+    VM_sessionstate state;
+    std::coroutine_handle<> parked; // set while parked
+    std::chrono::steady_clock::time_point parkedat;
+    uint64_t resumes;
+};
+
+struct VM_hostscheduler {
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::coroutine_handle<>> ready;
+    bool stopping;
+    uint64_t slice;
+    std::thread thread;
+};
+
+struct VM_host {
+    std::vector<std::unique_ptr<VM_hostscheduler>> schedulers;
+    std::vector<std::unique_ptr<VM_session>> sessions;
+    std::atomic<uint64_t> halted;
+    std::atomic<uint64_t> parked; // sessions waiting for input or cycles right now
+};
+
+VM_host* VM_newhost(unsigned threads, uint64_t slice); // one scheduler per thread, slice is the cycles a machine runs before yielding
+void VM_delhost(VM_host* host); // stops the threads, the machines stay with the caller
+VM_session* VM_hostadd(VM_host* host, VM_machine* machine, uint64_t budget); // before VM_hoststart, spread over the schedulers round robin
+void VM_hoststart(VM_host* host);
+
+void VM_postkey(VM_host* host, VM_session* session, char key); // queued, any thread
+void VM_grantcycles(VM_host* host, VM_session* session, uint64_t cycles); // any thread
+VM_sessionstate VM_sessionstatus(VM_session* session);
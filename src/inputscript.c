@@ -0,0 +1,81 @@
+/*
+Scripted keyboard input for headless runs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "inputscript.h"
+
+int VM_cmpinputevents(const void* a, const void* b) {
+    uint64_t ca = ((const VM_inputevent*)a)->cycle;
+    uint64_t cb = ((const VM_inputevent*)b)->cycle;
+    return (ca > cb) - (ca < cb);
+}
+VM_inputscript VM_loadinputscript(const char* path) { // returns an empty script on failure
+    VM_inputscript out;
+    out.events = NULL;
+    out.amount = 0;
+    out.next = 0;
+
+    FILE* file = fopen(path, "r");
+    if (!file) {return out;}
+
+    uint32_t capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#') {continue;}
+        unsigned long long cycle;
+        char keytext[8];
+        if (sscanf(line, "%llu %7s", &cycle, keytext) != 2) {continue;}
+
+        char key = keytext[0];
+        if (keytext[0] == '\\' && keytext[1]) {
+            switch (keytext[1]) {
+                case 'n': key = '\n'; break;
+                case 'b': key = '\b'; break;
+                case 't': key = '\t'; break;
+                case 's': key = ' '; break;
+                case 'e': key = 27; break;
+                default: key = keytext[1]; break;
+            }
+        }
+
+        if (out.amount == capacity) {
+            capacity = capacity ? capacity*2 : 64;
+            VM_inputevent* grown = (VM_inputevent*)realloc(out.events, capacity*sizeof(VM_inputevent));
+            if (!grown) {break;}
+            out.events = grown;
+        }
+        out.events[out.amount].cycle = cycle;
+        out.events[out.amount].key = key;
+        out.amount++;
+    }
+    fclose(file);
+
+    // scripts are usually written in order already, qsort would shuffle keys sharing a cycle
+    for (uint32_t i=1;i<out.amount;i++) {
+        if (out.events[i].cycle < out.events[i-1].cycle) {
+            qsort(out.events, out.amount, sizeof(VM_inputevent), VM_cmpinputevents);
+            break;
+        }
+    }
+    return out;
+}
+void VM_delinputscript(VM_inputscript* script) {
+    free(script->events);
+    script->events = NULL;
+    script->amount = 0;
+    script->next = 0;
+}
+void VM_feedinput(VM_inputscript* script, uint64_t cycle, VM_keyboard* keyboard) {
+    while (script->next < script->amount && script->events[script->next].cycle <= cycle) {
+        VM_registerkeypress(keyboard, script->events[script->next].key);
+        script->next++;
+    }
+}
+void VM_seekinput(VM_inputscript* script, uint64_t cycle) {
+    script->next = 0;
+    while (script->next < script->amount && script->events[script->next].cycle < cycle) {
+        script->next++;
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+#include "keyboard.h"
+
+// scripted keyboard input, one "<cycle> <key>" per line. keys are single characters or
+// one of the escapes \n \b \t \s (space) \e (escape) \\, lines starting with # are comments.
+typedef struct {
+    uint64_t cycle;
+    char key;
+} VM_inputevent;
+
+typedef struct {
+    VM_inputevent* events; // sorted by cycle
+    uint32_t amount;
+    uint32_t next; // first event that has not been delivered yet
+} VM_inputscript;
+
+VM_inputscript VM_loadinputscript(const char* path);
+void VM_delinputscript(VM_inputscript* script);
+void VM_feedinput(VM_inputscript* script, uint64_t cycle, VM_keyboard* keyboard);
+void VM_seekinput(VM_inputscript* script, uint64_t cycle); // drops events before cycle, for runs starting from a snapshot
@@ -10,10 +10,12 @@ void VM_registerkeypress(VM_keyboard* keyboard, char key) {
 VM_keyboard VM_newkeyboard() {
     VM_keyboard out;
     out.keycode = 0x00;
+    out.emptyreads = 0;
     return out;
 }
 char VM_getkey(VM_keyboard* keyboard) {
     char temp = keyboard->keycode;
     keyboard->keycode = 0x00;
+    if (!temp) {keyboard->emptyreads ++;}
     return temp;
 }
\ No newline at end of file
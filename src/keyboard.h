@@ -1,5 +1,8 @@
+#pragma once
+#include <stdint.h>
 typedef struct {
     char keycode;
+    uint64_t emptyreads; // reads that found no key, lets a host park machines that wait for input (see host.h)
 } VM_keyboard;
 
 char VM_getkey(VM_keyboard* keyboard);
@@ -0,0 +1,283 @@
+/*
+Lockstep runner for several machines of one layout. The ALU ops are written out over all lanes with a
+mask instead of going through arithmetic.c one lane at a time, so they must stay bit exact with it
+(TEST_ALU_exhaustive checks the reference model both follow).
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "lanes.h"
+#include "arithmetic.h"
+
+VM_lanes* VM_newlanes(VM_machine* const* machines, uint8_t amount) {
+    if (amount == 0 || amount > VM_lanemax) {return NULL;}
+    const VM_machineconfig* first = &machines[0]->config;
+    for (uint8_t i=1;i<amount;i++) { // the hook bitmaps and core table are shared
+        const VM_machineconfig* config = &machines[i]->config;
+        if (config->memrows != first->memrows || config->rowsize != first->rowsize || config->coreamount != first->coreamount ||
+            config->charsnh != first->charsnh || config->charsnv != first->charsnv || config->haspixplot != first->haspixplot ||
+            config->allowsmul != first->allowsmul || memcmp(config->coretypes, first->coretypes, sizeof(config->coretypes)) != 0) {
+            return NULL;
+        }
+    }
+
+    VM_lanes* out = (VM_lanes*)calloc(1, sizeof(VM_lanes));
+    if (!out) {return NULL;}
+    out->engine = VM_newengine(VM_engine_predecoded);
+    if (!out->engine) {
+        free(out);
+        return NULL;
+    }
+    out->amount = amount;
+    memcpy(out->machines, machines, amount*sizeof(VM_machine*));
+    for (uint8_t flags=0;flags<16;flags++) {
+        VM_word table[16];
+        VM_generatecondtable(flags, table);
+        for (uint8_t cond=0;cond<16;cond++) {
+            out->condtable[cond][flags] = table[cond] ? 1 : 0;
+        }
+    }
+    return out;
+}
+void VM_dellanes(VM_lanes* lanes) {
+    if (!lanes) {return;}
+    VM_delengine(lanes->engine);
+    free(lanes);
+}
+
+static inline VM_word VM_lanepatch(VM_word word) { // patchword without the branch
+    return (word & 0x3FFFFFFF) ? word : 0;
+}
+
+static void VM_lanesgather(VM_lanes* lanes) {
+    memset(lanes->regs, 0, sizeof(lanes->regs));
+    memset(lanes->halted, 1, sizeof(lanes->halted)); // lanes past amount never run
+    for (uint8_t lane=0;lane<lanes->amount;lane++) {
+        VM_vminstance* inst = &lanes->machines[lane]->instance;
+        for (uint8_t reg=1;reg<32;reg++) {
+            lanes->regs[reg][lane] = inst->regs[reg-1];
+        }
+        lanes->flags[lane] = inst->flags;
+        lanes->IP[lane] = inst->IP;
+        lanes->halted[lane] = inst->halted;
+        lanes->schmode[lane] = inst->sch_mode;
+        lanes->schreg[lane] = inst->sch_reg;
+        lanes->schaddr[lane] = inst->sch_addr;
+        lanes->content[lane] = inst->memory.content;
+    }
+}
+static void VM_lanesscatter(VM_lanes* lanes) {
+    for (uint8_t lane=0;lane<lanes->amount;lane++) {
+        VM_vminstance* inst = &lanes->machines[lane]->instance;
+        for (uint8_t reg=1;reg<32;reg++) {
+            inst->regs[reg-1] = lanes->regs[reg][lane];
+        }
+        inst->flags = lanes->flags[lane];
+        inst->IP = lanes->IP[lane];
+        inst->halted = lanes->halted[lane];
+        inst->sch_mode = lanes->schmode[lane];
+        inst->sch_reg = lanes->schreg[lane];
+        inst->sch_addr = lanes->schaddr[lane];
+    }
+}
+
+static inline void VM_laneschmem(VM_lanes* lanes, uint8_t lane) {
+    if (lanes->schmode[lane] >= 0x2) {return;}
+    VM_memory* memory = &lanes->machines[lane]->instance.memory;
+    uint8_t reg = lanes->schreg[lane];
+    if (lanes->schmode[lane] == 0x0) { // memread
+        VM_word word = VM_lanepatch(VM_engineread(lanes->engine, memory, lanes->schaddr[lane]));
+        if (reg != 0) {lanes->regs[reg][lane] = word;}
+    } else { // memwrite
+        VM_enginewrite(lanes->engine, memory, lanes->schaddr[lane], lanes->regs[reg][lane]);
+    }
+    lanes->schmode[lane] = 0x2;
+}
+
+// add/adc/sub/sbb, sub and sbb are ssrc-psrc with the carry inverted like VM_sub/VM_sbb
+static inline void VM_lanesaddop(const VM_lanes* lanes, const VM_word* p, const VM_word* s, VM_word* out, VM_flags* newflags, uint8_t subtract, uint8_t usecarry) {
+    for (int lane=0;lane<VM_lanemax;lane++) {
+        VM_word carry = usecarry ? (lanes->flags[lane] >> 2) & 1 : 0;
+        VM_word a = subtract ? s[lane] & 0xFFFF : p[lane] & 0xFFFF;
+        VM_word b = subtract ? ~p[lane] & 0xFFFF : s[lane] & 0xFFFF;
+        VM_word c = subtract ? (usecarry ? carry ^ 1 : 1) : carry;
+        VM_word r = a+b+c;
+        VM_flags f = ((r & 0xFFFF) == 0) | (((r >> 15) & 1) << 1) | ((r > 0xFFFF) << 2) | ((((~(a ^ b)) & (r ^ a)) >> 15 & 1) << 3);
+        out[lane] = r & 0xFFFF;
+        newflags[lane] = (lanes->flags[lane] & 0xF0) | (f ^ (subtract << 2));
+    }
+}
+
+// runs one decoded instruction on every lane in mask. 0 if it did not run (mul on a slot that can't multiply)
+static uint8_t VM_lanesexec(VM_lanes* lanes, const VM_decoded* ins, const uint8_t* mask, uint8_t canmul) {
+    VM_word p[VM_lanemax], s[VM_lanemax], out[VM_lanemax];
+    VM_flags newflags[VM_lanemax];
+    const VM_word* prow = lanes->regs[ins->psrc];
+    const VM_word* srow = lanes->regs[ins->ssrc < 32 ? ins->ssrc : 0]; // readreg gives 0 past the register file
+    for (int lane=0;lane<VM_lanemax;lane++) {
+        p[lane] = prow[lane];
+        s[lane] = ins->soii ? ins->ssrc : srow[lane] & 0xFFFF;
+    }
+
+    uint8_t writes = 1;
+    uint8_t setsflags = ins->moi;
+    switch (ins->op) {
+        case VM_dop_add: VM_lanesaddop(lanes, p, s, out, newflags, 0, 0); break;
+        case VM_dop_adc: VM_lanesaddop(lanes, p, s, out, newflags, 0, 1); break;
+        case VM_dop_sub: VM_lanesaddop(lanes, p, s, out, newflags, 1, 0); break;
+        case VM_dop_sbb: VM_lanesaddop(lanes, p, s, out, newflags, 1, 1); break;
+        case VM_dop_xor: case VM_dop_or: case VM_dop_and:
+            for (int lane=0;lane<VM_lanemax;lane++) {
+                VM_word a = VM_lanepatch(p[lane]);
+                VM_word r = VM_lanepatch(ins->op == VM_dop_xor ? a ^ s[lane] : ins->op == VM_dop_or ? a | s[lane] : a & s[lane]);
+                out[lane] = r;
+                newflags[lane] = (lanes->flags[lane] & 0xF8) | (r == 0) | (((r >> 15) & 1) << 1);
+            }
+            break;
+        case VM_dop_shl: case VM_dop_shr:
+            for (int lane=0;lane<VM_lanemax;lane++) {
+                VM_word a = VM_lanepatch(p[lane]);
+                VM_word r = VM_lanepatch(ins->op == VM_dop_shl ? a << (s[lane] & 0b1111) : a >> (s[lane] & 0b1111));
+                out[lane] = r;
+                newflags[lane] = (lanes->flags[lane] & 0xFC) | (r == 0) | (((r >> 15) & 1) << 1);
+            }
+            break;
+        case VM_dop_mov: case VM_dop_exh:
+            for (int lane=0;lane<VM_lanemax;lane++) {
+                VM_word r = VM_lanepatch(ins->op == VM_dop_mov ? ((p[lane] >> 16) << 16) | s[lane] : p[lane] << 16);
+                out[lane] = r;
+                newflags[lane] = (lanes->flags[lane] & 0xF8) | (r == 0) | ((r >> 31) << 1);
+            }
+            break;
+        case VM_dop_mul: case VM_dop_muls: case VM_dop_mulh: case VM_dop_mulx:
+            if (!canmul) {return 0;} // skipped without advancing IP
+            for (int lane=0;lane<VM_lanemax;lane++) {
+                VM_word r = ins->op == VM_dop_mul ? VM_mul(p[lane], s[lane]) : ins->op == VM_dop_muls ? VM_muls(p[lane], s[lane]) :
+                    ins->op == VM_dop_mulh ? VM_mulh(p[lane], s[lane]) : VM_mulx(p[lane], s[lane]);
+                out[lane] = VM_lanepatch(r);
+            }
+            setsflags = 0;
+            break;
+        case VM_dop_hlt:
+            for (int lane=0;lane<VM_lanemax;lane++) {
+                lanes->halted[lane] |= mask[lane];
+            }
+            writes = 0;
+            setsflags = 0;
+            break;
+        case VM_dop_ld: case VM_dop_st:
+            for (int lane=0;lane<VM_lanemax;lane++) {
+                uint8_t on = mask[lane];
+                lanes->schmode[lane] = on ? (ins->op == VM_dop_ld ? 0x0 : 0x1) : lanes->schmode[lane];
+                lanes->schaddr[lane] = on ? (uint16_t)((p[lane] & 0xFFFF)+s[lane]) : lanes->schaddr[lane];
+                lanes->schreg[lane] = on ? ins->dest : lanes->schreg[lane];
+            }
+            writes = 0;
+            setsflags = 0;
+            break;
+        case VM_dop_jmp: {
+            const uint8_t* taketable = lanes->condtable[ins->cond];
+            VM_word* row = lanes->regs[ins->dest];
+            for (int lane=0;lane<VM_lanemax;lane++) {
+                uint8_t taken = mask[lane] & taketable[lanes->flags[lane] & 0xF];
+                if (ins->dest != 0) {
+                    row[lane] = taken ? VM_lanepatch(lanes->IP[lane]+1) : row[lane];
+                }
+                lanes->IP[lane] = taken ? s[lane] : lanes->IP[lane]+mask[lane];
+            }
+            return 1;
+        }
+    }
+
+    if (writes && ins->dest != 0) {
+        VM_word* row = lanes->regs[ins->dest];
+        for (int lane=0;lane<VM_lanemax;lane++) {
+            row[lane] = mask[lane] ? out[lane] : row[lane];
+        }
+    }
+    if (setsflags) {
+        for (int lane=0;lane<VM_lanemax;lane++) {
+            lanes->flags[lane] = mask[lane] ? newflags[lane] : lanes->flags[lane];
+        }
+    }
+    for (int lane=0;lane<VM_lanemax;lane++) {
+        lanes->IP[lane] += mask[lane];
+    }
+    return 1;
+}
+
+// one core slot: lanes at the same IP with the same word there run as one group
+static void VM_lanesslot(VM_lanes* lanes, uint8_t* pending, uint8_t canmul) {
+    const VM_memory* layout = &lanes->machines[0]->instance.memory;
+    for (uint8_t lane=0;lane<lanes->amount;lane++) {
+        if (pending[lane]) {lanes->IP[lane] &= 0xFFFF;} // wraps around the address space
+    }
+
+    for (uint8_t lead=0;lead<lanes->amount;lead++) {
+        if (!pending[lead]) {continue;}
+        VM_word IP = lanes->IP[lead];
+        VM_decoded scratch;
+        const VM_decoded* ins = VM_enginefetch(lanes->engine, &lanes->machines[lead]->instance.memory, (uint16_t)IP, &scratch);
+
+        uint8_t mask[VM_lanemax] = {0};
+        mask[lead] = 1;
+        if (ins != &scratch) { // mmio fetches stay on their own lane
+            for (uint8_t lane=lead+1;lane<lanes->amount;lane++) {
+                if (!pending[lane] || lanes->IP[lane] != IP) {continue;}
+                VM_word word = lanes->content[lane][(uint16_t)IP & layout->mask];
+                mask[lane] = VM_lanepatch(word) == ins->raw;
+            }
+        }
+        uint8_t ran = 0;
+        for (uint8_t lane=lead;lane<lanes->amount;lane++) {
+            pending[lane] &= !mask[lane];
+            ran += mask[lane];
+        }
+        VM_lanesexec(lanes, ins, mask, canmul);
+        lanes->groups ++;
+        lanes->laneinstructions += ran;
+    }
+}
+
+uint64_t VM_runlanes(VM_lanes* lanes, uint64_t cycles) {
+    VM_lanesgather(lanes);
+    VM_enginehooks(lanes->engine, &lanes->machines[0]->instance.memory);
+    const VM_vminstance* first = &lanes->machines[0]->instance;
+
+    uint64_t ran = 0;
+    for (;ran<cycles;ran++) {
+        uint8_t live[VM_lanemax] = {0};
+        uint8_t anylive = 0;
+        for (uint8_t lane=0;lane<lanes->amount;lane++) {
+            VM_machine* machine = lanes->machines[lane];
+            live[lane] = !lanes->halted[lane];
+            anylive |= live[lane];
+            if (live[lane] && machine->script) {
+                VM_feedinput(machine->script, machine->instance.cycles, &machine->keyboard);
+            }
+        }
+        if (!anylive) {break;}
+
+        uint8_t running[VM_lanemax];
+        memcpy(running, live, sizeof(running));
+        for (uint8_t slot=0;slot<first->coreamount;slot++) {
+            uint8_t pending[VM_lanemax];
+            uint8_t anypending = 0;
+            for (uint8_t lane=0;lane<lanes->amount;lane++) {
+                if (running[lane]) {VM_laneschmem(lanes, lane);}
+                running[lane] &= !lanes->halted[lane];
+                pending[lane] = running[lane];
+                anypending |= pending[lane];
+            }
+            if (!anypending) {break;}
+            uint8_t canmul = first->cores[slot] == 2 || (first->cores[slot] == 1 && first->allowsmul);
+            VM_lanesslot(lanes, pending, canmul);
+        }
+        for (uint8_t lane=0;lane<lanes->amount;lane++) {
+            if (!live[lane]) {continue;}
+            VM_laneschmem(lanes, lane);
+            lanes->machines[lane]->instance.cycles ++;
+        }
+    }
+    VM_lanesscatter(lanes);
+    return ran;
+}
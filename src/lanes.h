@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include "machine.h"
+#include "engine.h"
+
+// runs several machines with the same layout (usually one ROM with different input) in lockstep.
+// registers, flags, IPs and the scheduled ld/st of every lane live in arrays indexed by lane, so one
+// decoded instruction runs over all lanes that are at the same IP with the same word there, as a loop
+// over the lanes the compiler can vectorize. lanes that went elsewhere run as their own group.
+// memory stays per lane, the decode cache and hook bitmaps are shared.
+// gives the same results as running every machine on its own (compare the hashes, see r3explore --lanes).
+#define VM_lanemax 16
+
+typedef struct {
+    uint8_t amount;
+    VM_machine* machines[VM_lanemax]; // not owned
+    VM_engine* engine; // predecoded, shared by every lane
+
+    // lane state while running, copied in and out of the instances by VM_runlanes
+    VM_word regs[32][VM_lanemax]; // row 0 stays zero
+    VM_flags flags[VM_lanemax];
+    VM_word IP[VM_lanemax];
+    uint8_t halted[VM_lanemax];
+    uint8_t schmode[VM_lanemax];
+    uint8_t schreg[VM_lanemax];
+    uint16_t schaddr[VM_lanemax];
+    const VM_word* content[VM_lanemax]; // each lane's memory, for comparing instruction words
+    uint8_t condtable[16][16]; // [condition][flags & 0xF], from VM_generatecondtable
+
+    uint64_t groups; // instructions decoded and run over a group of lanes
+    uint64_t laneinstructions; // instructions summed over lanes, /groups is the average group size
+} VM_lanes;
+
+// machines need the same memory, core and terminal layout. tracing, counters and profilers are not run.
+VM_lanes* VM_newlanes(VM_machine* const* machines, uint8_t amount);
+void VM_dellanes(VM_lanes* lanes);
+uint64_t VM_runlanes(VM_lanes* lanes, uint64_t cycles); // every lane up to cycles or halted, like VM_runmachine. returns the most cycles a lane ran
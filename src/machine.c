@@ -0,0 +1,82 @@
+/*
+Machine setup shared by the frontend and the headless tools.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine.h"
+#include "config.h"
+
+VM_machineconfig VM_defaultconfig(void) {
+    VM_machineconfig out;
+    memset(&out, 0, sizeof(out));
+    out.memrows = DEFAULT_memrows;
+    out.rowsize = DEFAULT_rowsize;
+    out.coreamount = DEFAULT_coreamount;
+    memset(out.coretypes, 2, sizeof(out.coretypes)); // all multiply capable
+    out.allowsmul = DEFAULT_allowsmul;
+    out.maketracedump = DEFAULT_maketracedump;
+    out.tracesize = DEFAULT_tracesize;
+    out.charsnh = DEFAULT_charsnh;
+    out.charsnv = DEFAULT_charsnv;
+    out.haspixplot = DEFAULT_haspixplot;
+    out.engine = VM_engine_reference;
+    return out;
+}
+VM_machine* VM_newmachine(const VM_machineconfig* config) {
+    VM_machine* out = (VM_machine*)calloc(1, sizeof(VM_machine));
+    if (!out) {return NULL;}
+    out->config = *config;
+    out->engine = VM_newengine((VM_enginetype)config->engine);
+    if (!out->engine) {
+        free(out);
+        return NULL;
+    }
+
+    out->instance = VM_newinstance(config->memrows, config->coreamount, config->coretypes, config->rowsize, config->allowsmul, config->maketracedump, config->tracesize);
+    memset(out->instance.memory.content, 0x00, VM_getsize(config->memrows, config->rowsize)*sizeof(VM_word));
+    out->keyboard = VM_newkeyboard();
+    out->term = VM_newterm(config->charsnh, config->charsnv);
+
+    out->devices.term = &out->term;
+    out->devices.keyboard = &out->keyboard;
+    out->devices.haspixplot = config->haspixplot;
+    VM_attachdevices(&out->instance.memory, &out->devices, VM_termbase);
+    return out;
+}
+void VM_delmachine(VM_machine* machine) {
+    if (!machine) {return;}
+    VM_delterm(&machine->term);
+    VM_delinstance(machine->instance);
+    VM_delengine(machine->engine);
+    free(machine);
+}
+uint8_t VM_loadrom(VM_machine* machine, const char* path) { // raw little endian image, cut off at the memory size. returns 0 on failure
+    FILE* file = fopen(path, "rb");
+    if (!file) {return 0;}
+
+    VM_memory* memory = &machine->instance.memory;
+    size_t size = VM_getsize(memory->rows, memory->rowsize)*sizeof(VM_word);
+    memset(memory->content, 0x00, size);
+    fread(memory->content, 1, size, file);
+    fclose(file);
+    return 1;
+}
+uint64_t VM_runmachine(VM_machine* machine, uint64_t cycles) { // runs until halted or cycles ran out, returns the cycles executed
+    uint64_t ran = 0;
+    while (ran < cycles && !machine->instance.halted) {
+        if (machine->script) {
+            VM_feedinput(machine->script, machine->instance.cycles, &machine->keyboard);
+        }
+        VM_enginecycle(machine->engine, &machine->instance);
+        ran ++;
+    }
+    return ran;
+}
+uint64_t VM_memoryhash(const VM_machine* machine) {
+    const VM_memory* memory = &machine->instance.memory;
+    return VM_hashbytes(memory->content, VM_getsize(memory->rows, memory->rowsize)*sizeof(VM_word));
+}
+uint64_t VM_framebufferhash(const VM_machine* machine) {
+    return VM_hashbytes(machine->term.pixbuf, (8*machine->term.charsnh)*(8*machine->term.charsnv));
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include "cores.h"
+#include "devices.h"
+#include "engine.h"
+#include "inputscript.h"
+
+// a complete R3: cores, memory, terminal and keyboard wired together
+typedef struct {
+    uint16_t memrows;
+    uint16_t rowsize;
+    uint8_t coreamount;
+    uint8_t coretypes[50];
+    uint8_t allowsmul;
+    uint8_t maketracedump;
+    uint64_t tracesize;
+    uint8_t charsnh;
+    uint8_t charsnv;
+    uint8_t haspixplot;
+    uint8_t engine; // VM_enginetype
+} VM_machineconfig;
+
+typedef struct {
+    VM_machineconfig config;
+    VM_vminstance instance;
+    VM_term term;
+    VM_keyboard keyboard;
+    VM_devices devices; // points into this struct, so machines never move
+    VM_inputscript* script; // fed before every cycle by VM_runmachine, may be NULL
+    VM_engine* engine; // runs the instance, see engine.h
+} VM_machine;
+
+VM_machineconfig VM_defaultconfig(void);
+VM_machine* VM_newmachine(const VM_machineconfig* config);
+void VM_delmachine(VM_machine* machine);
+uint8_t VM_loadrom(VM_machine* machine, const char* path);
+uint64_t VM_runmachine(VM_machine* machine, uint64_t cycles);
+uint64_t VM_memoryhash(const VM_machine* machine); // for comparing outcomes between runs
+uint64_t VM_framebufferhash(const VM_machine* machine);
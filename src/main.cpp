@@ -1,9 +1,11 @@
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
 #include <string>
 
 #include "argh.h"
+#include "dump.h"
 #include <memory.h>
 #include <SDL.h>
 
@@ -18,114 +20,23 @@ extern "C" {
 #include "config.h"
 #include "cores.h"
 #include "memory.h"
-#include "cores.h"
+#include "machine.h"
+#include "engine.h"
+#include "verify.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "recording.h"
+#include "profiler.h"
+#include "sampler.h"
+#include "symbols.h"
+#include "stats.h"
+#include "textterm.h"
+#include "capture.h"
 }
-VM_keyboard* HOOK_keyboard;
-VM_term* HOOK_term;
+#include <poll.h>
+#include <termios.h>
 SDL_Renderer* renderer;
-uint8_t HOOK_haspixplot;
-
-VM_word hook_getkey(uint16_t) {
-    return VM_getkey(HOOK_keyboard);
-}
-void hook_colreg(VM_word newval, uint16_t) {
-    HOOK_term->colors = newval;
-}
-void hook_hrangereg(VM_word newval, uint16_t) {
-    HOOK_term->hrange = newval;
-}
-void hook_vrangereg(VM_word newval, uint16_t) {
-    HOOK_term->vrange = newval;
-}
-void hook_cursorreg(VM_word newval, uint16_t) {
-    HOOK_term->cursor = newval;
-}
-void hook_nlcharreg(VM_word newval, uint16_t) {
-    HOOK_term->nlchar = newval;
-}
-void hook_scrollmaskreg(VM_word newval, uint16_t) {
-    HOOK_term->scrollmask = newval;
-}
-void hook_char0oddreg(VM_word newval, uint16_t) {
-    HOOK_term->char0odd = newval;
-}
-void hook_char0evenreg(VM_word newval, uint16_t) {
-    HOOK_term->char0even = newval;
-}
-void hook_scrollprint(VM_word newval, uint16_t addr) {
-    uint8_t nlchar = addr >> 5 & 1;
-    uint8_t tmscroll = addr >> 4 & 1;
-    //uint8_t scrollm = addr >> 3 & 1;
-    uint8_t roprint = addr >> 2 & 1;
-    uint8_t cfdata = addr >> 1 & 1;
-    uint8_t etmode = addr & 1;
-    uint8_t column = HOOK_term->cursor & 0b11111;
-    uint8_t row = (HOOK_term->cursor>>5) & 0b11111;
-    uint8_t* pdir = roprint ? &column : &row;
-    uint8_t* sdir = !roprint ? &column : &row;
-    uint16_t* prange = roprint ? &HOOK_term->hrange : &HOOK_term->vrange;
-    uint16_t* srange = !roprint ? &HOOK_term->hrange : &HOOK_term->vrange;
-    uint8_t forecolor = !cfdata ? HOOK_term->colors & 0b1111 : newval>>8&0b1111;
-    uint8_t backcolor = !cfdata ? (HOOK_term->colors >> 4) & 0b1111 : newval>>13&0b1111;
-    uint8_t charindex = newval & 0b11111111;
-
-    if (nlchar && charindex == HOOK_term->nlchar) {
-        (*pdir) = ((*prange)>>5&0b11111)+1;
-    }
-
-    if (etmode == 1) {
-        if (*pdir > ((*prange)>>5&0b11111)) {
-            *pdir = 0;
-            (*sdir) ++;
-        }
-        if (*sdir > ((*srange)>>5&0b11111)) {
-            if (tmscroll) {
-                // copy prev lines aka. scroll
-                for (uint8_t y=(*srange)&0b11111;y<=((*srange)>>5&0b11111);y++) {
-                    for (uint8_t x=(*prange)&0b11111;x<=((*prange)>>5&0b11111);x++) {
-                        VM_copycharpix(HOOK_term, x, y+1, x, y, renderer);
-                    }
-                }
-                // fill up space
-                for (uint8_t x=(*prange)&0b11111;x<=((*prange)>>5&0b11111);x++) {
-                    VM_setchar(HOOK_term, forecolor, backcolor, HOOK_term->nlchar, x, ((*srange)>>5&0b11111), renderer);
-                }
-                (*sdir) --;
-            } else {
-                (*sdir) = (*srange)&0b11111;
-            }
-        }
-
-        if (!(nlchar && charindex == HOOK_term->nlchar)) {
-            VM_setchar(HOOK_term, forecolor, backcolor, charindex, column, row, renderer);
-            (*pdir) ++;
-        }
-    } else {
-        if (1) {
-            for (uint8_t y=(*srange)&0b11111;y<((*srange)>>5&0b11111);y++) {
-                for (uint8_t x=(*prange)&0b11111;x<=((*prange)>>5&0b11111);x++) {
-                    VM_copycharpix(HOOK_term, x, y+1, x, y, renderer);
-                }
-            }
-        }
-        //VM_setchar(HOOK_term, forecolor, backcolor, charindex, column, row);
-        // fill up space
-        for (uint8_t x=(*prange)&0b11111;x<=((*prange)>>5&0b11111);x++) {
-            VM_setchar(HOOK_term, forecolor, backcolor, charindex, x, ((*srange)>>5&0b11111), renderer);
-        }
-    }
-
-    HOOK_term->cursor = column+(row<<5);
-}
-void hook_plotpix(VM_word newval, uint16_t addr) {
-    if (!HOOK_haspixplot) {return;} // pixel plotter not available
-
-    uint8_t colorindex = addr & 0b1111;
-    uint8_t row = (newval>>8) & 0b11111111;
-    uint8_t column = newval & 0b11111111;
 
-    VM_setpix(HOOK_term, column, row, colorindex, renderer);
-}
 uint64_t smolmin(uint64_t x, uint64_t y) {
 	return (x < y) ? x : y;
 }
@@ -147,10 +58,12 @@ void calcmemcol(VM_word value, uint8_t* out) { // taken from an R2 emulator at h
 	out[1] = g;
 	out[2] = b;
 }
-void rendermem(VM_memory memory, uint8_t memrows, uint8_t charsnv) {
+void rendermem(const VM_memory& memory, uint16_t memrows, uint8_t charsnv) {
+	if (memrows > 64) {memrows = 64;} // the window only has room for 64 rows under the terminal
 	for (uint64_t row=0;row<memrows;row++) {
 		for (uint64_t column=0;column<128;column++) {
-			VM_word val = VM_memread(memory, column+(128*row));
+			VM_word val = VM_mempeek(&memory, column+(128*row)); // not VM_memread, that would run device hooks
+			patchword(&val);
 			uint8_t color[3];
 			calcmemcol(val, color);
 			SDL_SetRenderDrawColor(renderer, color[0], color[1], color[2], 255);
@@ -161,8 +74,179 @@ void rendermem(VM_memory memory, uint8_t memrows, uint8_t charsnv) {
 	}
 }
 
+void renderhudline(const char* text, uint8_t line, uint8_t columns, const uint8_t* color) { // over the top left of the terminal, black background
+	for (uint8_t column=0;text[column] && column<columns;column++) {
+		const uint8_t* glyph = VM_fontglyph((uint8_t)text[column]);
+		for (uint8_t y=0;y<8;y++) {
+			for (uint8_t x=0;x<8;x++) {
+				uint8_t set = glyph[y]>>x & 1;
+				SDL_SetRenderDrawColor(renderer, set ? color[0] : 0, set ? color[1] : 0, set ? color[2] : 0, 255);
+				SDL_RenderDrawPoint(renderer, x+8*column, y+8*line);
+			}
+		}
+	}
+}
+std::string hudrate(double value) {
+	char out[16];
+	if (value >= 1e6) {
+		snprintf(out, sizeof(out), "%.2fM", value/1e6);
+	} else if (value >= 1e4) {
+		snprintf(out, sizeof(out), "%.1fk", value/1e3);
+	} else {
+		snprintf(out, sizeof(out), "%.0f", value);
+	}
+	return out;
+}
+
+struct MAIN_capturesettings {
+    std::string path;
+    uint64_t interval; // emulated cycles between frames
+    uint32_t fps;
+};
+static VM_capture* start_capture(const MAIN_capturesettings& settings, const VM_term* term) {
+    if (settings.path.empty()) {return NULL;}
+    VM_capture* capture = VM_newcapture(settings.path.c_str(), term, settings.fps);
+    if (!capture) {
+        std::cout << "Failed to capture to " << settings.path << " (needs to end in .y4m, or .png with one %d in it)!" << std::endl;
+    }
+    return capture;
+}
+static void finish_capture(VM_capture* capture, const MAIN_capturesettings& settings) {
+    if (!capture) {return;}
+    uint8_t failed = 0;
+    uint64_t frames = VM_delcapture(capture, &failed);
+    std::cout << "Captured " << frames << " frames to " << settings.path << (failed ? ", then writing failed!" : "") << std::endl;
+}
+
+static int run_replay(const std::string& path, int engine, uint64_t to, const std::string& savesnapshot, const MAIN_capturesettings& capturesettings) { // headless, as fast as the engine goes
+    VM_replay replay;
+    if (!VM_loadreplay(path.c_str(), &replay)) {
+        std::cout << "Failed to load recording " << path << "!" << std::endl;
+        return 1;
+    }
+    uint64_t until = to ? to : replay.endcycle;
+    std::cout << "Replaying " << path << ": " << replay.script.amount << " keys, " << replay.snapshotamount << " snapshots, cycles "
+        << replay.snapshots[0].cycle << " to " << replay.endcycle << std::endl;
+
+    VM_machine* machine = VM_newreplaymachine(&replay, (uint8_t)engine);
+    uint64_t start = machine->instance.cycles;
+    VM_capture* capture = start_capture(capturesettings, &machine->term);
+    auto began = std::chrono::steady_clock::now();
+    if (capture) { // every interval from the start instead of jumping through the snapshots
+        uint64_t interval = capturesettings.interval;
+        while (machine->instance.cycles < until && !machine->instance.halted) {
+            uint64_t step = interval-machine->instance.cycles%interval;
+            VM_runmachine(machine, step < until-machine->instance.cycles ? step : until-machine->instance.cycles);
+            if (machine->instance.cycles%interval == 0) {
+                VM_captureframe(capture, &machine->term);
+            }
+        }
+    } else {
+        VM_replayseek(&replay, machine, until);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-began).count();
+
+    const VM_vminstance& instance = machine->instance;
+    uint64_t ran = instance.cycles > start ? instance.cycles-start : 0;
+    std::cout << "Replay stopped at cycle " << instance.cycles << ", IP '" << instance.IP << "'" << (instance.halted ? " (halted)" : "") << std::endl;
+    printf("memory hash %016llX, framebuffer hash %016llX, %.2f MIPS\n",
+        (unsigned long long)VM_memoryhash(machine), (unsigned long long)VM_framebufferhash(machine),
+        seconds > 0 ? ran*instance.coreamount/seconds/1e6 : 0.0);
+
+    finish_capture(capture, capturesettings);
+
+    int status = 0;
+    if (!savesnapshot.empty() && !VM_writesnapshot(machine, savesnapshot.c_str())) {
+        std::cout << "Failed to write " << savesnapshot << "!" << std::endl;
+        status = 1;
+    }
+    machine->script = NULL;
+    VM_delmachine(machine);
+    VM_delreplay(&replay);
+    return status;
+}
+
+// headless text mode: the terminal streams characters (textterm.h) and stdin feeds the keyboard. a byte is handed
+// over when the program reads the keyboard and finds it empty, so piped input never overruns it and runs repeat
+// exactly. ends when the program halts, or after stdin ended, once it polled the keyboard without printing
+// anything for idlecycles (programs that poll for a key while they compute keep going while they print)
+static int run_text(VM_machine* machine, const std::string& outpath, uint64_t maxcycles, uint64_t idlecycles) {
+    FILE* out = outpath.empty() ? stdout : fopen(outpath.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Failed to open %s!\n", outpath.c_str());
+        return 1;
+    }
+    VM_textterm* text = VM_newtextterm(out);
+    machine->devices.text = text;
+
+    termios saved;
+    bool raw = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved) == 0;
+    if (raw) { // keys as they are typed, the guest echoes what it wants
+        termios keys = saved;
+        keys.c_lflag &= ~(ICANON | ECHO);
+        keys.c_cc[VMIN] = 1;
+        keys.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &keys);
+    }
+
+    VM_vminstance& instance = machine->instance;
+    VM_keyboard& keyboard = machine->keyboard;
+    char buffer[256];
+    ssize_t buffered = 0, next = 0;
+    bool ended = false, starved = false;
+    uint64_t printed = 0, idlesince = instance.cycles;
+    while (!instance.halted && (!maxcycles || instance.cycles < maxcycles)) {
+        uint64_t emptyreads = keyboard.emptyreads;
+        VM_enginecycle(machine->engine, &instance);
+        if (keyboard.emptyreads == emptyreads) {continue;}
+
+        if (next == buffered && !ended) { // only look at stdin when the program asks for a key
+            fflush(out);
+            pollfd input = {STDIN_FILENO, POLLIN, 0};
+            if (poll(&input, 1, 0) > 0) {
+                buffered = read(STDIN_FILENO, buffer, sizeof(buffer));
+                next = 0;
+                if (buffered <= 0) {
+                    buffered = 0;
+                    ended = true;
+                }
+            }
+        }
+        if (next < buffered) {
+            char ch = buffer[next++];
+            if (ch == '\r') {ch = '\n';} // enter on a raw tty
+            if (ch == 127) {ch = '\b';} // backspace on a raw tty
+            VM_registerkeypress(&keyboard, ch);
+        } else if (ended) {
+            if (text->characters != printed) {
+                printed = text->characters;
+                idlesince = instance.cycles;
+            }
+            if (instance.cycles-idlesince >= idlecycles) {
+                starved = true;
+                break;
+            }
+        }
+    }
+
+    if (raw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    }
+    machine->devices.text = NULL;
+    uint64_t characters = text->characters;
+    VM_deltextterm(text);
+    if (out != stdout) {
+        fclose(out);
+    }
+    fprintf(stderr, "%s at IP '%u' after %llu cycles, %llu characters printed\n",
+        instance.halted ? "Halted" : starved ? "Waiting for input after the end of stdin" : "Stopped",
+        instance.IP, (unsigned long long)instance.cycles, (unsigned long long)characters);
+    return 0;
+}
+
 static void print_usage(const char* prog) {
     std::cout << "Usage: " << prog << " [options] <input.bin>" << std::endl;
+    std::cout << "       " << prog << " [options] --replay=FILE" << std::endl;
     std::cout << "Options:" << std::endl;
     std::cout << "  -h, --help              Show this help and exit" << std::endl;
     std::cout << "  --memrows N             Memory rows (default: " << DEFAULT_memrows << ")" << std::endl;
@@ -178,27 +262,66 @@ static void print_usage(const char* prog) {
     std::cout << "  --no-fpslimiter         Disable FPS limiter" << std::endl;
     std::cout << "  --no-smul               Disallow S-type core multiplication" << std::endl;
     std::cout << "  --no-pixplot            Disable pixel plotting" << std::endl;
+    std::cout << "  --profile               Count executions per address and write a hot spot report" << std::endl;
+    std::cout << "  --profile-out=FILE      Hot spot report path (default: hotspots.txt)" << std::endl;
+    std::cout << "  --callgraph             Track calls/returns and write a call graph profile" << std::endl;
+    std::cout << "  --callgraph-out=FILE    Folded stacks for flamegraph.pl (default: callgraph.folded)" << std::endl;
+    std::cout << "  --callgraph-report=FILE Per function inclusive/exclusive cycles (default: callgraph.txt)" << std::endl;
+    std::cout << "  --sample                Sample the guest IP with a SIGPROF timer and write a report" << std::endl;
+    std::cout << "  --sample-hz=N           Samples per second of cpu time (default: 1000)" << std::endl;
+    std::cout << "  --sample-out=FILE       Sample report path (default: samples.txt)" << std::endl;
+    std::cout << "  --counters              Count ops, jumps, loads/stores, mmio and slot usage" << std::endl;
+    std::cout << "  --counters-out=FILE     Counter dump path, JSON (default: counters.json)" << std::endl;
+    std::cout << "  --symbols=FILE          Label file from tptasm (export_labels) to annotate reports" << std::endl;
+    std::cout << "  --engine=NAME           Execution engine: reference, predecoded (default: reference)" << std::endl;
+    std::cout << "  --verify-against=NAME   Run the reference engine in lockstep and stop at the first divergence" << std::endl;
+    std::cout << "  --verify-interval=N     Cycles between lockstep state comparisons (default: 1000)" << std::endl;
+    std::cout << "  --load-snapshot=FILE    Restore a save state after loading the ROM (same memory/core/terminal layout)" << std::endl;
+    std::cout << "  --save-snapshot=FILE    Write a save state when emulation finishes" << std::endl;
+    std::cout << "  --save-snapshot-at=N    Write it at cycle N instead and keep running" << std::endl;
+    std::cout << "  --rewind                Keep a rewind buffer, the left arrow key steps back one interval" << std::endl;
+    std::cout << "  --rewind-interval=N     Cycles between rewind keyframes (default: 1000)" << std::endl;
+    std::cout << "  --rewind-keyframes=N    Keyframes kept in the rewind buffer (default: 256)" << std::endl;
+    std::cout << "  --record=FILE           Record the keyboard input with embedded snapshots" << std::endl;
+    std::cout << "  --record-snapshots=N    Cycles between embedded snapshots (default: 100000)" << std::endl;
+    std::cout << "  --replay=FILE           Replay a recording headless (no ROM needed) and print the final state" << std::endl;
+    std::cout << "  --replay-to=N           Stop the replay at cycle N, jumping through the embedded snapshots" << std::endl;
+    std::cout << "  --text                  No window: printed characters stream to stdout, stdin is the keyboard" << std::endl;
+    std::cout << "  --text-out=FILE         Stream the text to this file instead of stdout" << std::endl;
+    std::cout << "  --max-cycles=N          Stop text mode after N cycles (default: no limit)" << std::endl;
+    std::cout << "  --text-idle=N           After stdin ended, stop once the program polled the keyboard N cycles without printing (default: 200000)" << std::endl;
+    std::cout << "  --capture=FILE          Write terminal frames to a .y4m video, or PNGs if FILE ends in .png and has a %d (frames/%06d.png)" << std::endl;
+    std::cout << "  --capture-interval=N    Emulated cycles between captured frames (default: --updxframes)" << std::endl;
+    std::cout << "  --capture-fps=N         Frame rate written into the y4m header (default: targetfps/updxframes)" << std::endl;
+    std::cout << "  --hud                   Show the performance overlay from the start (F1 toggles it)" << std::endl;
+    std::cout << "  --stats                 Publish live stats in /dev/shm for r3top" << std::endl;
+    std::cout << "  --stats-name=NAME       Name of the stats file in /dev/shm (default: r3emu-<pid>)" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
-    std::cout << "R3 emulator" << std::endl;
-    std::cout << "Written by Justus Wolff in very late 2025-2026" << std::endl << "With help from LBPHacker, to fix alot of arithmetic bugs, who also made the original R3" << std::endl << "Also credit to siraben due to finding bugs and patching them by implementing haskell for the R3." << std::endl;
-    std::cout << "Also, if you read this, I might do an complete rewrite soon since this is quite the mess." << std::endl;
-
 	argh::parser cmdl(argc, argv);
+    bool textmode = cmdl["--text"]; // stdout belongs to the guest then
+    if (!textmode) {
+        std::cout << "R3 emulator" << std::endl;
+        std::cout << "Written by Justus Wolff in very late 2025-2026" << std::endl << "With help from LBPHacker, to fix alot of arithmetic bugs, who also made the original R3" << std::endl << "Also credit to siraben due to finding bugs and patching them by implementing haskell for the R3." << std::endl;
+        std::cout << "Also, if you read this, I might do an complete rewrite soon since this is quite the mess." << std::endl;
+    }
 
     if (cmdl[{ "-h", "--help" }]) {
         print_usage(argv[0]);
         return 0;
     }
 
-    if (cmdl.size() < 2) {
+    std::string replaypath;
+    cmdl("--replay", "") >> replaypath;
+
+    if (cmdl.size() < 2 && replaypath.empty()) {
         print_usage(argv[0]);
         return 1;
     }
 
-    const std::string input_path = cmdl[1];
-    if (!std::filesystem::exists(input_path)) {
+    const std::string input_path = replaypath.empty() ? cmdl[1] : "";
+    if (replaypath.empty() && !std::filesystem::exists(input_path)) {
         std::cout << "File doesnt exist!" << std::endl;
         return 2;
     }
@@ -233,52 +356,174 @@ int main(int argc, char* argv[]) {
     bool fpslimiter = !cmdl["--no-fpslimiter"];
     bool allowsmul = !cmdl["--no-smul"];
     bool haspixplot = !cmdl["--no-pixplot"];
+    bool profile = cmdl["--profile"];
+
+    std::string profileout;
+    cmdl("--profile-out", "hotspots.txt") >> profileout;
+
+    bool callgraph = cmdl["--callgraph"];
+
+    std::string callgraphout;
+    cmdl("--callgraph-out", "callgraph.folded") >> callgraphout;
+
+    std::string callgraphreport;
+    cmdl("--callgraph-report", "callgraph.txt") >> callgraphreport;
+
+    bool sample = cmdl["--sample"];
+
+    int samplehz;
+    cmdl("--sample-hz", 1000) >> samplehz;
+
+    std::string sampleout;
+    cmdl("--sample-out", "samples.txt") >> sampleout;
+
+    bool counters = cmdl["--counters"];
+
+    std::string countersout;
+    cmdl("--counters-out", "counters.json") >> countersout;
 
-    HOOK_haspixplot = haspixplot ? 1 : 0;
-
-    VM_vminstance instance = VM_newinstance(
-        (uint8_t)memrows,
-        (uint8_t)coreamount,
-        (uint8_t[]){2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
-        (uint16_t)rowsize,
-        allowsmul ? 1 : 0,
-        tracedump ? 1 : 0,
-        tracesize
-    );
-    uint16_t memsize_words = VM_getsize((uint8_t)memrows, (uint16_t)rowsize);
-    memset(instance.memory.content, 0x00, memsize_words*sizeof(VM_word));
-
-    std::ifstream file(input_path, std::ios_base::binary);
-    file.seekg(0, std::ios::end);
-    size_t length = file.tellg();
-    file.seekg(0, std::ios::beg);
-    if (length > memsize_words*sizeof(VM_word)) {
-        length = memsize_words*sizeof(VM_word);
-    }
-    char* buf = new char[memsize_words*sizeof(VM_word)];
-	memset(buf, 0x00, memsize_words*sizeof(VM_word));
-    file.read(buf, length);
-    std::cout << "Reading into memory..." << std::endl;
-    memcpy(instance.memory.content, buf, memsize_words*sizeof(VM_word));
-    delete[] buf;
-
-    VM_keyboard keyboard = VM_newkeyboard();
-    VM_term terminal = VM_newterm((uint8_t)charsnh, (uint8_t)charsnv);
-    HOOK_term = &terminal;
-    HOOK_keyboard = &keyboard;
-    uint16_t baseaddr = 0x9F80;
-    // setup hooks for terminal/keyboard
-    VM_addrhook(&instance.memory, baseaddr, hook_getkey, 0); // input register
-    VM_addwhook(&instance.memory, baseaddr+0x46, hook_colreg, 0); // color register
-    VM_addwhook(&instance.memory, baseaddr+0x42, hook_hrangereg, 0); // hrange register
-    VM_addwhook(&instance.memory, baseaddr+0x43, hook_vrangereg, 0); // vrange register
-    VM_addwhook(&instance.memory, baseaddr+0x44, hook_cursorreg, 0); // cursor register
-    VM_addwhook(&instance.memory, baseaddr+0x45, hook_nlcharreg, 0); // nlchar register
-    VM_addwhook(&instance.memory, baseaddr+0x47, hook_scrollmaskreg, 0); // scrollmask register
-    VM_addwhook(&instance.memory, baseaddr+0x40, hook_char0oddreg, 0); // char0odd register
-    VM_addwhook(&instance.memory, baseaddr+0x41, hook_char0evenreg, 0); // char0even register
-    VM_addwhook(&instance.memory, baseaddr, hook_scrollprint, 0x3F); // scrollprint
-    VM_addwhook(&instance.memory, baseaddr+0x60, hook_plotpix, 0x1F); // plotpix
+    std::string symbolpath;
+    cmdl("--symbols", "") >> symbolpath;
+
+    std::string enginename;
+    cmdl("--engine", "reference") >> enginename;
+    int engine = VM_findengine(enginename.c_str());
+    if (engine < 0) {
+        std::cout << "Unknown engine '" << enginename << "'!" << std::endl;
+        return 1;
+    }
+
+    std::string verifyagainst;
+    cmdl("--verify-against", "") >> verifyagainst;
+    if (!verifyagainst.empty() && verifyagainst != "reference") {
+        std::cout << "Can only verify against the reference engine!" << std::endl;
+        return 1;
+    }
+    uint64_t verifyinterval;
+    cmdl("--verify-interval", 1000) >> verifyinterval;
+
+    std::string loadsnapshot, savesnapshot;
+    cmdl("--load-snapshot", "") >> loadsnapshot;
+    cmdl("--save-snapshot", "") >> savesnapshot;
+    uint64_t savesnapshotat;
+    cmdl("--save-snapshot-at", 0) >> savesnapshotat;
+
+    bool userewind = cmdl["--rewind"];
+    uint64_t rewindinterval, rewindkeyframes;
+    cmdl("--rewind-interval", 1000) >> rewindinterval;
+    cmdl("--rewind-keyframes", 256) >> rewindkeyframes;
+    if (userewind && !verifyagainst.empty()) {
+        std::cout << "--rewind can't be combined with --verify-against!" << std::endl;
+        return 1;
+    }
+
+    std::string recordpath;
+    cmdl("--record", "") >> recordpath;
+    uint64_t recordsnapshots;
+    cmdl("--record-snapshots", 100000) >> recordsnapshots;
+    if (!recordpath.empty() && userewind) {
+        std::cout << "--record can't be combined with --rewind!" << std::endl;
+        return 1;
+    }
+
+    uint64_t replayto;
+    cmdl("--replay-to", 0) >> replayto;
+
+    bool hudshown = cmdl["--hud"];
+
+    MAIN_capturesettings capturesettings;
+    cmdl("--capture", "") >> capturesettings.path;
+    cmdl("--capture-interval", updxframes) >> capturesettings.interval;
+    cmdl("--capture-fps", updxframes > 0 && targetfps/updxframes > 0 ? targetfps/updxframes : 1) >> capturesettings.fps;
+    if (!capturesettings.interval) {capturesettings.interval = 1;}
+    if (!capturesettings.path.empty() && textmode) {
+        std::cout << "--capture can't be combined with --text, nothing is drawn!" << std::endl;
+        return 1;
+    }
+
+    std::string textout;
+    cmdl("--text-out", "") >> textout;
+    uint64_t maxcycles, textidle;
+    cmdl("--max-cycles", 0) >> maxcycles;
+    cmdl("--text-idle", 200000) >> textidle;
+
+    bool stats = cmdl["--stats"];
+    std::string statsname;
+    cmdl("--stats-name", "r3emu-" + std::to_string(getpid())) >> statsname;
+    if (!replaypath.empty()) {
+        return run_replay(replaypath, engine, replayto, savesnapshot, capturesettings);
+    }
+
+    VM_machineconfig config = VM_defaultconfig();
+    config.memrows = (uint16_t)memrows;
+    config.rowsize = (uint16_t)rowsize;
+    config.coreamount = (uint8_t)coreamount;
+    config.allowsmul = allowsmul ? 1 : 0;
+    config.maketracedump = tracedump ? 1 : 0;
+    config.tracesize = tracesize;
+    config.charsnh = (uint8_t)charsnh;
+    config.charsnv = (uint8_t)charsnv;
+    config.haspixplot = haspixplot ? 1 : 0;
+    config.engine = (uint8_t)engine;
+    VM_machine* machine = VM_newmachine(&config);
+    VM_vminstance& instance = machine->instance;
+    VM_term& terminal = machine->term;
+    VM_keyboard& keyboard = machine->keyboard;
+
+    if (!textmode) {
+        std::cout << "Reading into memory..." << std::endl;
+    }
+    VM_loadrom(machine, input_path.c_str());
+    uint32_t memsize_words = VM_getsize(instance.memory.rows, instance.memory.rowsize);
+
+    if (!loadsnapshot.empty()) {
+        VM_snapshotfile snapshot = VM_mapsnapshot(loadsnapshot.c_str());
+        if (!VM_loadsnapshot(machine, snapshot.data, snapshot.size)) {
+            std::cout << "Failed to load snapshot " << loadsnapshot << " (missing, corrupt or different memory/core/terminal layout)!" << std::endl;
+            VM_unmapsnapshot(&snapshot);
+            VM_delmachine(machine);
+            return 1;
+        }
+        VM_unmapsnapshot(&snapshot);
+        if (!textmode) {
+            std::cout << "Restored snapshot at cycle " << instance.cycles << "." << std::endl;
+        }
+    }
+
+    if (textmode) {
+        int status = run_text(machine, textout, maxcycles, textidle);
+        VM_delmachine(machine);
+        return status;
+    }
+
+    VM_recorder* recorder = NULL;
+    if (!recordpath.empty()) {
+        recorder = VM_newrecorder(recordpath.c_str(), machine, recordsnapshots);
+        if (!recorder) {
+            std::cout << "Failed to open " << recordpath << "!" << std::endl;
+        }
+    }
+
+    VM_rewind* rewind = NULL;
+    if (userewind) {
+        rewind = VM_newrewind(machine, rewindinterval, (uint32_t)rewindkeyframes);
+    }
+
+    VM_verifier* verifier = NULL;
+    if (!verifyagainst.empty()) {
+        verifier = VM_newverifier(machine, verifyinterval);
+        std::cout << "Verifying engine '" << enginename << "' against the reference every " << verifier->interval << " cycles." << std::endl;
+    }
+
+    if (profile) {
+        instance.ipcounts = VM_newiphistogram();
+    }
+    if (counters) {
+        VM_attachcounters(&instance, VM_newcounters());
+    }
+    if (callgraph) {
+        instance.callprof = VM_newcallprof(instance.IP);
+    }
 
     std::cout << "Target fps: " << targetfps << std::endl;
     std::cout << "Target ips: " << targetfps*coreamount << std::endl;
@@ -296,18 +541,88 @@ int main(int argc, char* argv[]) {
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
     SDL_RenderClear(renderer);
 
+    VM_sampler* sampler = NULL;
+    if (sample) {
+        sampler = VM_newsampler(samplehz > 0 ? (uint32_t)samplehz : 1);
+        if (sampler && VM_startsampler(sampler)) {
+            instance.samplepoint = VM_samplepoint(sampler);
+        } else {
+            std::cout << "Failed to start the sampling profiler!" << std::endl;
+            VM_delsampler(sampler);
+            sampler = NULL;
+        }
+    }
+
+    VM_statswriter* statswriter = NULL;
+    if (stats) {
+        statswriter = VM_newstats(statsname.c_str());
+        if (statswriter) {
+            std::cout << "Publishing stats to /dev/shm/" << statsname << std::endl;
+        } else {
+            std::cout << "Failed to create /dev/shm/" << statsname << "!" << std::endl;
+        }
+    }
+
+    // HUD, measured at every present and drawn with the next one
+    uint64_t hudmmionanos = 0; // the memory adds up hook time here while the HUD is shown
+    uint64_t hudcycles = instance.cycles, hudlastmmio = 0;
+    auto hudlastpresent = std::chrono::steady_clock::now();
+    double hudips = 0, hudframems = 0, hudrenderms = 0, hudmmioms = 0;
+    uint64_t hudcyclesperframe = 0;
+    if (hudshown) {
+        instance.memory.hooknanos = &hudmmionanos;
+    }
+
+    VM_capture* capture = start_capture(capturesettings, &terminal);
+
     std::cout << "Emulation started." << std::endl;
     uint64_t frame=0;
     float frameLimit = 1.f / targetfps;
     while (!instance.halted) {
-        VM_instcycle(&instance);
+        if (verifier) {
+            if (!VM_verifycycle(verifier)) {
+                VM_writedivergence(stdout, verifier);
+                break;
+            }
+        } else {
+            VM_enginecycle(machine->engine, &instance);
+        }
+        if (sampler) {
+            *instance.samplepoint = VM_samplehost;
+        }
+        if (rewind) {
+            VM_rewindtick(rewind);
+        }
+        if (recorder) {
+            VM_recordtick(recorder, machine);
+        }
+        if (capture && instance.cycles%capturesettings.interval == 0) {
+            VM_captureframe(capture, &terminal);
+        }
+        if (savesnapshotat && instance.cycles == savesnapshotat && !savesnapshot.empty()) {
+            if (!VM_writesnapshot(machine, savesnapshot.c_str())) {
+                std::cout << "Failed to write " << savesnapshot << "!" << std::endl;
+            }
+        }
 
-		SDL_PollEvent(&event);
+		if (!SDL_PollEvent(&event)) {
+			event.type = 0; // an empty queue leaves the last event in place, it must not repeat
+		}
 		if (event.type == SDL_QUIT) {
 			instance.halted = 1;
 		}
 		if (event.type == SDL_KEYDOWN) {
 			SDL_Keycode key = event.key.keysym.sym;
+			if (key == SDLK_F1) {
+				hudshown = !hudshown;
+				instance.memory.hooknanos = hudshown ? &hudmmionanos : NULL;
+			}
+			if (rewind && key == SDLK_LEFT) {
+				uint64_t target = instance.cycles > rewind->interval ? instance.cycles-rewind->interval : 0;
+				if (target < VM_rewindoldest(rewind)) {target = VM_rewindoldest(rewind);}
+				VM_rewindseek(rewind, target);
+				std::cout << "Rewound to cycle " << instance.cycles << " (" << VM_rewindbytes(rewind)/1024 << " KiB buffered)" << std::endl;
+			}
 
 			char ch = 0;
 
@@ -326,14 +641,22 @@ int main(int argc, char* argv[]) {
 					case SDLK_ESCAPE:    ch = 27;   break;
 				}
 			}
-			if (ch != 0) {
+			if (ch != 0 && recorder) {
+				VM_recordkey(recorder, instance.cycles, ch);
+			}
+			if (ch != 0 && verifier) {
+				VM_verifykey(verifier, ch);
+			} else if (ch != 0 && rewind) {
+				VM_rewindkey(rewind, ch);
+			} else if (ch != 0) {
 				VM_registerkeypress(&keyboard, ch);
 			}
 		}
 
         frame ++;
         if (frame >= (uint64_t)updxframes) {
-			rendermem(instance.memory, (uint8_t)memrows, (uint8_t)charsnv); // render memory
+			auto renderstart = std::chrono::steady_clock::now();
+			rendermem(instance.memory, instance.memory.rows, (uint8_t)charsnv); // render memory
 
 			for (uint16_t x=0;x<(8*charsnh);x++) { // render main screen
 				for (uint16_t y=0;y<(8*charsnv);y++) {
@@ -347,8 +670,43 @@ int main(int argc, char* argv[]) {
 				}
 			}
 
+            if (hudshown) {
+                double target = fpslimiter ? (double)targetfps*coreamount : 0;
+                uint8_t behind = target > 0 && hudips < 0.95*target;
+                const uint8_t white[3] = {255, 255, 255}, good[3] = {64, 255, 64}, bad[3] = {255, 64, 64};
+                char lines[6][32];
+                snprintf(lines[0], sizeof(lines[0]), "ips  %s", hudrate(hudips).c_str());
+                snprintf(lines[1], sizeof(lines[1]), "tgt  %s", target > 0 ? hudrate(target).c_str() : "none");
+                snprintf(lines[2], sizeof(lines[2]), "cyc/f %llu", (unsigned long long)hudcyclesperframe);
+                snprintf(lines[3], sizeof(lines[3]), "frm %.1fms", hudframems);
+                snprintf(lines[4], sizeof(lines[4]), "rnd %.2fms", hudrenderms);
+                snprintf(lines[5], sizeof(lines[5]), "mmio %.2fms", hudmmioms);
+                for (uint8_t line=0;line<6 && line<charsnv;line++) {
+                    renderhudline(lines[line], line, (uint8_t)charsnh, line == 0 ? (behind ? bad : good) : white);
+                }
+            }
+
             frame = 0;
             SDL_RenderPresent(renderer);
+
+            auto presented = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(presented-hudlastpresent).count();
+            hudcyclesperframe = instance.cycles-hudcycles;
+            hudips = seconds > 0 ? hudcyclesperframe*coreamount/seconds : 0;
+            hudframems = seconds*1e3;
+            hudrenderms = std::chrono::duration<double, std::milli>(presented-renderstart).count();
+            hudmmioms = (hudmmionanos-hudlastmmio)/1e6;
+            hudcycles = instance.cycles;
+            hudlastmmio = hudmmionanos;
+            hudlastpresent = presented;
+
+            if (sampler) {
+                VM_drainsamples(sampler);
+            }
+            if (statswriter) {
+                VM_statsframe(statswriter);
+                VM_publishstats(statswriter, machine, 100000000); // 10 times a second
+            }
         }
 
         if (fpslimiter) {
@@ -356,52 +714,107 @@ int main(int argc, char* argv[]) {
         }
     }
     std::cout << "Emulation finished at IP '" << instance.IP << "'" << std::endl;
+    if (statswriter) {
+        VM_publishstats(statswriter, machine, 0);
+    }
+    finish_capture(capture, capturesettings);
+    if (sampler) {
+        VM_stopsampler(sampler);
+        instance.samplepoint = NULL;
+    }
 
+    VM_delrecorder(recorder, machine);
+    if (!savesnapshot.empty() && !savesnapshotat) {
+        std::cout << "Writing snapshot..." << std::endl;
+        if (!VM_writesnapshot(machine, savesnapshot.c_str())) {
+            std::cout << "Failed to write " << savesnapshot << "!" << std::endl;
+        }
+    }
     if (memdump) {
         std::cout << "Dumping memory..." << std::endl;
-        std::ofstream dumpfile("memdump.bin");
-        for (uint16_t index=0;index<memsize_words;index++) {
-            dumpfile << instance.memory.content[index] << std::endl;
+        if (!VM_dumpbinary("memdump.bin", instance.memory.content, memsize_words)) {
+            std::cout << "Failed to write memdump.bin!" << std::endl;
         }
-        dumpfile.close();
 
         std::cout << "Dumping disassembled memory..." << std::endl;
-        std::ofstream dumpfile2("memdumpdisasm.asm");
-        dumpfile2 << "%include \"common\"" << std::endl;
-        for (uint16_t index=0;index<memsize_words;index++) {
-            char* temp = VM_disasminstruction(instance.memory.content[index]);
-            dumpfile2 << temp << std::endl;
-            free(temp);
+        if (!VM_dumpdisasm("memdumpdisasm.asm", instance.memory.content, memsize_words)) {
+            std::cout << "Failed to write memdumpdisasm.asm!" << std::endl;
         }
-        dumpfile2.close();
     }
     if (tracedump) {
         std::cout << "Dumping trace..." << std::endl;
-        std::ofstream dumpfile("tracedump.bin");
-        for (uint16_t index=0;index<instance.tracesize;index++) {
-            dumpfile << instance.backtrace[index] << std::endl;
+        if (!VM_dumpbinary("tracedump.bin", instance.backtrace, instance.tracesize)) {
+            std::cout << "Failed to write tracedump.bin!" << std::endl;
         }
-        dumpfile.close();
 
         std::cout << "Dumping disassembled trace..." << std::endl;
-        std::ofstream dumpfile2("tracedumpdisasm.asm");
-        dumpfile2 << "%include \"common\"" << std::endl;
-        for (uint16_t index=0;index<instance.tracesize;index++) {
-            char* temp = VM_disasminstruction(instance.backtrace[index]);
-            dumpfile2 << instance.backtraceaddrs[index] << ": " << temp << "    "
-            << instance.backtraceop[index][0]
-            << "/"
-            << instance.backtraceop[index][1]
-            << "/"
-            << instance.backtraceop[index][2] << std::endl;
-            free(temp);
+        if (!VM_dumptracedisasm("tracedumpdisasm.asm", instance.backtrace, instance.backtraceaddrs, instance.backtraceop, instance.tracesize)) {
+            std::cout << "Failed to write tracedumpdisasm.asm!" << std::endl;
+        }
+    }
+
+    if (counters && instance.counters) {
+        std::cout << "Writing counters..." << std::endl;
+        FILE* out = fopen(countersout.c_str(), "w");
+        if (out) {
+            VM_writecountersjson(out, VM_getcounters(&instance), &instance.memory);
+            fclose(out);
+        } else {
+            std::cout << "Failed to write " << countersout << "!" << std::endl;
+        }
+    }
+
+    VM_symbols symbols = VM_loadsymbols(symbolpath.c_str());
+    if (!symbolpath.empty() && symbols.amount == 0) {
+        std::cout << "Failed to load symbols from " << symbolpath << "!" << std::endl;
+    }
+    if (profile) {
+        std::cout << "Writing hot spot report..." << std::endl;
+        FILE* report = fopen(profileout.c_str(), "w");
+        if (report) {
+            VM_writehotspots(report, instance.ipcounts, &instance.memory, &symbols);
+            fclose(report);
+        } else {
+            std::cout << "Failed to write " << profileout << "!" << std::endl;
+        }
+    }
+    if (sampler) {
+        std::cout << "Writing sample report..." << std::endl;
+        FILE* report = fopen(sampleout.c_str(), "w");
+        if (report) {
+            VM_writesamples(report, sampler, &instance.memory, &symbols);
+            fclose(report);
+        } else {
+            std::cout << "Failed to write " << sampleout << "!" << std::endl;
+        }
+        VM_delsampler(sampler);
+    }
+    if (callgraph && instance.callprof) {
+        std::cout << "Writing call graph..." << std::endl;
+        FILE* folded = fopen(callgraphout.c_str(), "w");
+        if (folded) {
+            VM_writefolded(folded, instance.callprof, &symbols);
+            fclose(folded);
+        } else {
+            std::cout << "Failed to write " << callgraphout << "!" << std::endl;
+        }
+        FILE* report = fopen(callgraphreport.c_str(), "w");
+        if (report) {
+            VM_writefunctions(report, instance.callprof, &symbols);
+            fclose(report);
+        } else {
+            std::cout << "Failed to write " << callgraphreport << "!" << std::endl;
         }
-        dumpfile2.close();
     }
+    VM_delsymbols(&symbols);
 
-    VM_delterm(&terminal);
-    VM_delinstance(instance);
+    uint8_t diverged = verifier && verifier->diverged;
+    VM_delverifier(verifier);
+    VM_delrewind(rewind);
+    VM_delstats(statswriter);
+    VM_delmachine(machine);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
+    return diverged ? 1 : 0;
 }
@@ -5,66 +5,118 @@ Written by Justus Wolff in very late 2025.
 #include <stdlib.h>
 #include <memory.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include "memory.h"
 #include "common.h"
 #include "cores.h"
 
 
-void VM_addrhook(VM_memory* memory, uint16_t addr, VM_mrhook hook, uint16_t length) {
+void VM_addrhook(VM_memory* memory, uint16_t addr, VM_mrhook hook, uint16_t length, void* ctx) {
 	memory->rhooks[memory->rha++] = hook;
 	memory->rhaddrf[memory->rha-1] = addr;
 	memory->rhaddrt[memory->rha-1] = addr+length;
+	memory->rhctx[memory->rha-1] = ctx;
 }
-void VM_addwhook(VM_memory* memory, uint16_t addr, VM_mwhook hook, uint16_t length) {
+void VM_addwhook(VM_memory* memory, uint16_t addr, VM_mwhook hook, uint16_t length, void* ctx) {
 	memory->whooks[memory->wha++] = hook;
 	memory->whaddrf[memory->wha-1] = addr;
 	memory->whaddrt[memory->wha-1] = addr+length;
+	memory->whctx[memory->wha-1] = ctx;
 }
-VM_mrhook VM_callrhooks(VM_memory memory, uint16_t addr) {
-	for (uint16_t i=0;i<memory.rha;i++) {
-		if (addr >= memory.rhaddrf[i] && addr <= memory.rhaddrt[i]) {return memory.rhooks[i];}
+static uint64_t VM_hookclock(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000000ull+(uint64_t)now.tv_nsec;
+}
+int16_t VM_callrhooks(const VM_memory* memory, uint16_t addr) { // index of the hook handling addr, -1 if none
+	for (uint16_t i=0;i<memory->rha;i++) {
+		if (addr >= memory->rhaddrf[i] && addr <= memory->rhaddrt[i]) {
+			if (memory->rhcounts) {memory->rhcounts[i] ++;}
+			return i;
+		}
 	}
-	return NULL;
+	return -1;
 }
-uint8_t VM_callwhooks(VM_memory memory, uint16_t addr, VM_word val) {
+uint8_t VM_callwhooks(const VM_memory* memory, uint16_t addr, VM_word val) {
 	uint8_t called = 0;
-	for (uint16_t i=0;i<memory.wha;i++) {
-		if (addr >= memory.whaddrf[i] && addr <= memory.whaddrt[i]) {
-			memory.whooks[i](val, addr-memory.whaddrf[i]);
+	uint64_t start = 0;
+	for (uint16_t i=0;i<memory->wha;i++) {
+		if (addr >= memory->whaddrf[i] && addr <= memory->whaddrt[i]) {
+			if (memory->hooknanos && !called) {start = VM_hookclock();} // only once a hook matched, plain stores aren't timed
+			if (memory->whcounts) {memory->whcounts[i] ++;}
+			memory->whooks[i](memory->whctx[i], val, addr-memory->whaddrf[i]);
 			called = 1;
 		}
 	}
+	if (memory->hooknanos && called) {*memory->hooknanos += VM_hookclock()-start;}
 	return called;
 }
-uint16_t VM_getsize(uint8_t rows, uint16_t rowsize) {
-	return rowsize*rows;
+static uint16_t VM_fitrows(uint16_t rows, uint16_t rowsize) {
+	if (rowsize && (uint32_t)rows*rowsize > 65536) {return 65536/rowsize;}
+	return rows;
+}
+uint32_t VM_getsize(uint16_t rows, uint16_t rowsize) {
+	return (uint32_t)VM_fitrows(rows, rowsize)*rowsize;
+}
+uint32_t VM_getcapacity(uint16_t rows, uint16_t rowsize) {
+	uint32_t size = VM_getsize(rows, rowsize);
+	uint32_t capacity = 1;
+	while (capacity < size) {capacity <<= 1;}
+	return capacity;
 }
-VM_memory VM_newmemory(uint8_t rows, uint16_t rowsize) {
+uint16_t VM_getmask(uint16_t rows, uint16_t rowsize) {
+	return (uint16_t)(VM_getcapacity(rows, rowsize)-1);
+}
+VM_word VM_mempeek(const VM_memory* memory, uint16_t addr) {
+	return memory->content[addr & memory->mask];
+}
+VM_memory VM_newmemory(uint16_t rows, uint16_t rowsize) {
 	VM_memory out;
-	out.rows = rows;
+	out.rows = VM_fitrows(rows, rowsize);
 	out.rowsize = rowsize;
-	out.content = (VM_word*)malloc(sizeof(VM_word)*VM_getsize(rows, rowsize));
+	out.mask = VM_getmask(rows, rowsize);
+	out.content = (VM_word*)calloc(VM_getcapacity(rows, rowsize), sizeof(VM_word));
 	memset(out.content, 0xAA, sizeof(VM_word)*VM_getsize(rows, rowsize));
 	out.rha = 0;
 	out.wha = 0;
+	out.rhcounts = NULL;
+	out.whcounts = NULL;
+	out.hooknanos = NULL;
+	out.dirtyrows = NULL;
+	out.mappedbytes = 0;
 	return out;
 }
-VM_word VM_memread(VM_memory memory, uint16_t addr) {
-	VM_mrhook hook = VM_callrhooks(memory, addr);
-	if (hook != NULL) {
-		return hook(addr);
+void VM_delmemory(VM_memory* memory) {
+	if (memory->mappedbytes) {
+		munmap(memory->content, memory->mappedbytes);
+	} else {
+		free(memory->content);
+	}
+	memory->content = NULL;
+	memory->mappedbytes = 0;
+}
+VM_word VM_memread(const VM_memory* memory, uint16_t addr) {
+	int16_t hook = VM_callrhooks(memory, addr);
+	if (hook >= 0) {
+		if (!memory->hooknanos) {return memory->rhooks[hook](memory->rhctx[hook], addr-memory->rhaddrf[hook]);}
+		uint64_t start = VM_hookclock();
+		VM_word value = memory->rhooks[hook](memory->rhctx[hook], addr-memory->rhaddrf[hook]);
+		*memory->hooknanos += VM_hookclock()-start;
+		return value;
 	}
-	if (addr >= VM_getsize(memory.rows, memory.rowsize)) {return VM_nullword;}
-	VM_word temp = memory.content[addr];
+	VM_word temp = memory->content[addr & memory->mask]; // unmapped words are 0
 	patchword(&temp);
 	return temp;
 }
 void VM_memwrite(VM_memory* memory, uint16_t addr, VM_word newval) {
-	if (VM_callwhooks(*memory, addr, newval)) {return;}
-	if (addr >= VM_getsize(memory->rows, memory->rowsize)) {return;}
+	if (VM_callwhooks(memory, addr, newval)) {return;}
+	addr &= memory->mask;
+	if (addr >= VM_getsize(memory->rows, memory->rowsize)) {return;} // unmapped
 	patchword(&newval);
 	memory->content[addr] = newval;
+	if (memory->dirtyrows) {memory->dirtyrows[addr/memory->rowsize] = 1;}
 }
 
 
@@ -1,12 +1,17 @@
 #include "common.h"
 #pragma once
-typedef VM_word(*VM_mrhook)(uint16_t);
-typedef void(*VM_mwhook)(VM_word, uint16_t);
+typedef VM_word(*VM_mrhook)(void*, uint16_t); // (ctx, offset into the hooked range)
+typedef void(*VM_mwhook)(void*, VM_word, uint16_t);
 
+// the R3 address space is 64K words. memory repeats through all of it: an address is masked with the next power
+// of two of the memory size minus 1 (mask), so 32K words show up twice and 8K words 8 times. when the size isn't
+// a power of two, the words between it and the mirror are unmapped (read 0, writes are dropped).
+// hooks come first and see the address unmasked, like devices on the bus.
 typedef struct {
 	uint16_t rows;
 	uint16_t rowsize;
-	VM_word* content;
+	uint16_t mask;
+	VM_word* content; // mask+1 words, the unmapped ones stay 0
 
 	// hooks
 	uint16_t rha;
@@ -17,13 +22,24 @@ typedef struct {
 	uint16_t whaddrf[32];
 	uint16_t rhaddrt[32];
 	uint16_t whaddrt[32];
+	void* rhctx[32];
+	void* whctx[32];
+	uint64_t* rhcounts; // per hook call counters (see counters.h), NULL if not counting
+	uint64_t* whcounts;
+	uint64_t* hooknanos; // adds up the time spent in hooks, NULL if not timing (the HUD in main.cpp)
+	uint8_t* dirtyrows; // set to 1 for every row written to, NULL if not tracking (see rewind.h)
+	uint64_t mappedbytes; // content is a private mapping of a ROM image this big (see romimage.h), 0 if it came from malloc
 } VM_memory;
 
 
 
-VM_word VM_memread(VM_memory memory, uint16_t addr);
+VM_word VM_memread(const VM_memory* memory, uint16_t addr);
 void VM_memwrite(VM_memory* memory, uint16_t addr, VM_word newval);
-void VM_addrhook(VM_memory* memory, uint16_t addr, VM_mrhook hook, uint16_t length);
-void VM_addwhook(VM_memory* memory, uint16_t addr, VM_mwhook hook, uint16_t length);
-uint16_t VM_getsize(uint8_t rows, uint16_t rowsize);
-VM_memory VM_newmemory(uint8_t rows, uint16_t rowsize);
+void VM_addrhook(VM_memory* memory, uint16_t addr, VM_mrhook hook, uint16_t length, void* ctx);
+void VM_addwhook(VM_memory* memory, uint16_t addr, VM_mwhook hook, uint16_t length, void* ctx);
+uint32_t VM_getsize(uint16_t rows, uint16_t rowsize); // words, rows past the 64K address space are cut off
+uint16_t VM_getmask(uint16_t rows, uint16_t rowsize);
+uint32_t VM_getcapacity(uint16_t rows, uint16_t rowsize); // words allocated for content, mask+1
+VM_word VM_mempeek(const VM_memory* memory, uint16_t addr); // mirrored, without hooks and patchword (for tools and dumps)
+VM_memory VM_newmemory(uint16_t rows, uint16_t rowsize);
+void VM_delmemory(VM_memory* memory);
@@ -0,0 +1,213 @@
+/*
+Guest profiling: per address execution histogram and call graph.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "profiler.h"
+#include "disassembler.h"
+
+uint64_t* VM_newiphistogram(void) {
+    return (uint64_t*)calloc(VM_profaddrs, sizeof(uint64_t));
+}
+
+const uint64_t* VM_sortcounts; // qsort has no context argument
+int VM_cmpheat(const void* a, const void* b) {
+    uint64_t ca = VM_sortcounts[*(const uint16_t*)a];
+    uint64_t cb = VM_sortcounts[*(const uint16_t*)b];
+    if (ca != cb) {return ca > cb ? -1 : 1;}
+    return *(const uint16_t*)a < *(const uint16_t*)b ? -1 : 1;
+}
+void VM_writehotspots(FILE* out, const uint64_t* counts, const VM_memory* memory, const VM_symbols* symbols) {
+    uint16_t* addrs = (uint16_t*)malloc(VM_profaddrs*sizeof(uint16_t));
+    if (!addrs) {return;}
+    uint32_t used = 0;
+    uint64_t total = 0;
+    for (uint32_t addr=0;addr<VM_profaddrs;addr++) {
+        if (counts[addr]) {
+            addrs[used++] = addr;
+            total += counts[addr];
+        }
+    }
+    VM_sortcounts = counts;
+    qsort(addrs, used, sizeof(uint16_t), VM_cmpheat);
+
+    fprintf(out, "# hot spots, %llu hits over %u addresses\n", (unsigned long long)total, used);
+    fprintf(out, "#        hits  percent  address  label                     disassembly\n");
+    char disasm[128];
+    char label[96];
+    for (uint32_t i=0;i<used;i++) {
+        uint16_t addr = addrs[i];
+        VM_disasmto(VM_mempeek(memory, addr), disasm); // no VM_memread, that would trigger io hooks
+
+        label[0] = 0x00;
+        const VM_symbol* symbol = VM_findsymbol(symbols, addr);
+        if (symbol) {
+            if (symbol->addr == addr) {
+                snprintf(label, sizeof(label), "%s", symbol->name);
+            } else {
+                snprintf(label, sizeof(label), "%s+%u", symbol->name, addr-symbol->addr);
+            }
+        }
+        fprintf(out, "%13llu  %6.2f%%  0x%04X   %-24s  %s\n", (unsigned long long)counts[addr], 100.0*counts[addr]/total, addr, label, disasm);
+    }
+    free(addrs);
+}
+
+#define VM_callmaxdepth 65536 // deeper calls get attributed to the deepest frame
+
+uint32_t VM_callchild(VM_callprof* prof, uint32_t parent, uint16_t func) {
+    for (uint32_t i=prof->nodes[parent].child;i;i=prof->nodes[i].sibling) {
+        if (prof->nodes[i].func == func) {return i;}
+    }
+    if (prof->nodeamount == prof->nodecapacity) {
+        VM_callnode* grown = (VM_callnode*)realloc(prof->nodes, prof->nodecapacity*2*sizeof(VM_callnode));
+        if (!grown) {return parent;}
+        prof->nodes = grown;
+        prof->nodecapacity *= 2;
+    }
+    uint32_t index = prof->nodeamount++;
+    VM_callnode* node = &prof->nodes[index];
+    node->func = func;
+    node->parent = parent;
+    node->child = 0;
+    node->sibling = prof->nodes[parent].child;
+    node->self = 0;
+    prof->nodes[parent].child = index;
+    return index;
+}
+VM_callprof* VM_newcallprof(uint16_t entry) {
+    VM_callprof* prof = (VM_callprof*)calloc(1, sizeof(VM_callprof));
+    if (!prof) {return NULL;}
+    prof->nodecapacity = 1024;
+    prof->nodes = (VM_callnode*)calloc(prof->nodecapacity, sizeof(VM_callnode));
+    prof->stackcapacity = 256;
+    prof->stack = (VM_callframe*)calloc(prof->stackcapacity, sizeof(VM_callframe));
+    if (!prof->nodes || !prof->stack) {
+        VM_delcallprof(prof);
+        return NULL;
+    }
+
+    // root frame, the code that runs from reset
+    prof->nodes[0].func = entry;
+    prof->nodeamount = 1;
+    prof->stack[0].node = 0;
+    prof->depth = 1;
+    prof->active[entry] = 1;
+    return prof;
+}
+void VM_delcallprof(VM_callprof* prof) {
+    if (!prof) {return;}
+    free(prof->nodes);
+    free(prof->stack);
+    free(prof);
+}
+void VM_proftick(VM_callprof* prof) {
+    prof->cycles ++;
+    prof->nodes[prof->stack[prof->depth-1].node].self ++;
+}
+void VM_profpop(VM_callprof* prof) {
+    VM_callframe* frame = &prof->stack[--prof->depth];
+    uint16_t func = prof->nodes[frame->node].func;
+    if (--prof->active[func] == 0) {
+        prof->inclusive[func] += prof->cycles-frame->entry;
+    }
+}
+void VM_profjump(VM_callprof* prof, uint16_t from, uint16_t to, uint8_t linkreg, uint8_t indirect) {
+    if (linkreg) { // call
+        if (prof->depth == prof->stackcapacity) {
+            if (prof->stackcapacity >= VM_callmaxdepth) {return;}
+            VM_callframe* grown = (VM_callframe*)realloc(prof->stack, prof->stackcapacity*2*sizeof(VM_callframe));
+            if (!grown) {return;}
+            prof->stack = grown;
+            prof->stackcapacity *= 2;
+        }
+        VM_callframe* frame = &prof->stack[prof->depth++];
+        frame->node = VM_callchild(prof, prof->stack[prof->depth-2].node, to);
+        frame->retaddr = from+1;
+        frame->entry = prof->cycles;
+        prof->active[to] ++;
+        return;
+    }
+    if (!indirect) {return;} // plain jump inside the current function
+
+    // return, possibly skipping frames that never returned themselves
+    for (uint32_t i=prof->depth-1;i>0;i--) {
+        if (prof->stack[i].retaddr == to) {
+            while (prof->depth > i) {
+                VM_profpop(prof);
+            }
+            return;
+        }
+    }
+}
+void VM_funcname(const VM_symbols* symbols, uint16_t func, char* out, size_t size) {
+    const VM_symbol* symbol = VM_findsymbol(symbols, func);
+    if (!symbol) {
+        snprintf(out, size, "0x%04X", func);
+    } else if (symbol->addr == func) {
+        snprintf(out, size, "%s", symbol->name);
+    } else {
+        snprintf(out, size, "%s+%u", symbol->name, func-symbol->addr);
+    }
+}
+void VM_writefolded(FILE* out, VM_callprof* prof, const VM_symbols* symbols) { // brendan gregg's folded stack format, one "a;b;c <count>" line per stack
+    uint32_t* path = (uint32_t*)malloc(sizeof(uint32_t)*VM_callmaxdepth);
+    if (!path) {return;}
+    char name[96];
+    for (uint32_t i=0;i<prof->nodeamount;i++) {
+        if (!prof->nodes[i].self) {continue;}
+        uint32_t length = 0;
+        for (uint32_t node=i;;node=prof->nodes[node].parent) {
+            path[length++] = node;
+            if (node == 0 || length == VM_callmaxdepth) {break;}
+        }
+        for (uint32_t j=length;j>0;j--) {
+            VM_funcname(symbols, prof->nodes[path[j-1]].func, name, sizeof(name));
+            fprintf(out, j == length ? "%s" : ";%s", name);
+        }
+        fprintf(out, " %llu\n", (unsigned long long)prof->nodes[i].self);
+    }
+    free(path);
+}
+void VM_writefunctions(FILE* out, VM_callprof* prof, const VM_symbols* symbols) {
+    uint64_t* exclusive = (uint64_t*)calloc(VM_profaddrs, sizeof(uint64_t));
+    uint64_t* inclusive = (uint64_t*)malloc(VM_profaddrs*sizeof(uint64_t));
+    uint16_t* funcs = (uint16_t*)malloc(VM_profaddrs*sizeof(uint16_t));
+    uint8_t* seen = (uint8_t*)calloc(VM_profaddrs, sizeof(uint8_t));
+    if (!exclusive || !inclusive || !funcs || !seen) {
+        free(exclusive);free(inclusive);free(funcs);free(seen);
+        return;
+    }
+    for (uint32_t i=0;i<prof->nodeamount;i++) {
+        exclusive[prof->nodes[i].func] += prof->nodes[i].self;
+    }
+    // frames that are still open count up to now
+    memcpy(inclusive, prof->inclusive, VM_profaddrs*sizeof(uint64_t));
+    for (uint32_t i=0;i<prof->depth;i++) {
+        uint16_t func = prof->nodes[prof->stack[i].node].func;
+        if (!seen[func]) {
+            seen[func] = 1;
+            inclusive[func] += prof->cycles-prof->stack[i].entry;
+        }
+    }
+
+    uint32_t used = 0;
+    for (uint32_t func=0;func<VM_profaddrs;func++) {
+        if (inclusive[func] || exclusive[func]) {funcs[used++] = func;}
+    }
+    VM_sortcounts = inclusive;
+    qsort(funcs, used, sizeof(uint16_t), VM_cmpheat);
+
+    fprintf(out, "# functions by inclusive cycles, %llu cycles total\n", (unsigned long long)prof->cycles);
+    fprintf(out, "#    inclusive  percent      exclusive  percent  address  function\n");
+    char name[96];
+    for (uint32_t i=0;i<used;i++) {
+        uint16_t func = funcs[i];
+        VM_funcname(symbols, func, name, sizeof(name));
+        fprintf(out, "%14llu  %6.2f%%  %13llu  %6.2f%%  0x%04X   %s\n",
+            (unsigned long long)inclusive[func], prof->cycles ? 100.0*inclusive[func]/prof->cycles : 0.0,
+            (unsigned long long)exclusive[func], prof->cycles ? 100.0*exclusive[func]/prof->cycles : 0.0,
+            func, name);
+    }
+    free(exclusive);free(inclusive);free(funcs);free(seen);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "memory.h"
+#include "symbols.h"
+
+#define VM_profaddrs 65536 // one counter per possible IP
+
+uint64_t* VM_newiphistogram(void);
+void VM_writehotspots(FILE* out, const uint64_t* counts, const VM_memory* memory, const VM_symbols* symbols);
+
+// call graph profiler. calls are taken jumps that store a return address (jmp rX, target),
+// returns are indirect jumps to an address that is waiting on the shadow call stack.
+typedef struct {
+    uint16_t func; // entry address of the function
+    uint32_t parent;
+    uint32_t child; // first child
+    uint32_t sibling; // next child of parent
+    uint64_t self; // exclusive cycles spent with this exact stack
+} VM_callnode;
+
+typedef struct {
+    uint32_t node;
+    uint16_t retaddr; // address the caller continues at
+    uint64_t entry; // cycle count on entry
+} VM_callframe;
+
+typedef struct {
+    VM_callnode* nodes; // node 0 is the root
+    uint32_t nodeamount;
+    uint32_t nodecapacity;
+
+    VM_callframe* stack;
+    uint32_t depth;
+    uint32_t stackcapacity;
+
+    uint64_t cycles;
+    uint64_t inclusive[VM_profaddrs]; // per function entry address
+    uint32_t active[VM_profaddrs]; // frames of each function on the stack, for recursion
+} VM_callprof;
+
+VM_callprof* VM_newcallprof(uint16_t entry);
+void VM_delcallprof(VM_callprof* prof);
+void VM_proftick(VM_callprof* prof);
+void VM_profjump(VM_callprof* prof, uint16_t from, uint16_t to, uint8_t linkreg, uint8_t indirect);
+void VM_writefolded(FILE* out, VM_callprof* prof, const VM_symbols* symbols);
+void VM_writefunctions(FILE* out, VM_callprof* prof, const VM_symbols* symbols);
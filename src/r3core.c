@@ -0,0 +1,121 @@
+/*
+libr3core's public API, a thin layer over machine.h.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "r3core.h"
+#include "machine.h"
+#include "snapshot.h"
+
+struct R3_machine {
+    VM_machine* machine;
+};
+
+uint32_t R3_apiversion(void) {
+    return R3_APIVERSION;
+}
+R3_config R3_defaultconfig(void) {
+    VM_machineconfig defaults = VM_defaultconfig();
+    R3_config out;
+    memset(&out, 0, sizeof(out));
+    out.size = sizeof(R3_config);
+    out.memrows = defaults.memrows;
+    out.rowsize = defaults.rowsize;
+    out.coreamount = defaults.coreamount;
+    out.allowsmul = defaults.allowsmul;
+    out.charsnh = defaults.charsnh;
+    out.charsnv = defaults.charsnv;
+    out.haspixplot = defaults.haspixplot;
+    out.engine = defaults.engine;
+    return out;
+}
+int R3_findengine(const char* name) {
+    return VM_findengine(name);
+}
+
+R3_machine* R3_create(const R3_config* config) {
+    if (!config || config->size < sizeof(R3_config) || config->engine >= VM_engineamount) {return NULL;}
+    VM_machineconfig vmconfig = VM_defaultconfig();
+    vmconfig.memrows = config->memrows;
+    vmconfig.rowsize = config->rowsize;
+    vmconfig.coreamount = config->coreamount;
+    vmconfig.allowsmul = config->allowsmul;
+    vmconfig.charsnh = config->charsnh;
+    vmconfig.charsnv = config->charsnv;
+    vmconfig.haspixplot = config->haspixplot;
+    vmconfig.engine = config->engine;
+    vmconfig.maketracedump = 0;
+
+    R3_machine* out = (R3_machine*)calloc(1, sizeof(R3_machine));
+    if (!out) {return NULL;}
+    out->machine = VM_newmachine(&vmconfig);
+    if (!out->machine) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+void R3_destroy(R3_machine* machine) {
+    if (!machine) {return;}
+    VM_delmachine(machine->machine);
+    free(machine);
+}
+int R3_loadrom(R3_machine* machine, const char* path) {
+    return VM_loadrom(machine->machine, path);
+}
+int R3_loadromdata(R3_machine* machine, const void* data, uint64_t size) { // cut off at the memory size like VM_loadrom
+    if (!data) {return 0;}
+    VM_memory* memory = &machine->machine->instance.memory;
+    uint64_t capacity = VM_getsize(memory->rows, memory->rowsize)*sizeof(VM_word);
+    memset(memory->content, 0x00, capacity);
+    memcpy(memory->content, data, size < capacity ? size : capacity);
+    return 1;
+}
+
+uint64_t R3_run(R3_machine* machine, uint64_t cycles) {
+    return VM_runmachine(machine->machine, cycles);
+}
+void R3_pushkey(R3_machine* machine, char key) {
+    VM_registerkeypress(&machine->machine->keyboard, key);
+}
+int R3_halted(const R3_machine* machine) {
+    return machine->machine->instance.halted;
+}
+uint32_t R3_ip(const R3_machine* machine) {
+    return machine->machine->instance.IP;
+}
+uint64_t R3_cycles(const R3_machine* machine) {
+    return machine->machine->instance.cycles;
+}
+uint32_t R3_readword(const R3_machine* machine, uint16_t addr) {
+    const VM_memory* memory = &machine->machine->instance.memory;
+    VM_word word = VM_mempeek(memory, addr);
+    patchword(&word);
+    return word;
+}
+
+uint64_t R3_snapshotsize(const R3_machine* machine) {
+    return VM_snapshotsize(machine->machine);
+}
+uint64_t R3_savesnapshot(const R3_machine* machine, void* buf, uint64_t bufsize) {
+    return VM_savesnapshot(machine->machine, buf, bufsize);
+}
+int R3_loadsnapshot(R3_machine* machine, const void* blob, uint64_t size) {
+    return VM_loadsnapshot(machine->machine, blob, size);
+}
+
+const uint8_t* R3_framebuffer(const R3_machine* machine, uint32_t* width, uint32_t* height) {
+    const VM_term* term = &machine->machine->term;
+    if (width) {*width = 8*(uint32_t)term->charsnh;}
+    if (height) {*height = 8*(uint32_t)term->charsnv;}
+    return term->pixbuf;
+}
+void R3_framebufferrgb(const R3_machine* machine, uint8_t* out) {
+    VM_termtorgb(&machine->machine->term, out);
+}
+uint64_t R3_memoryhash(const R3_machine* machine) {
+    return VM_memoryhash(machine->machine);
+}
+uint64_t R3_framebufferhash(const R3_machine* machine) {
+    return VM_framebufferhash(machine->machine);
+}
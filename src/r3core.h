@@ -0,0 +1,57 @@
+#pragma once
+/*
+Embedding API for libr3core. Plain C, no SDL, the machine is an opaque handle so the internals
+(machine.h and friends) can change without breaking callers. Bump R3_APIVERSION on any change here.
+*/
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define R3_APIVERSION 1
+
+typedef struct R3_machine R3_machine;
+
+typedef struct {
+    uint32_t size; // sizeof(R3_config), filled in by R3_defaultconfig
+    uint16_t memrows; // up to 512 rows of 128 words, the whole 64K address space
+    uint16_t rowsize;
+    uint8_t coreamount; // all multiply capable
+    uint8_t allowsmul;
+    uint8_t charsnh; // terminal size in characters, 8x8 pixels each
+    uint8_t charsnv;
+    uint8_t haspixplot;
+    uint8_t engine; // 0 reference, 1 predecoded, see R3_findengine
+} R3_config;
+
+uint32_t R3_apiversion(void); // R3_APIVERSION the library was built with
+R3_config R3_defaultconfig(void);
+int R3_findengine(const char* name); // -1 if unknown
+
+R3_machine* R3_create(const R3_config* config); // NULL on failure
+void R3_destroy(R3_machine* machine);
+int R3_loadrom(R3_machine* machine, const char* path); // 0 on failure
+int R3_loadromdata(R3_machine* machine, const void* data, uint64_t size); // same image format as the files, 0 if data is NULL
+
+uint64_t R3_run(R3_machine* machine, uint64_t cycles); // until halted or cycles ran out, returns the cycles executed
+void R3_pushkey(R3_machine* machine, char key); // what the keyboard register reads next
+int R3_halted(const R3_machine* machine);
+uint32_t R3_ip(const R3_machine* machine);
+uint64_t R3_cycles(const R3_machine* machine);
+uint32_t R3_readword(const R3_machine* machine, uint16_t addr); // raw memory, mirrored like the cores see it. no device hooks run
+
+// save states, the format of --save-snapshot. a snapshot loads into a machine with the same layout only
+uint64_t R3_snapshotsize(const R3_machine* machine);
+uint64_t R3_savesnapshot(const R3_machine* machine, void* buf, uint64_t bufsize); // bytes written, 0 if buf is too small
+int R3_loadsnapshot(R3_machine* machine, const void* blob, uint64_t size); // 0 if invalid or the layout differs
+
+// terminal, one byte per pixel holding a color index 0-15, rows of width pixels
+const uint8_t* R3_framebuffer(const R3_machine* machine, uint32_t* width, uint32_t* height);
+void R3_framebufferrgb(const R3_machine* machine, uint8_t* out); // 3 bytes per pixel
+uint64_t R3_memoryhash(const R3_machine* machine);
+uint64_t R3_framebufferhash(const R3_machine* machine);
+
+#ifdef __cplusplus
+}
+#endif
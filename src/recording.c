@@ -0,0 +1,167 @@
+/*
+Input recording and replay, see recording.h for the format.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "recording.h"
+
+static void VM_putvarint(FILE* file, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        fputc(byte | (value ? 0x80 : 0), file);
+    } while (value);
+}
+static uint8_t VM_getvarint(const uint8_t** pos, const uint8_t* end, uint64_t* value) {
+    *value = 0;
+    for (uint8_t shift=0;shift<64;shift+=7) {
+        if (*pos >= end) {return 0;}
+        uint8_t byte = *(*pos)++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {return 1;}
+    }
+    return 0;
+}
+
+static void VM_recordsnapshot(VM_recorder* recorder, const VM_machine* machine) {
+    uint64_t size = VM_snapshotsize(machine);
+    if (size > recorder->snapshotsize) {
+        free(recorder->snapshotbuf);
+        recorder->snapshotbuf = malloc(size);
+        recorder->snapshotsize = recorder->snapshotbuf ? size : 0;
+        if (!recorder->snapshotbuf) {return;}
+    }
+    VM_savesnapshot(machine, recorder->snapshotbuf, size);
+    fputc('S', recorder->file);
+    VM_putvarint(recorder->file, machine->instance.cycles);
+    VM_putvarint(recorder->file, size);
+    fwrite(recorder->snapshotbuf, 1, size, recorder->file);
+    recorder->lastcycle = machine->instance.cycles;
+    recorder->lastsnapshot = machine->instance.cycles;
+}
+
+VM_recorder* VM_newrecorder(const char* path, const VM_machine* machine, uint64_t snapshotinterval) {
+    VM_recorder* out = (VM_recorder*)calloc(1, sizeof(VM_recorder));
+    if (!out) {return NULL;}
+    out->file = fopen(path, "wb");
+    if (!out->file) {
+        free(out);
+        return NULL;
+    }
+    uint32_t version = VM_recordingversion;
+    fwrite(VM_recordingmagic, 1, 8, out->file);
+    fwrite(&version, sizeof(version), 1, out->file);
+    out->snapshotinterval = snapshotinterval;
+    VM_recordsnapshot(out, machine);
+    return out;
+}
+void VM_recordkey(VM_recorder* recorder, uint64_t cycle, char key) {
+    fputc('K', recorder->file);
+    VM_putvarint(recorder->file, cycle-recorder->lastcycle);
+    fputc(key, recorder->file);
+    recorder->lastcycle = cycle;
+}
+void VM_recordtick(VM_recorder* recorder, const VM_machine* machine) {
+    if (recorder->snapshotinterval && machine->instance.cycles-recorder->lastsnapshot >= recorder->snapshotinterval) {
+        VM_recordsnapshot(recorder, machine);
+    }
+}
+void VM_delrecorder(VM_recorder* recorder, const VM_machine* machine) {
+    if (!recorder) {return;}
+    fputc('E', recorder->file);
+    VM_putvarint(recorder->file, machine->instance.cycles-recorder->lastcycle);
+    fclose(recorder->file);
+    free(recorder->snapshotbuf);
+    free(recorder);
+}
+
+uint8_t VM_loadreplay(const char* path, VM_replay* out) {
+    memset(out, 0, sizeof(VM_replay));
+    out->file = VM_mapsnapshot(path);
+    const uint8_t* pos = (const uint8_t*)out->file.data;
+    const uint8_t* end = pos+out->file.size;
+    if (!pos || out->file.size < 12 || memcmp(pos, VM_recordingmagic, 8) != 0) {
+        VM_delreplay(out);
+        return 0;
+    }
+    uint32_t version;
+    memcpy(&version, pos+8, sizeof(version));
+    if (version != VM_recordingversion) {
+        VM_delreplay(out);
+        return 0;
+    }
+    pos += 12;
+
+    uint32_t keycapacity = 0, snapshotcapacity = 0;
+    uint64_t cycle = 0;
+    uint8_t ended = 0;
+    while (pos < end && !ended) {
+        uint8_t tag = *pos++;
+        uint64_t value, size;
+        if (!VM_getvarint(&pos, end, &value)) {break;}
+        if (tag == 'K') {
+            if (pos >= end) {break;}
+            cycle += value;
+            if (out->script.amount == keycapacity) {
+                keycapacity = keycapacity ? keycapacity*2 : 256;
+                out->script.events = (VM_inputevent*)realloc(out->script.events, keycapacity*sizeof(VM_inputevent));
+            }
+            out->script.events[out->script.amount].cycle = cycle;
+            out->script.events[out->script.amount++].key = (char)*pos++;
+        } else if (tag == 'S') {
+            if (!VM_getvarint(&pos, end, &size) || size > (uint64_t)(end-pos) || !VM_checksnapshot(pos, size)) {break;}
+            cycle = value;
+            if (out->snapshotamount == snapshotcapacity) {
+                snapshotcapacity = snapshotcapacity ? snapshotcapacity*2 : 16;
+                out->snapshots = (VM_replaysnapshot*)realloc(out->snapshots, snapshotcapacity*sizeof(VM_replaysnapshot));
+            }
+            out->snapshots[out->snapshotamount].cycle = cycle;
+            out->snapshots[out->snapshotamount].blob = pos;
+            out->snapshots[out->snapshotamount++].size = size;
+            pos += size;
+        } else if (tag == 'E') {
+            cycle += value;
+            ended = 1;
+        } else {
+            break;
+        }
+    }
+    out->endcycle = cycle; // a recording cut short still replays up to its last record
+    if (!out->snapshotamount) {
+        VM_delreplay(out);
+        return 0;
+    }
+    return 1;
+}
+void VM_delreplay(VM_replay* replay) {
+    VM_unmapsnapshot(&replay->file);
+    free(replay->snapshots);
+    VM_delinputscript(&replay->script);
+    replay->snapshots = NULL;
+    replay->snapshotamount = 0;
+}
+VM_machine* VM_newreplaymachine(VM_replay* replay, uint8_t engine) {
+    VM_machineconfig config = VM_snapshotconfig(VM_checksnapshot(replay->snapshots[0].blob, replay->snapshots[0].size));
+    config.engine = engine;
+    VM_machine* out = VM_newmachine(&config);
+    if (!out) {return NULL;}
+    VM_loadsnapshot(out, replay->snapshots[0].blob, replay->snapshots[0].size);
+    VM_seekinput(&replay->script, out->instance.cycles);
+    out->script = &replay->script;
+    return out;
+}
+uint8_t VM_replayseek(VM_replay* replay, VM_machine* machine, uint64_t cycle) {
+    if (cycle < replay->snapshots[0].cycle) {return 0;}
+    uint32_t nearest = 0;
+    for (uint32_t i=1;i<replay->snapshotamount && replay->snapshots[i].cycle <= cycle;i++) {
+        nearest = i;
+    }
+    // running on is cheaper than restoring if the machine is already between the snapshot and the target
+    const VM_replaysnapshot* snapshot = &replay->snapshots[nearest];
+    if (machine->instance.cycles > cycle || machine->instance.cycles < snapshot->cycle) {
+        if (!VM_loadsnapshot(machine, snapshot->blob, snapshot->size)) {return 0;}
+        VM_seekinput(&replay->script, snapshot->cycle);
+    }
+    VM_runmachine(machine, cycle-machine->instance.cycles);
+    return 1;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "machine.h"
+#include "snapshot.h"
+
+// input recordings. a header, then records in cycle order:
+//     'K' <varint cycles since the previous record> <key>
+//     'S' <varint cycle> <varint size> <snapshot blob>   state at the start of that cycle
+//     'E' <varint cycles since the previous record>      end of the recording
+// varints are LEB128. the first record is always a snapshot, so a recording replays without the ROM.
+#define VM_recordingmagic "R3REC\x1A\n"
+#define VM_recordingversion 1
+
+typedef struct {
+    FILE* file;
+    uint64_t lastcycle; // of the previous record
+    uint64_t snapshotinterval; // cycles between embedded snapshots, 0 for only the first
+    uint64_t lastsnapshot;
+    void* snapshotbuf;
+    uint64_t snapshotsize;
+} VM_recorder;
+
+VM_recorder* VM_newrecorder(const char* path, const VM_machine* machine, uint64_t snapshotinterval);
+void VM_recordkey(VM_recorder* recorder, uint64_t cycle, char key); // log only, still register the key
+void VM_recordtick(VM_recorder* recorder, const VM_machine* machine); // after every cycle, embeds the snapshots
+void VM_delrecorder(VM_recorder* recorder, const VM_machine* machine); // writes the end record and closes
+
+typedef struct {
+    uint64_t cycle;
+    const void* blob; // points into the mapped file
+    uint64_t size;
+} VM_replaysnapshot;
+
+typedef struct {
+    VM_snapshotfile file;
+    VM_replaysnapshot* snapshots; // by cycle, [0] is where the recording starts
+    uint32_t snapshotamount;
+    VM_inputscript script; // the recorded keys
+    uint64_t endcycle;
+} VM_replay;
+
+uint8_t VM_loadreplay(const char* path, VM_replay* out); // 0 if missing or not a recording
+void VM_delreplay(VM_replay* replay);
+VM_machine* VM_newreplaymachine(VM_replay* replay, uint8_t engine); // at the start of the recording, script attached
+uint8_t VM_replayseek(VM_replay* replay, VM_machine* machine, uint64_t cycle); // nearest snapshot, then runs up to cycle
@@ -0,0 +1,190 @@
+/*
+Rewind ring, see rewind.h.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+
+static uint64_t VM_rewindpixels(const VM_machine* machine) {
+    return (8*machine->term.charsnh)*(8*machine->term.charsnv);
+}
+static VM_keyframe* VM_keyframeat(VM_rewind* rewind, uint32_t index) { // 0 is the oldest
+    return &rewind->keyframes[(rewind->first+index) % rewind->capacity];
+}
+static void VM_clearundo(VM_keyframe* keyframe) {
+    free(keyframe->undorows);
+    free(keyframe->undodata);
+    keyframe->undorows = NULL;
+    keyframe->undodata = NULL;
+    keyframe->undoamount = 0;
+}
+
+static void VM_pushkeyframe(VM_rewind* rewind) {
+    VM_machine* machine = rewind->machine;
+    if (rewind->amount == rewind->capacity) { // drop the oldest, along with the keys only it needed
+        VM_clearundo(VM_keyframeat(rewind, 0));
+        rewind->first = (rewind->first+1) % rewind->capacity;
+        rewind->amount --;
+    }
+    if (!rewind->replaying && rewind->keyamount && rewind->keylog[0].cycle < VM_keyframeat(rewind, 0)->cycle) {
+        uint64_t oldest = VM_keyframeat(rewind, 0)->cycle;
+        uint32_t drop = 0;
+        while (drop < rewind->keyamount && rewind->keylog[drop].cycle < oldest) {drop++;}
+        memmove(rewind->keylog, rewind->keylog+drop, (rewind->keyamount-drop)*sizeof(VM_inputevent));
+        rewind->keyamount -= drop;
+        rewind->keynext -= drop;
+    }
+    VM_keyframe* keyframe = VM_keyframeat(rewind, rewind->amount++);
+    keyframe->cycle = machine->instance.cycles;
+    VM_snapshotstate(machine, &keyframe->state);
+    if (!keyframe->pixbuf) {keyframe->pixbuf = (uint8_t*)malloc(VM_rewindpixels(machine));}
+    memcpy(keyframe->pixbuf, machine->term.pixbuf, VM_rewindpixels(machine));
+    keyframe->scriptnext = machine->script ? machine->script->next : 0;
+    VM_clearundo(keyframe);
+}
+
+VM_rewind* VM_newrewind(VM_machine* machine, uint64_t interval, uint32_t keyframes) {
+    VM_rewind* out = (VM_rewind*)calloc(1, sizeof(VM_rewind));
+    if (!out) {return NULL;}
+    VM_memory* memory = &machine->instance.memory;
+    uint64_t words = VM_getsize(memory->rows, memory->rowsize);
+
+    out->machine = machine;
+    out->interval = interval ? interval : 1;
+    out->capacity = keyframes > 1 ? keyframes : 2;
+    out->keyframes = (VM_keyframe*)calloc(out->capacity, sizeof(VM_keyframe));
+    out->shadow = (VM_word*)malloc(words*sizeof(VM_word) + 1);
+    out->dirtyrows = (uint8_t*)calloc(memory->rows + 1, 1);
+    if (!out->keyframes || !out->shadow || !out->dirtyrows) {
+        VM_delrewind(out);
+        return NULL;
+    }
+    memcpy(out->shadow, memory->content, words*sizeof(VM_word));
+    memory->dirtyrows = out->dirtyrows;
+    VM_pushkeyframe(out);
+    return out;
+}
+void VM_delrewind(VM_rewind* rewind) {
+    if (!rewind) {return;}
+    if (rewind->machine->instance.memory.dirtyrows == rewind->dirtyrows) {
+        rewind->machine->instance.memory.dirtyrows = NULL;
+    }
+    for (uint32_t i=0;rewind->keyframes && i<rewind->capacity;i++) {
+        VM_clearundo(&rewind->keyframes[i]);
+        free(rewind->keyframes[i].pixbuf);
+    }
+    free(rewind->keyframes);
+    free(rewind->shadow);
+    free(rewind->dirtyrows);
+    free(rewind->keylog);
+    free(rewind);
+}
+
+static void VM_deliverkeys(VM_rewind* rewind) {
+    VM_machine* machine = rewind->machine;
+    while (rewind->keynext < rewind->keyamount && rewind->keylog[rewind->keynext].cycle <= machine->instance.cycles) {
+        VM_registerkeypress(&machine->keyboard, rewind->keylog[rewind->keynext++].key);
+    }
+}
+void VM_rewindkey(VM_rewind* rewind, char key) {
+    rewind->keyamount = rewind->keynext; // the logged future is void now
+    if (rewind->keyamount == rewind->keycapacity) {
+        rewind->keycapacity = rewind->keycapacity ? rewind->keycapacity*2 : 64;
+        rewind->keylog = (VM_inputevent*)realloc(rewind->keylog, rewind->keycapacity*sizeof(VM_inputevent));
+    }
+    rewind->keylog[rewind->keyamount].cycle = rewind->machine->instance.cycles;
+    rewind->keylog[rewind->keyamount++].key = key;
+    rewind->keynext = rewind->keyamount;
+    VM_registerkeypress(&rewind->machine->keyboard, key);
+}
+
+void VM_rewindtick(VM_rewind* rewind) {
+    VM_machine* machine = rewind->machine;
+    VM_keyframe* newest = VM_keyframeat(rewind, rewind->amount-1);
+    if (machine->instance.cycles-newest->cycle < rewind->interval) {
+        VM_deliverkeys(rewind);
+        return;
+    }
+
+    // the rows written since the newest keyframe become its undo record, the shadow moves forward
+    VM_memory* memory = &machine->instance.memory;
+    uint16_t rowsize = memory->rowsize;
+    uint32_t dirty = 0;
+    for (uint16_t row=0;row<memory->rows;row++) {
+        dirty += rewind->dirtyrows[row];
+    }
+    if (dirty) {
+        newest->undorows = (uint16_t*)malloc(dirty*sizeof(uint16_t));
+        newest->undodata = (VM_word*)malloc((uint64_t)dirty*rowsize*sizeof(VM_word));
+        for (uint16_t row=0;row<memory->rows;row++) {
+            if (!rewind->dirtyrows[row]) {continue;}
+            VM_word* shadowrow = rewind->shadow+(uint64_t)row*rowsize;
+            newest->undorows[newest->undoamount] = row;
+            memcpy(newest->undodata+(uint64_t)newest->undoamount*rowsize, shadowrow, rowsize*sizeof(VM_word));
+            memcpy(shadowrow, memory->content+(uint64_t)row*rowsize, rowsize*sizeof(VM_word));
+            newest->undoamount ++;
+            rewind->dirtyrows[row] = 0;
+        }
+    }
+    VM_pushkeyframe(rewind);
+    VM_deliverkeys(rewind);
+}
+
+uint8_t VM_rewindseek(VM_rewind* rewind, uint64_t cycle) {
+    VM_machine* machine = rewind->machine;
+    VM_memory* memory = &machine->instance.memory;
+    uint16_t rowsize = memory->rowsize;
+    if (cycle < VM_rewindoldest(rewind)) {return 0;}
+
+    if (cycle < machine->instance.cycles) {
+        uint32_t target = rewind->amount-1;
+        while (VM_keyframeat(rewind, target)->cycle > cycle) {target--;}
+
+        // back to the newest keyframe, then undo keyframe by keyframe
+        for (uint16_t row=0;row<memory->rows;row++) {
+            if (!rewind->dirtyrows[row]) {continue;}
+            memcpy(memory->content+(uint64_t)row*rowsize, rewind->shadow+(uint64_t)row*rowsize, rowsize*sizeof(VM_word));
+            rewind->dirtyrows[row] = 0;
+        }
+        for (uint32_t i=rewind->amount-1;i-- > target;) {
+            VM_keyframe* keyframe = VM_keyframeat(rewind, i);
+            for (uint32_t j=0;j<keyframe->undoamount;j++) {
+                uint64_t offset = (uint64_t)keyframe->undorows[j]*rowsize;
+                memcpy(memory->content+offset, keyframe->undodata+(uint64_t)j*rowsize, rowsize*sizeof(VM_word));
+                memcpy(rewind->shadow+offset, keyframe->undodata+(uint64_t)j*rowsize, rowsize*sizeof(VM_word));
+            }
+            VM_clearundo(keyframe);
+        }
+        rewind->amount = target+1;
+
+        VM_keyframe* keyframe = VM_keyframeat(rewind, target);
+        VM_restorestate(machine, &keyframe->state);
+        memcpy(machine->term.pixbuf, keyframe->pixbuf, VM_rewindpixels(machine));
+        if (machine->script) {machine->script->next = keyframe->scriptnext;}
+    }
+
+    // re-execute up to the target with the logged keys
+    rewind->keynext = 0;
+    while (rewind->keynext < rewind->keyamount && rewind->keylog[rewind->keynext].cycle < machine->instance.cycles) {rewind->keynext++;}
+    rewind->replaying = 1;
+    VM_deliverkeys(rewind);
+    while (machine->instance.cycles < cycle && !machine->instance.halted) {
+        VM_runmachine(machine, 1);
+        VM_rewindtick(rewind);
+    }
+    rewind->replaying = 0;
+    return 1;
+}
+uint64_t VM_rewindoldest(const VM_rewind* rewind) {
+    return rewind->keyframes[rewind->first].cycle;
+}
+uint64_t VM_rewindbytes(const VM_rewind* rewind) {
+    const VM_memory* memory = &rewind->machine->instance.memory;
+    uint64_t out = VM_getsize(memory->rows, memory->rowsize)*sizeof(VM_word);
+    for (uint32_t i=0;i<rewind->amount;i++) {
+        const VM_keyframe* keyframe = &rewind->keyframes[(rewind->first+i) % rewind->capacity];
+        out += sizeof(VM_keyframe)+VM_rewindpixels(rewind->machine);
+        out += (uint64_t)keyframe->undoamount*(sizeof(uint16_t)+memory->rowsize*sizeof(VM_word));
+    }
+    return out;
+}
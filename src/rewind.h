@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include "machine.h"
+#include "snapshot.h"
+
+// stepping backwards. a bounded ring of keyframes, every interval cycles. a keyframe keeps the
+// machine state without memory, plus the old contents of the rows written until the next keyframe.
+// memory is tracked per row (VM_memory.dirtyrows) against one shadow copy as of the newest keyframe,
+// so the ring only grows with the rows a program actually writes.
+// seeking undoes rows back to the nearest keyframe at or before the target and re-executes from
+// there, replaying the logged keys (and the input script) at the same cycles.
+
+typedef struct {
+    uint64_t cycle;
+    VM_snapshotheader state;
+    uint8_t* pixbuf;
+    uint32_t scriptnext;
+    uint16_t* undorows; // rows written until the next keyframe
+    VM_word* undodata; // their contents at this keyframe, rowsize words each
+    uint32_t undoamount;
+} VM_keyframe;
+
+typedef struct {
+    VM_machine* machine; // not owned
+    uint64_t interval;
+    VM_keyframe* keyframes; // ring
+    uint32_t capacity;
+    uint32_t first;
+    uint32_t amount;
+    VM_word* shadow; // memory as of the newest keyframe
+    uint8_t* dirtyrows; // attached to the machine's memory
+
+    VM_inputevent* keylog; // keys since the oldest keyframe. after a seek the later ones are replayed
+    uint32_t keyamount; // again as their cycles come up, until a new key starts a different future
+    uint32_t keycapacity;
+    uint32_t keynext; // first key not delivered yet
+    uint8_t replaying;
+} VM_rewind;
+
+VM_rewind* VM_newrewind(VM_machine* machine, uint64_t interval, uint32_t keyframes);
+void VM_delrewind(VM_rewind* rewind);
+void VM_rewindkey(VM_rewind* rewind, char key); // use instead of VM_registerkeypress
+void VM_rewindtick(VM_rewind* rewind); // after every cycle, takes the keyframes and delivers logged keys
+uint8_t VM_rewindseek(VM_rewind* rewind, uint64_t cycle); // 0 if cycle is older than the oldest keyframe
+uint64_t VM_rewindoldest(const VM_rewind* rewind);
+uint64_t VM_rewindbytes(const VM_rewind* rewind); // held by keyframes and deltas
@@ -0,0 +1,85 @@
+/*
+Copy on write ROM images. The image is written once to a memfd (an unlinked temp file where that's missing),
+every machine gets a MAP_PRIVATE mapping of it.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "romimage.h"
+
+static int VM_imagefile(void) {
+#ifdef MFD_CLOEXEC
+    int fd = memfd_create("r3rom", MFD_CLOEXEC);
+    if (fd >= 0) {return fd;}
+#endif
+    char path[] = "/tmp/r3romXXXXXX";
+    int fd2 = mkstemp(path);
+    if (fd2 >= 0) {unlink(path);}
+    return fd2;
+}
+
+VM_romimage* VM_newromimage(const VM_word* words, uint64_t amount, uint16_t rows, uint16_t rowsize) {
+    uint64_t size = VM_getsize(rows, rowsize);
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t bytes = (VM_getcapacity(rows, rowsize)*sizeof(VM_word)+page-1)/page*page; // the unmapped words up to the mirror stay 0
+    if (amount > size) {amount = size;}
+
+    VM_romimage* out = (VM_romimage*)calloc(1, sizeof(VM_romimage));
+    if (!out) {return NULL;}
+    out->fd = VM_imagefile();
+    out->bytes = bytes;
+    out->rows = rows;
+    out->rowsize = rowsize;
+    if (out->fd < 0 || ftruncate(out->fd, bytes) != 0) { // the file starts out zeroed
+        VM_delromimage(out);
+        return NULL;
+    }
+    VM_word* view = (VM_word*)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, out->fd, 0);
+    if (view == MAP_FAILED) {
+        VM_delromimage(out);
+        return NULL;
+    }
+    memcpy(view, words, amount*sizeof(VM_word));
+    mprotect(view, bytes, PROT_READ);
+    out->words = view;
+    out->hash = VM_hashbytes(view, size*sizeof(VM_word));
+    out->decoded = VM_newdecodetable(view, (uint32_t)size, VM_getmask(rows, rowsize));
+    if (!out->decoded) {
+        VM_delromimage(out);
+        return NULL;
+    }
+    return out;
+}
+VM_romimage* VM_loadromimage(const char* path, uint16_t rows, uint16_t rowsize) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {return NULL;}
+    uint64_t size = VM_getsize(rows, rowsize);
+    VM_word* words = (VM_word*)calloc(size ? size : 1, sizeof(VM_word));
+    uint64_t amount = words ? (fread(words, 1, size*sizeof(VM_word), file)+sizeof(VM_word)-1)/sizeof(VM_word) : 0; // a partial last word counts, like VM_loadrom
+    fclose(file);
+    VM_romimage* out = words ? VM_newromimage(words, amount, rows, rowsize) : NULL;
+    free(words);
+    return out;
+}
+void VM_delromimage(VM_romimage* image) {
+    if (!image) {return;}
+    if (image->words) {munmap((void*)image->words, image->bytes);}
+    if (image->fd >= 0) {close(image->fd);}
+    free(image->decoded);
+    free(image);
+}
+
+uint8_t VM_attachromimage(VM_machine* machine, const VM_romimage* image) {
+    VM_memory* memory = &machine->instance.memory;
+    if (VM_getsize(memory->rows, memory->rowsize) != VM_getsize(image->rows, image->rowsize) || memory->rowsize != image->rowsize) {return 0;}
+    void* content = mmap(NULL, image->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, image->fd, 0);
+    if (content == MAP_FAILED) {return 0;}
+    VM_delmemory(memory);
+    memory->content = (VM_word*)content;
+    memory->mappedbytes = image->bytes;
+    machine->engine->shared = image->decoded;
+    return 1;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include "machine.h"
+
+// a loaded ROM shared by every machine running it. the memory image lives in one anonymous file, machines map
+// it privately so they share its pages until they write to them (copy on write). the predecoded engine shares
+// a decode table of the image too. only the rows a program writes end up private to a machine.
+typedef struct {
+    int fd;
+    const VM_word* words; // read only view of the image
+    uint64_t bytes; // size of the image mapping, whole pages
+    uint16_t rows;
+    uint16_t rowsize;
+    uint64_t hash; // of the image, machines running the same program can share one
+    VM_decoded* decoded; // see VM_newdecodetable
+} VM_romimage;
+
+VM_romimage* VM_newromimage(const VM_word* words, uint64_t amount, uint16_t rows, uint16_t rowsize); // cut off at the memory size like VM_loadrom
+VM_romimage* VM_loadromimage(const char* path, uint16_t rows, uint16_t rowsize); // NULL if unreadable
+void VM_delromimage(VM_romimage* image); // after every machine using it is gone
+
+// replaces the machine's memory with a mapping of the image, instead of VM_loadrom. 0 if the layout differs or mapping fails
+uint8_t VM_attachromimage(VM_machine* machine, const VM_romimage* image);
@@ -0,0 +1,172 @@
+/*
+Sampling profiler driven by a POSIX interval timer.
+*/
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "sampler.h"
+#include "profiler.h"
+#include "disassembler.h"
+
+#define VM_samplering 4096 // must be a power of 2
+#define VM_sampleslots 256 // core slot is stored in 8 bits
+
+struct VM_sampler {
+    volatile uint32_t point; // IP | coreslot<<16, written by the cores
+    uint32_t ring[VM_samplering];
+    _Atomic uint32_t head; // written by the signal handler only
+    _Atomic uint32_t tail; // written by the drain only
+    _Atomic uint64_t dropped;
+
+    uint32_t hz;
+    uint64_t total;
+    uint64_t host;
+    uint64_t counts[VM_profaddrs];
+    uint64_t slotcounts[VM_sampleslots];
+    struct sigaction oldaction;
+};
+
+VM_sampler* VM_activesampler; // only one timer per process
+
+void VM_samplehandler(int sig) {
+    (void)sig;
+    VM_sampler* sampler = VM_activesampler;
+    if (!sampler) {return;}
+    uint32_t head = atomic_load_explicit(&sampler->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&sampler->tail, memory_order_acquire);
+    if (head-tail >= VM_samplering) { // drain fell behind
+        atomic_fetch_add_explicit(&sampler->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    sampler->ring[head & (VM_samplering-1)] = sampler->point;
+    atomic_store_explicit(&sampler->head, head+1, memory_order_release);
+}
+
+VM_sampler* VM_newsampler(uint32_t hz) {
+    VM_sampler* sampler = (VM_sampler*)calloc(1, sizeof(VM_sampler));
+    if (!sampler) {return NULL;}
+    sampler->hz = hz ? hz : 1;
+    atomic_init(&sampler->head, 0);
+    atomic_init(&sampler->tail, 0);
+    atomic_init(&sampler->dropped, 0);
+    return sampler;
+}
+void VM_delsampler(VM_sampler* sampler) {
+    if (!sampler) {return;}
+    VM_stopsampler(sampler);
+    free(sampler);
+}
+volatile uint32_t* VM_samplepoint(VM_sampler* sampler) {
+    return &sampler->point;
+}
+uint8_t VM_startsampler(VM_sampler* sampler) { // returns 0 if the timer could not be set up
+    if (VM_activesampler) {return 0;}
+    VM_activesampler = sampler;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = VM_samplehandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &sampler->oldaction) != 0) {
+        VM_activesampler = NULL;
+        return 0;
+    }
+
+    // ITIMER_PROF counts cpu time, so sleeping in the fps limiter is not sampled
+    struct itimerval timer;
+    uint32_t usec = 1000000/sampler->hz;
+    if (usec == 0) {usec = 1;}
+    timer.it_interval.tv_sec = usec/1000000;
+    timer.it_interval.tv_usec = usec%1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        sigaction(SIGPROF, &sampler->oldaction, NULL);
+        VM_activesampler = NULL;
+        return 0;
+    }
+    return 1;
+}
+void VM_stopsampler(VM_sampler* sampler) {
+    if (VM_activesampler != sampler) {return;}
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sigaction(SIGPROF, &sampler->oldaction, NULL);
+    VM_activesampler = NULL;
+    VM_drainsamples(sampler);
+}
+void VM_drainsamples(VM_sampler* sampler) {
+    uint32_t tail = atomic_load_explicit(&sampler->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&sampler->head, memory_order_acquire);
+    for (;tail!=head;tail++) {
+        uint32_t point = sampler->ring[tail & (VM_samplering-1)];
+        if (point == VM_samplehost) {
+            sampler->host ++;
+            continue;
+        }
+        sampler->counts[point & 0xFFFF] ++;
+        sampler->slotcounts[(point >> 16) & 0xFF] ++;
+        sampler->total ++;
+    }
+    atomic_store_explicit(&sampler->tail, tail, memory_order_release);
+}
+void VM_writesamples(FILE* out, VM_sampler* sampler, const VM_memory* memory, const VM_symbols* symbols) {
+    VM_drainsamples(sampler);
+    fprintf(out, "# %llu guest samples at %u Hz, %llu in host code, %llu dropped\n", (unsigned long long)sampler->total, sampler->hz,
+        (unsigned long long)sampler->host, (unsigned long long)atomic_load(&sampler->dropped));
+    if (!sampler->total) {return;}
+
+    // per symbol, every address counts towards the closest label before it
+    if (symbols && symbols->amount) {
+        uint64_t* symcounts = (uint64_t*)calloc(symbols->amount, sizeof(uint64_t));
+        uint32_t* order = (uint32_t*)malloc(symbols->amount*sizeof(uint32_t));
+        if (symcounts && order) {
+            uint64_t unknown = 0;
+            for (uint32_t addr=0;addr<VM_profaddrs;addr++) {
+                if (!sampler->counts[addr]) {continue;}
+                const VM_symbol* symbol = VM_findsymbol(symbols, addr);
+                if (symbol) {
+                    symcounts[symbol-symbols->entries] += sampler->counts[addr];
+                } else {
+                    unknown += sampler->counts[addr];
+                }
+            }
+            uint32_t used = 0;
+            for (uint32_t i=0;i<symbols->amount;i++) {
+                if (symcounts[i]) {order[used++] = i;}
+            }
+            // few symbols carry samples, a simple insertion sort is fine
+            for (uint32_t i=1;i<used;i++) {
+                uint32_t cur = order[i];
+                uint32_t j = i;
+                while (j > 0 && symcounts[order[j-1]] < symcounts[cur]) {
+                    order[j] = order[j-1];
+                    j--;
+                }
+                order[j] = cur;
+            }
+            fprintf(out, "\n# by symbol\n#     samples  percent  symbol\n");
+            for (uint32_t i=0;i<used;i++) {
+                fprintf(out, "%13llu  %6.2f%%  %s\n", (unsigned long long)symcounts[order[i]], 100.0*symcounts[order[i]]/sampler->total, symbols->entries[order[i]].name);
+            }
+            if (unknown) {
+                fprintf(out, "%13llu  %6.2f%%  ?\n", (unsigned long long)unknown, 100.0*unknown/sampler->total);
+            }
+        }
+        free(symcounts);
+        free(order);
+    }
+
+    fprintf(out, "\n# by core slot\n#     samples  percent  slot\n");
+    for (uint32_t slot=0;slot<VM_sampleslots;slot++) {
+        if (sampler->slotcounts[slot]) {
+            fprintf(out, "%13llu  %6.2f%%  %u\n", (unsigned long long)sampler->slotcounts[slot], 100.0*sampler->slotcounts[slot]/sampler->total, slot);
+        }
+    }
+
+    fprintf(out, "\n# by address\n");
+    VM_writehotspots(out, sampler->counts, memory, symbols);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "memory.h"
+#include "symbols.h"
+
+// statistical profiler. a SIGPROF interval timer samples the IP/core slot the cores publish
+// and pushes it into a lock free ring, the emulation loop drains that into histograms.
+typedef struct VM_sampler VM_sampler;
+
+#define VM_samplehost 0xFFFFFFFF // store into the sample point while the host does other work (rendering, input...)
+
+VM_sampler* VM_newsampler(uint32_t hz);
+void VM_delsampler(VM_sampler* sampler);
+volatile uint32_t* VM_samplepoint(VM_sampler* sampler); // give this to VM_vminstance.samplepoint
+uint8_t VM_startsampler(VM_sampler* sampler);
+void VM_stopsampler(VM_sampler* sampler);
+void VM_drainsamples(VM_sampler* sampler);
+void VM_writesamples(FILE* out, VM_sampler* sampler, const VM_memory* memory, const VM_symbols* symbols);
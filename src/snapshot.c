@@ -0,0 +1,191 @@
+/*
+Save state snapshots, see snapshot.h for the layout.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+#define VM_snapshotalign(x) (((x)+63) & ~(uint64_t)63)
+
+static uint64_t VM_snapshotwords(const VM_machine* machine) {
+    return VM_getsize(machine->instance.memory.rows, machine->instance.memory.rowsize);
+}
+static uint64_t VM_snapshotpixels(const VM_machine* machine) {
+    return (8*machine->term.charsnh)*(8*machine->term.charsnv);
+}
+
+uint64_t VM_snapshotsize(const VM_machine* machine) {
+    uint64_t memoryoffset = VM_snapshotalign(sizeof(VM_snapshotheader));
+    uint64_t pixbufoffset = VM_snapshotalign(memoryoffset+VM_snapshotwords(machine)*sizeof(VM_word));
+    return pixbufoffset+VM_snapshotpixels(machine);
+}
+void VM_snapshotstate(const VM_machine* machine, VM_snapshotheader* header) {
+    const VM_vminstance* inst = &machine->instance;
+    const VM_term* term = &machine->term;
+
+    memset(header, 0, sizeof(VM_snapshotheader));
+    memcpy(header->magic, VM_snapshotmagic, 8);
+    header->version = VM_snapshotversion;
+    header->byteorder = VM_snapshotbyteorder;
+    header->headersize = sizeof(VM_snapshotheader);
+    header->size = VM_snapshotsize(machine);
+    header->memoryoffset = VM_snapshotalign(sizeof(VM_snapshotheader));
+    header->memorywords = VM_snapshotwords(machine);
+    header->pixbufoffset = VM_snapshotalign(header->memoryoffset+header->memorywords*sizeof(VM_word));
+    header->pixbufsize = VM_snapshotpixels(machine);
+
+    header->memrows = inst->memory.rows;
+    header->rowsize = inst->memory.rowsize;
+    header->coreamount = inst->coreamount;
+    memcpy(header->cores, inst->cores, sizeof(header->cores));
+    header->allowsmul = inst->allowsmul;
+    header->haspixplot = machine->devices.haspixplot;
+
+    memcpy(header->regs, inst->regs, sizeof(VM_registers));
+    header->IP = inst->IP;
+    header->cycles = inst->cycles;
+    header->sch_addr = inst->sch_addr;
+    header->sch_mode = inst->sch_mode;
+    header->sch_reg = inst->sch_reg;
+    header->flags = inst->flags;
+    header->halted = inst->halted;
+
+    header->charsnh = term->charsnh;
+    header->charsnv = term->charsnv;
+    header->colors = term->colors;
+    header->nlchar = term->nlchar;
+    header->hrange = term->hrange;
+    header->vrange = term->vrange;
+    header->cursor = term->cursor;
+    header->scrollmask = term->scrollmask;
+    header->char0even = term->char0even;
+    header->char0odd = term->char0odd;
+
+    header->keycode = machine->keyboard.keycode;
+}
+void VM_restorestate(VM_machine* machine, const VM_snapshotheader* header) {
+    VM_vminstance* inst = &machine->instance;
+    VM_term* term = &machine->term;
+
+    memcpy(inst->cores, header->cores, sizeof(inst->cores));
+    inst->allowsmul = header->allowsmul;
+    machine->devices.haspixplot = header->haspixplot;
+
+    memcpy(inst->regs, header->regs, sizeof(VM_registers));
+    inst->IP = header->IP;
+    inst->cycles = header->cycles;
+    inst->sch_addr = header->sch_addr;
+    inst->sch_mode = header->sch_mode;
+    inst->sch_reg = header->sch_reg;
+    inst->flags = header->flags;
+    inst->halted = header->halted;
+
+    term->colors = header->colors;
+    term->nlchar = header->nlchar;
+    term->hrange = header->hrange;
+    term->vrange = header->vrange;
+    term->cursor = header->cursor;
+    term->scrollmask = header->scrollmask;
+    term->char0even = header->char0even;
+    term->char0odd = header->char0odd;
+
+    machine->keyboard.keycode = header->keycode;
+}
+uint64_t VM_savesnapshot(const VM_machine* machine, void* buf, uint64_t bufsize) {
+    uint64_t size = VM_snapshotsize(machine);
+    if (bufsize < size) {return 0;}
+    VM_snapshotheader header;
+    VM_snapshotstate(machine, &header);
+
+    uint8_t* out = (uint8_t*)buf;
+    memset(out, 0, size);
+    memcpy(out, &header, sizeof(header));
+    memcpy(out+header.memoryoffset, machine->instance.memory.content, header.memorywords*sizeof(VM_word));
+    memcpy(out+header.pixbufoffset, machine->term.pixbuf, header.pixbufsize);
+    return size;
+}
+const VM_snapshotheader* VM_checksnapshot(const void* blob, uint64_t size) {
+    const VM_snapshotheader* header = (const VM_snapshotheader*)blob;
+    if (!blob || size < sizeof(VM_snapshotheader)) {return NULL;}
+    if (memcmp(header->magic, VM_snapshotmagic, 8) != 0 || header->version != VM_snapshotversion) {return NULL;}
+    if (header->byteorder != VM_snapshotbyteorder || header->headersize != sizeof(VM_snapshotheader)) {return NULL;}
+    if (header->size > size) {return NULL;}
+    if (header->memoryoffset+header->memorywords*sizeof(VM_word) > header->size) {return NULL;}
+    if (header->pixbufoffset+header->pixbufsize > header->size) {return NULL;}
+    return header;
+}
+uint8_t VM_loadsnapshot(VM_machine* machine, const void* blob, uint64_t size) {
+    const VM_snapshotheader* header = VM_checksnapshot(blob, size);
+    if (!header) {return 0;}
+    VM_vminstance* inst = &machine->instance;
+    VM_term* term = &machine->term;
+    if (header->memorywords != VM_snapshotwords(machine) || header->pixbufsize != VM_snapshotpixels(machine)) {return 0;}
+    if (header->memrows != inst->memory.rows || header->rowsize != inst->memory.rowsize || header->coreamount != inst->coreamount) {return 0;}
+
+    VM_restorestate(machine, header);
+
+    const uint8_t* data = (const uint8_t*)blob;
+    const VM_word* words = (const VM_word*)(data+header->memoryoffset);
+    if (inst->memory.mappedbytes) { // rom image, rows that match it stay shared
+        uint64_t rowbytes = inst->memory.rowsize*sizeof(VM_word);
+        for (uint64_t offset=0;offset<header->memorywords;offset+=inst->memory.rowsize) {
+            if (memcmp(inst->memory.content+offset, words+offset, rowbytes) != 0) {
+                memcpy(inst->memory.content+offset, words+offset, rowbytes);
+            }
+        }
+    } else {
+        memcpy(inst->memory.content, words, header->memorywords*sizeof(VM_word));
+    }
+    memcpy(term->pixbuf, data+header->pixbufoffset, header->pixbufsize);
+    return 1;
+}
+VM_machineconfig VM_snapshotconfig(const VM_snapshotheader* header) {
+    VM_machineconfig out = VM_defaultconfig();
+    out.memrows = header->memrows;
+    out.rowsize = header->rowsize;
+    out.coreamount = header->coreamount;
+    memcpy(out.coretypes, header->cores, sizeof(out.coretypes));
+    out.allowsmul = header->allowsmul;
+    out.haspixplot = header->haspixplot;
+    out.charsnh = header->charsnh;
+    out.charsnv = header->charsnv;
+    return out;
+}
+
+uint8_t VM_writesnapshot(const VM_machine* machine, const char* path) {
+    uint64_t size = VM_snapshotsize(machine);
+    void* buf = malloc(size);
+    if (!buf) {return 0;}
+    VM_savesnapshot(machine, buf, size);
+
+    FILE* file = fopen(path, "wb");
+    uint8_t ok = file && fwrite(buf, 1, size, file) == size;
+    if (file && fclose(file) != 0) {ok = 0;}
+    free(buf);
+    return ok;
+}
+VM_snapshotfile VM_mapsnapshot(const char* path) {
+    VM_snapshotfile out = {NULL, 0};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {return out;}
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            out.data = data;
+            out.size = info.st_size;
+        }
+    }
+    close(fd);
+    return out;
+}
+void VM_unmapsnapshot(VM_snapshotfile* file) {
+    if (file->data) {munmap((void*)file->data, file->size);}
+    file->data = NULL;
+    file->size = 0;
+}
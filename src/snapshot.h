@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include "machine.h"
+
+// save states. one contiguous blob: this header, then the memory image, then the terminal pixbuf,
+// each at a 64 byte aligned offset so a mapped file can be copied straight into a machine.
+// host byte order, the header records it so foreign snapshots get rejected.
+#define VM_snapshotmagic "R3SNAP\x1A\n"
+#define VM_snapshotversion 1
+#define VM_snapshotbyteorder 0x01020304
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteorder;
+    uint32_t headersize; // sizeof(VM_snapshotheader)
+    uint32_t reserved;
+    uint64_t size; // whole blob
+    uint64_t memoryoffset;
+    uint64_t memorywords;
+    uint64_t pixbufoffset;
+    uint64_t pixbufsize;
+
+    // machine layout, has to match when restoring
+    uint16_t memrows;
+    uint16_t rowsize;
+    uint8_t coreamount;
+    uint8_t cores[50];
+    uint8_t allowsmul;
+    uint8_t haspixplot;
+
+    // cores
+    VM_registers regs;
+    VM_word IP;
+    uint64_t cycles;
+    uint16_t sch_addr;
+    uint8_t sch_mode;
+    uint8_t sch_reg;
+    VM_flags flags;
+    uint8_t halted;
+
+    // terminal
+    uint8_t charsnh;
+    uint8_t charsnv;
+    uint8_t colors;
+    uint8_t nlchar;
+    uint16_t hrange;
+    uint16_t vrange;
+    uint16_t cursor;
+    uint32_t scrollmask;
+    uint32_t char0even;
+    uint32_t char0odd;
+
+    // keyboard
+    char keycode;
+} VM_snapshotheader;
+
+typedef struct {
+    const void* data; // NULL if mapping failed
+    uint64_t size;
+} VM_snapshotfile;
+
+uint64_t VM_snapshotsize(const VM_machine* machine);
+uint64_t VM_savesnapshot(const VM_machine* machine, void* buf, uint64_t bufsize); // bytes written, 0 if buf is too small
+const VM_snapshotheader* VM_checksnapshot(const void* blob, uint64_t size); // NULL if not a usable snapshot
+uint8_t VM_loadsnapshot(VM_machine* machine, const void* blob, uint64_t size); // 0 if invalid or the layout differs
+VM_machineconfig VM_snapshotconfig(const VM_snapshotheader* header); // default config with the snapshot's layout
+
+// everything but memory and pixels, for callers that keep those themselves (see rewind.h)
+void VM_snapshotstate(const VM_machine* machine, VM_snapshotheader* header);
+void VM_restorestate(VM_machine* machine, const VM_snapshotheader* header);
+
+uint8_t VM_writesnapshot(const VM_machine* machine, const char* path);
+VM_snapshotfile VM_mapsnapshot(const char* path); // read only mapping, restore from it with VM_loadsnapshot
+void VM_unmapsnapshot(VM_snapshotfile* file);
@@ -0,0 +1,153 @@
+/*
+Live statistics in /dev/shm, see stats.h.
+*/
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stats.h"
+
+static uint64_t VM_statsclock(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec*1000000000ull+(uint64_t)now.tv_nsec;
+}
+static void VM_statspath(char* out, size_t size, const char* name) {
+    snprintf(out, size, "/dev/shm/%s", name);
+}
+
+VM_statswriter* VM_newstats(const char* name) {
+    VM_statswriter* writer = (VM_statswriter*)calloc(1, sizeof(VM_statswriter));
+    if (!writer) {return NULL;}
+    VM_statspath(writer->path, sizeof(writer->path), name);
+    int fd = open(writer->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        free(writer);
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(VM_statspage)) != 0) {
+        close(fd);
+        unlink(writer->path);
+        free(writer);
+        return NULL;
+    }
+    VM_statspage* page = (VM_statspage*)mmap(NULL, sizeof(VM_statspage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        unlink(writer->path);
+        free(writer);
+        return NULL;
+    }
+    page->version = VM_statsversion;
+    page->pid = (int32_t)getpid();
+    page->size = sizeof(VM_statspage);
+    __atomic_store_n(&page->magic, VM_statsmagic, __ATOMIC_RELEASE); // last, readers check it first
+    writer->page = page;
+    writer->lastframe = VM_statsclock(CLOCK_MONOTONIC);
+    return writer;
+}
+void VM_delstats(VM_statswriter* writer) {
+    if (!writer) {return;}
+    munmap(writer->page, sizeof(VM_statspage));
+    unlink(writer->path);
+    free(writer);
+}
+
+void VM_statsframe(VM_statswriter* writer) {
+    uint64_t now = VM_statsclock(CLOCK_MONOTONIC);
+    uint64_t micros = (now-writer->lastframe)/1000;
+    writer->frametimes[writer->frames % VM_statsframes] = micros > UINT32_MAX ? UINT32_MAX : (uint32_t)micros;
+    writer->frames ++;
+    writer->lastframe = now;
+}
+
+static int VM_comparetimes(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y)-(x < y);
+}
+static void VM_framepercentiles(const VM_statswriter* writer, uint32_t* out) {
+    uint32_t amount = writer->frames < VM_statsframes ? (uint32_t)writer->frames : VM_statsframes;
+    if (!amount) {
+        memset(out, 0, 4*sizeof(uint32_t));
+        return;
+    }
+    uint32_t sorted[VM_statsframes];
+    memcpy(sorted, writer->frametimes, amount*sizeof(uint32_t));
+    qsort(sorted, amount, sizeof(uint32_t), VM_comparetimes);
+    out[0] = sorted[amount*50/100];
+    out[1] = sorted[amount*90/100];
+    out[2] = sorted[amount*99/100];
+    out[3] = sorted[amount-1];
+}
+
+void VM_publishstats(VM_statswriter* writer, const VM_machine* machine, uint64_t intervalns) {
+    uint64_t now = VM_statsclock(CLOCK_MONOTONIC);
+    if (writer->lastpublish && now-writer->lastpublish < intervalns && !machine->instance.halted) {return;}
+
+    const VM_vminstance* instance = &machine->instance;
+    VM_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.updated = VM_statsclock(CLOCK_REALTIME);
+    stats.cycles = instance->cycles;
+    stats.instructions = instance->cycles*instance->coreamount;
+    if (writer->lastpublish && now > writer->lastpublish) {
+        stats.ips = (double)(stats.instructions-writer->lastinstructions)*1e9/(double)(now-writer->lastpublish);
+    }
+    stats.frames = writer->frames;
+    VM_framepercentiles(writer, stats.frametime);
+    stats.IP = instance->IP;
+    stats.halted = instance->halted;
+    stats.coreamount = instance->coreamount;
+    stats.tracefill = instance->maketracedump ? instance->tracesize : 0;
+    stats.tracesize = instance->maketracedump ? instance->maxtracesize : 0;
+    stats.mmioreads = machine->devices.mmioreads;
+    stats.mmiowrites = machine->devices.mmiowrites;
+
+    VM_statspage* page = writer->page;
+    uint64_t sequence = __atomic_load_n(&page->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->sequence, sequence+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&page->stats, &stats, sizeof(stats));
+    __atomic_store_n(&page->sequence, sequence+2, __ATOMIC_RELEASE);
+
+    writer->lastpublish = now;
+    writer->lastinstructions = stats.instructions;
+}
+
+const VM_statspage* VM_openstats(const char* name) {
+    char path[256];
+    VM_statspath(path, sizeof(path), name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {return NULL;}
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < sizeof(VM_statspage)) {
+        close(fd);
+        return NULL;
+    }
+    const VM_statspage* page = (const VM_statspage*)mmap(NULL, sizeof(VM_statspage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {return NULL;}
+    if (__atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != VM_statsmagic || page->version != VM_statsversion || page->size != sizeof(VM_statspage)) {
+        munmap((void*)page, sizeof(VM_statspage));
+        return NULL;
+    }
+    return page;
+}
+void VM_closestats(const VM_statspage* page) {
+    if (page) {munmap((void*)page, sizeof(VM_statspage));}
+}
+uint8_t VM_readstats(const VM_statspage* page, VM_stats* out) {
+    for (int attempt=0;attempt<1000;attempt++) {
+        uint64_t before = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) {continue;} // writer is busy
+        memcpy(out, (const void*)&page->stats, sizeof(VM_stats));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->sequence, __ATOMIC_RELAXED) == before) {return 1;}
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include "machine.h"
+
+// live statistics published in a small shared memory file (/dev/shm/<name>) so tools like r3top can
+// watch a running emulator without stopping it. the emulation loop is the only writer and guards
+// every update with a sequence lock: odd while writing, readers retry until they saw the same even
+// value before and after copying. nothing here blocks the writer.
+#define VM_statsmagic 0x54533352 // "R3ST" in the file
+#define VM_statsversion 1
+#define VM_statsframes 256 // frame times kept for the percentiles
+
+typedef struct {
+    uint64_t updated; // CLOCK_REALTIME nanoseconds of this update
+    uint64_t cycles;
+    uint64_t instructions; // cycles*cores
+    double ips; // instructions per second since the previous update
+    uint64_t frames; // frames presented
+    uint32_t frametime[4]; // p50, p90, p99 and max over the last VM_statsframes frames, microseconds
+    uint32_t IP;
+    uint8_t halted;
+    uint8_t coreamount;
+    uint64_t tracefill; // trace buffer entries used, of tracesize. 0/0 if not tracing
+    uint64_t tracesize;
+    uint64_t mmioreads; // device register accesses, see devices.h
+    uint64_t mmiowrites;
+} VM_stats;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    uint32_t size; // sizeof(VM_statspage)
+    uint64_t sequence; // odd while the writer is in the middle of an update, only touched with atomics
+    VM_stats stats;
+} VM_statspage;
+
+typedef struct {
+    char path[256];
+    VM_statspage* page;
+    uint64_t lastpublish; // CLOCK_MONOTONIC nanoseconds
+    uint64_t lastinstructions;
+    uint64_t lastframe;
+    uint32_t frametimes[VM_statsframes]; // microseconds, ring
+    uint64_t frames;
+} VM_statswriter;
+
+// writer, in the emulating process. name is a file name in /dev/shm, removed again by VM_delstats
+VM_statswriter* VM_newstats(const char* name);
+void VM_delstats(VM_statswriter* writer);
+void VM_statsframe(VM_statswriter* writer); // call once per presented frame
+void VM_publishstats(VM_statswriter* writer, const VM_machine* machine, uint64_t intervalns); // at most every intervalns, cheap otherwise
+
+// reader
+const VM_statspage* VM_openstats(const char* name); // read only mapping, NULL if missing or not a stats page
+void VM_closestats(const VM_statspage* page);
+uint8_t VM_readstats(const VM_statspage* page, VM_stats* out); // consistent copy, 0 if the writer kept changing it
@@ -0,0 +1,62 @@
+/*
+Symbol files as written by tptasm's export_labels option.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbols.h"
+
+int VM_cmpsymbols(const void* a, const void* b) {
+    const VM_symbol* sa = (const VM_symbol*)a;
+    const VM_symbol* sb = (const VM_symbol*)b;
+    if (sa->addr != sb->addr) {return sa->addr < sb->addr ? -1 : 1;}
+    return strcmp(sa->name, sb->name);
+}
+VM_symbols VM_loadsymbols(const char* path) { // one "<name> 0x<address>" per line, returns an empty table on failure
+    VM_symbols out;
+    out.entries = NULL;
+    out.amount = 0;
+
+    FILE* file = fopen(path, "r");
+    if (!file) {return out;}
+
+    uint32_t capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char name[64];
+        unsigned int addr;
+        if (sscanf(line, "%63s %x", name, &addr) != 2) {continue;}
+        if (out.amount == capacity) {
+            capacity = capacity ? capacity*2 : 256;
+            VM_symbol* grown = (VM_symbol*)realloc(out.entries, capacity*sizeof(VM_symbol));
+            if (!grown) {break;}
+            out.entries = grown;
+        }
+        strcpy(out.entries[out.amount].name, name);
+        out.entries[out.amount].addr = addr & 0xFFFF;
+        out.amount++;
+    }
+    fclose(file);
+
+    qsort(out.entries, out.amount, sizeof(VM_symbol), VM_cmpsymbols);
+    return out;
+}
+void VM_delsymbols(VM_symbols* symbols) {
+    free(symbols->entries);
+    symbols->entries = NULL;
+    symbols->amount = 0;
+}
+const VM_symbol* VM_findsymbol(const VM_symbols* symbols, uint16_t addr) { // closest label at or before addr, NULL if there is none
+    if (!symbols || symbols->amount == 0 || symbols->entries[0].addr > addr) {return NULL;}
+    uint32_t lo = 0;
+    uint32_t hi = symbols->amount;
+    while (hi-lo > 1) {
+        uint32_t mid = (lo+hi)/2;
+        if (symbols->entries[mid].addr <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return &symbols->entries[lo];
+}
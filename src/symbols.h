@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+
+typedef struct {
+    char name[64];
+    uint16_t addr;
+} VM_symbol;
+
+typedef struct {
+    VM_symbol* entries; // sorted by address
+    uint32_t amount;
+} VM_symbols;
+
+VM_symbols VM_loadsymbols(const char* path);
+void VM_delsymbols(VM_symbols* symbols);
+const VM_symbol* VM_findsymbol(const VM_symbols* symbols, uint16_t addr);
@@ -61,41 +61,50 @@ void VM_delterm(VM_term* term) {
     free(term->pixbuf);
     term->pixbuf = NULL;
 }
-void VM_setrawpix(VM_term* term, uint32_t x, uint32_t y, SDL_Renderer* renderer, uint8_t color) {
+void VM_setrawpix(VM_term* term, uint32_t x, uint32_t y, uint8_t color) {
+    if (x >= 8*(uint32_t)term->charsnh || y >= 8*(uint32_t)term->charsnv) {return;} // the pixel plotter can address up to 256x256
     term->pixbuf[x+(y*term->charsnh*8)] = color;
-	//SDL_SetRenderDrawColor(renderer, color[0], color[1], color[2], 255);
-    //SDL_RenderDrawPoint(renderer, x, y);
 }
-void VM_setpix(VM_term* term, uint32_t x, uint32_t y, uint8_t colorindex, SDL_Renderer* renderer) {
+void VM_setpix(VM_term* term, uint32_t x, uint32_t y, uint8_t colorindex) {
     //uint8_t r,g,b;
     //r = VM_colortable[colorindex][0];
     //g = VM_colortable[colorindex][1];
     //b = VM_colortable[colorindex][2];
-    VM_setrawpix(term, x, y, renderer, colorindex);
+    VM_setrawpix(term, x, y, colorindex);
 }
-void VM_setchar(VM_term* term, uint8_t fcolor, uint8_t bcolor, uint8_t charindex, uint8_t column, uint8_t row, SDL_Renderer* renderer) {
+void VM_setchar(VM_term* term, uint8_t fcolor, uint8_t bcolor, uint8_t charindex, uint8_t column, uint8_t row) {
     if (charindex > 127) {
         charindex = 0x00;
     }
     for (uint8_t y=0;y<8;y++) {
         for (uint8_t x=0;x<8;x++) {
-            VM_setpix(term, x+(column*8), y+(row*8), font8x8_basic[charindex][y]>>x & 1 ? fcolor : bcolor, renderer);
+            VM_setpix(term, x+(column*8), y+(row*8), font8x8_basic[charindex][y]>>x & 1 ? fcolor : bcolor);
         }
     }
 }
-void VM_copypix(VM_term* term, uint32_t sx, uint32_t sy, uint32_t dx, uint32_t dy, SDL_Renderer* renderer) {
-    VM_setpix(term, dx, dy, term->pixbuf[sx+(sy*(8*term->charsnh))], renderer);
+const uint8_t* VM_fontglyph(uint8_t charindex) {
+    return font8x8_basic[charindex > 127 ? 0x00 : charindex];
 }
-void VM_copycharpix(VM_term* term, uint8_t sx, uint8_t sy, uint8_t dx, uint8_t dy, SDL_Renderer* renderer) {
+void VM_copypix(VM_term* term, uint32_t sx, uint32_t sy, uint32_t dx, uint32_t dy) {
+    VM_setpix(term, dx, dy, term->pixbuf[sx+(sy*(8*term->charsnh))]);
+}
+void VM_copycharpix(VM_term* term, uint8_t sx, uint8_t sy, uint8_t dx, uint8_t dy) {
     sy *= 8;
     sx *= 8;
     dx *= 8;
     dy *= 8;
     for (uint8_t y=0;y<8;y++) {
         for (uint8_t x=0;x<8;x++) {
-            VM_copypix(term, sx+x, sy+y, dx+x, dy+y, renderer);
+            VM_copypix(term, sx+x, sy+y, dx+x, dy+y);
         }
     }
 }
-
-
+void VM_termtorgb(const VM_term* term, uint8_t* out) { // out needs 3 bytes per pixel, rows of 8*charsnh pixels
+    uint32_t pixam = (8 * term->charsnh) * (8 * term->charsnv);
+    for (uint32_t i=0;i<pixam;i++) {
+        const VM_pixel* color = VM_colortable[term->pixbuf[i] & 0b1111];
+        out[i*3+0] = color[0];
+        out[i*3+1] = color[1];
+        out[i*3+2] = color[2];
+    }
+}
@@ -0,0 +1,187 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../arithmetic.c"
+#include "../common.c"
+
+/*
+Checks every 16 bit operand pair (and carry in) of every ALU op against a plain reference model,
+result and all four flags. Flags the op should not touch are checked to survive too.
+A second, random pass uses operands with bits above the ALU width to cover patchword on the inputs.
+
+usage: TEST_ALU_exhaustive [stride]   (stride > 1 only tests every stride-th first operand, for quick runs)
+
+codes:
+0 - OK
+1 - mismatch, details on stderr
+*/
+
+enum {OP_add, OP_adc, OP_sub, OP_sbb, OP_mul, OP_mulh, OP_muls, OP_mulx, OP_shl, OP_shr, OP_and, OP_or, OP_xor, OP_amount};
+const char* opnames[OP_amount] = {"add", "adc", "sub", "sbb", "mul", "mulh", "muls", "mulx", "shl", "shr", "and", "or", "xor"};
+
+// reference model. flags: bit 0 Z, 1 S, 2 C, 3 O
+static inline VM_word ref_patch(VM_word x) {
+    return (x & 0x3FFFFFFF) == 0 ? 0 : x;
+}
+static inline VM_word ref_op(int op, VM_word a, VM_word b, VM_word cin, VM_flags* flags) {
+    a = ref_patch(a);
+    b = ref_patch(b);
+    VM_word a16 = a & 0xFFFF;
+    VM_word b16 = b & 0xFFFF;
+    VM_word out;
+    VM_flags f = *flags;
+    switch (op) {
+        case OP_add: case OP_adc: case OP_sub: case OP_sbb: {
+            uint8_t subtract = op == OP_sub || op == OP_sbb;
+            VM_word rhs = subtract ? (~b16 & 0xFFFF) : b16;
+            VM_word carry = op == OP_add ? 0 : op == OP_adc ? cin : op == OP_sub ? 1 : !cin;
+            VM_word sum = a16+rhs+carry;
+            out = sum & 0xFFFF;
+            VM_word c = (sum >> 16) ^ subtract; // subtraction reports borrow
+            VM_word o = ((a16 ^ rhs) & 0x8000) == 0 && ((a16 ^ out) & 0x8000) != 0;
+            f = (out == 0) | ((out >> 15) << 1) | (c << 2) | (o << 3);
+            break;
+        }
+        case OP_mul: out = (a16*b16) & 0xFFFF; break;
+        case OP_mulh: out = (a16*b16) >> 16; break;
+        case OP_muls: out = (VM_word)((int32_t)(int16_t)a16*(int16_t)b16) >> 16; break;
+        case OP_mulx: out = (VM_word)((int64_t)a16*(int16_t)b16) >> 16; break;
+        case OP_shl: case OP_shr:
+            out = ref_patch(op == OP_shl ? a << (b & 15) : a >> (b & 15)); // not cut to 16 bits
+            f = (f & 0b1100) | (out == 0) | (((out >> 15) & 1) << 1);
+            break;
+        default:
+            out = ref_patch(op == OP_and ? a & b : op == OP_or ? a | b : a ^ b);
+            f = (f & 0b1000) | (out == 0) | (((out >> 15) & 1) << 1);
+            break;
+    }
+    *flags = f;
+    return out;
+}
+static inline VM_word impl_op(int op, VM_word a, VM_word b, VM_word cin, VM_flags* flags) {
+    switch (op) {
+        case OP_add: return VM_add(a, b, flags);
+        case OP_adc: return VM_adc(a, b, flags, cin);
+        case OP_sub: return VM_sub(a, b, flags);
+        case OP_sbb: return VM_sbb(a, b, flags, cin);
+        case OP_mul: return VM_mul(a, b);
+        case OP_mulh: return VM_mulh(a, b);
+        case OP_muls: return VM_muls(a, b);
+        case OP_mulx: return VM_mulx(a, b);
+        case OP_shl: return VM_shl(a, b, flags);
+        case OP_shr: return VM_shr(a, b, flags);
+        case OP_and: return VM_and(a, b, flags);
+        case OP_or: return VM_or(a, b, flags);
+        default: return VM_xor(a, b, flags);
+    }
+}
+
+std::mutex reportlock;
+std::atomic<uint64_t> failures(0);
+static void report(int op, VM_word a, VM_word b, VM_word cin, VM_flags before) {
+    if (failures++ >= 16) {return;}
+    VM_flags reff = before, implf = before;
+    VM_word ref = ref_op(op, a, b, cin, &reff);
+    VM_word impl = impl_op(op, a, b, cin, &implf);
+    std::lock_guard<std::mutex> guard(reportlock);
+    fprintf(stderr, "%s a=0x%08X b=0x%08X cin=%u flags=0x%X: got 0x%08X/0x%X expected 0x%08X/0x%X\n",
+        opnames[op], a, b, cin, before, impl, implf, ref, reff);
+}
+
+// every b for one a. split in plain loops over arrays so the compiler can vectorize the comparisons
+template <int op>
+static void sweep(VM_word a, VM_word cin, VM_word* refout, VM_word* implout, VM_flags* reff, VM_flags* implf) {
+    for (VM_word b=0;b<65536;b++) {
+        reff[b] = implf[b] = (a ^ b) & 0b1111; // varying start flags catch ops clobbering flags they should keep
+    }
+    for (VM_word b=0;b<65536;b++) {
+        refout[b] = ref_op(op, a, b, cin, &reff[b]);
+    }
+    for (VM_word b=0;b<65536;b++) {
+        implout[b] = impl_op(op, a, b, cin, &implf[b]);
+    }
+    uint32_t bad = 0;
+    for (VM_word b=0;b<65536;b++) {
+        bad |= (refout[b] ^ implout[b]) | (VM_word)(reff[b] ^ implf[b]);
+    }
+    if (bad) {
+        for (VM_word b=0;b<65536;b++) {
+            if (refout[b] != implout[b] || reff[b] != implf[b]) {
+                report(op, a, b, cin, (a ^ b) & 0b1111);
+            }
+        }
+    }
+}
+template <int op>
+static void sweepall(VM_word a, VM_word* refout, VM_word* implout, VM_flags* reff, VM_flags* implf) {
+    sweep<op>(a, 0, refout, implout, reff, implf);
+    if (op == OP_adc || op == OP_sbb) {
+        sweep<op>(a, 1, refout, implout, reff, implf);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t stride = argc > 1 ? atoi(argv[1]) : 1;
+    if (stride == 0) {stride = 1;}
+
+    std::atomic<uint32_t> next(0);
+    auto worker = [&]() {
+        std::vector<VM_word> refout(65536), implout(65536);
+        std::vector<VM_flags> reff(65536), implf(65536);
+        for (;;) {
+            uint32_t a = next.fetch_add(stride);
+            if (a >= 65536) {break;}
+            sweepall<OP_add>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_adc>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_sub>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_sbb>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_mul>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_mulh>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_muls>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_mulx>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_shl>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_shr>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_and>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_or>(a, refout.data(), implout.data(), reff.data(), implf.data());
+            sweepall<OP_xor>(a, refout.data(), implout.data(), reff.data(), implf.data());
+        }
+    };
+    unsigned threadamount = std::thread::hardware_concurrency();
+    if (threadamount == 0) {threadamount = 1;}
+    std::vector<std::thread> pool;
+    for (unsigned i=0;i<threadamount;i++) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    // operands wider than the ALU, including the patterns patchword clears
+    const VM_word uppers[] = {0x00000000, 0x00010000, 0x3FFF0000, 0x40000000, 0x80000000, 0xC0000000, 0xFFFF0000};
+    uint32_t seed = 0x2545F491;
+    for (uint32_t i=0;i<(1u << 22)/stride;i++) {
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        VM_word a = (seed & 0xFFFF) | uppers[(seed >> 16) % 7];
+        VM_word b = ((seed >> 8) & (i & 1 ? 0xFFFF : 0)) | uppers[(seed >> 24) % 7];
+        for (int op=0;op<OP_amount;op++) {
+            for (VM_word cin=0;cin<2;cin++) {
+                VM_flags reff = i & 0b1111, implf = i & 0b1111;
+                VM_word ref = ref_op(op, a, b, cin, &reff);
+                VM_word impl = impl_op(op, a, b, cin, &implf);
+                if (ref != impl || reff != implf) {
+                    report(op, a, b, cin, i & 0b1111);
+                }
+            }
+        }
+    }
+
+    if (failures) {
+        fprintf(stderr, "%llu mismatches\n", (unsigned long long)failures.load());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <iostream>
+
+extern "C" {
+#include "../machine.h"
+}
+
+/*
+Memory mirroring and IP wrap around, on both engines.
+
+codes:
+0 - OK
+1x - jump into a mirror didn't run the mirrored word (x: engine)
+2x - ld/st through a mirror missed the word
+3x - the IP didn't wrap from 0xFFFF to 0 (512 rows)
+*/
+
+static VM_word ins(uint8_t loi, uint8_t dest, uint8_t psrc, uint16_t imm) { // second operand immediate
+    return (1u << 30) | ((VM_word)dest << 25) | ((VM_word)psrc << 20) | ((VM_word)loi << 16) | imm;
+}
+enum {OP_mov = 0, OP_jmp = 1, OP_ld = 2, OP_add = 6, OP_st = 10, OP_hlt = 13};
+
+static VM_machine* newmachine(uint8_t engine, uint16_t memrows) {
+    VM_machineconfig config = VM_defaultconfig();
+    config.engine = engine;
+    config.memrows = memrows;
+    config.coreamount = 1;
+    return VM_newmachine(&config);
+}
+
+int main() {
+    for (uint8_t engine=0;engine<VM_engineamount;engine++) {
+        // 8K words: 0x2003 is word 3, the IP stays in the mirror
+        VM_machine* machine = newmachine(engine, 64);
+        VM_word* content = machine->instance.memory.content;
+        content[0] = ins(OP_jmp, 0, 0, 0x2003);
+        content[3] = ins(OP_hlt, 0, 0, 0);
+        VM_runmachine(machine, 10);
+        if (!machine->instance.halted || machine->instance.IP != 0x2004) {return 10+engine;}
+        VM_delmachine(machine);
+
+        // a st to 0x2100 lands in word 0x100, a ld from 0xE100 reads it back
+        machine = newmachine(engine, 64);
+        content = machine->instance.memory.content;
+        content[0] = ins(OP_mov, 1, 0, 0x1234);
+        content[1] = ins(OP_st, 1, 0, 0x2100);
+        content[2] = ins(OP_ld, 2, 0, 0xE100);
+        content[3] = ins(OP_hlt, 0, 0, 0);
+        VM_runmachine(machine, 10);
+        if (content[0x100] != 0x1234 || machine->instance.regs[1] != 0x1234) {return 20+engine;}
+        VM_delmachine(machine);
+
+        // the whole address space: word 0xFFFF runs once, then word 0 again
+        machine = newmachine(engine, 512);
+        content = machine->instance.memory.content;
+        content[0] = ins(OP_add, 1, 1, 1);
+        content[1] = ins(OP_jmp, 0, 0, 0xFFFF);
+        content[0xFFFF] = ins(OP_add, 2, 2, 1);
+        VM_runmachine(machine, 5);
+        if (machine->instance.regs[0] != 2 || machine->instance.regs[1] != 1 || machine->instance.IP != 0xFFFF) {return 30+engine;}
+        VM_delmachine(machine);
+    }
+    return 0;
+}
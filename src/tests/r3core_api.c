@@ -0,0 +1,65 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../r3core.h" // nothing else: this is what embedders see
+
+/*
+Drives a machine through the public C API only, so changes to r3core.h or the library that break
+embedders fail here.
+
+codes:
+0 - OK
+1x - create/load
+2x - run
+3x - snapshots
+4x - framebuffer
+*/
+
+static uint32_t ins(uint8_t loi, uint8_t dest, uint8_t psrc, uint16_t imm) { // second operand immediate
+    return (1u << 30) | ((uint32_t)dest << 25) | ((uint32_t)psrc << 20) | ((uint32_t)loi << 16) | imm;
+}
+
+int main(void) {
+    if (R3_apiversion() != R3_APIVERSION) {return 10;}
+    R3_config config = R3_defaultconfig();
+    if (config.size != sizeof(R3_config)) {return 11;}
+    config.coreamount = 1;
+    R3_machine* machine = R3_create(&config);
+    if (!machine) {return 12;}
+    if (R3_loadromdata(machine, NULL, 4)) {return 13;}
+
+    // prints a white 'A' through the terminal at 0x9F80 (along rows, color in the data), stores it at 0x100 and halts
+    const uint32_t rom[] = {ins(0, 1, 0, 0x0F41), ins(10, 1, 0, 0x9F87), ins(10, 1, 0, 0x100), ins(13, 0, 0, 0)};
+    if (!R3_loadromdata(machine, rom, sizeof(rom))) {return 14;}
+    uint64_t blank = R3_framebufferhash(machine);
+
+    uint64_t ran = R3_run(machine, 100);
+    if (!R3_halted(machine) || ran != R3_cycles(machine) || ran > 10) {return 20;}
+    if (R3_readword(machine, 0x100) != 0x0F41) {return 21;}
+
+    uint64_t size = R3_snapshotsize(machine);
+    void* snapshot = malloc(size);
+    if (!snapshot || R3_savesnapshot(machine, snapshot, size) != size) {return 30;}
+    R3_machine* copy = R3_create(&config);
+    if (!copy || !R3_loadsnapshot(copy, snapshot, size)) {return 31;}
+    if (R3_memoryhash(copy) != R3_memoryhash(machine) || R3_framebufferhash(copy) != R3_framebufferhash(machine) || R3_ip(copy) != R3_ip(machine)) {return 32;}
+    if (R3_savesnapshot(machine, snapshot, size-1) != 0) {return 33;}
+    free(snapshot);
+    R3_destroy(copy);
+
+    uint32_t width, height;
+    const uint8_t* pixels = R3_framebuffer(machine, &width, &height);
+    if (!pixels || width != 8u*config.charsnh || height != 8u*config.charsnv) {return 40;}
+    if (R3_framebufferhash(machine) == blank) {return 41;}
+    uint8_t* rgb = (uint8_t*)malloc((size_t)width*height*3);
+    if (!rgb) {return 42;}
+    R3_framebufferrgb(machine, rgb);
+    int lit = 0;
+    for (uint32_t i=0;i<width*height;i++) { // the letter has pixels of another color, in both forms
+        lit |= (pixels[i] != pixels[0]) && memcmp(rgb+3*i, rgb, 3) != 0;
+    }
+    free(rgb);
+    if (!lit) {return 43;}
+
+    R3_destroy(machine);
+    return 0;
+}
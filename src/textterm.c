@@ -0,0 +1,54 @@
+/*
+Text only terminal, see textterm.h.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "textterm.h"
+
+VM_textterm* VM_newtextterm(FILE* out) {
+    VM_textterm* text = (VM_textterm*)calloc(1, sizeof(VM_textterm));
+    if (!text) {return NULL;}
+    text->out = out;
+    return text;
+}
+void VM_deltextterm(VM_textterm* text) {
+    if (!text) {return;}
+    fflush(text->out);
+    free(text);
+}
+
+void VM_textput(VM_textterm* text, uint8_t charindex, uint8_t position, uint8_t line) {
+    uint8_t shown = charindex >= 0x20 && charindex < 0x7F ? charindex : ' ';
+    if (text->cells[line][position] == shown) {return;}
+    text->cells[line][position] = shown;
+    if (text->started && line != text->line) {
+        fputc('\n', text->out);
+        text->position = 0;
+    } else if (!text->started) {
+        text->position = 0;
+    }
+    for (;text->position < position;text->position++) {
+        fputc(' ', text->out);
+    }
+    for (;text->position > position;text->position--) {
+        fputc('\b', text->out);
+    }
+    fputc(shown, text->out);
+    text->line = line;
+    text->position = position+1;
+    text->started = 1;
+    text->characters ++;
+}
+void VM_textwrap(VM_textterm* text, uint8_t position, uint8_t line) {
+    fputc('\n', text->out);
+    text->line = line;
+    text->position = position;
+    text->started = 1;
+}
+void VM_textscroll(VM_textterm* text) {
+    text->line --; // wraps around for line 0, which is just another line
+    VM_textforget(text);
+}
+void VM_textforget(VM_textterm* text) {
+    memset(text->cells, 0, sizeof(text->cells));
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+// text only terminal backend. when attached to the devices (VM_devices.text) the scrollprint registers
+// stream the printed characters to a file instead of rasterizing them, and the pixel plotter does nothing.
+// the cursor, range and nlchar registers still work as usual: line wraps and newlines become '\n',
+// a jump within the line pads with spaces or backs up with '\b', a jump to another line starts a new one.
+// characters outside printable ASCII come out as spaces, like the blank glyphs of the font.
+// writing the character a cell already shows (a blinking cursor redrawn in place) prints nothing.
+typedef struct {
+    FILE* out;
+    uint8_t cells[256][256]; // [line][position], what was last printed there, 0 if nothing
+    uint8_t line; // where the stream stands in terminal coordinates: printing here needs no extra output
+    uint8_t position;
+    uint8_t started; // anything printed yet
+    uint64_t characters; // printed, for the summary and the idle check
+} VM_textterm;
+
+VM_textterm* VM_newtextterm(FILE* out);
+void VM_deltextterm(VM_textterm* text); // flushes, the file stays open
+
+// called by the scrollprint hook (devices.c). line and position follow the print direction:
+// rows and columns when printing along rows, swapped otherwise
+void VM_textput(VM_textterm* text, uint8_t charindex, uint8_t position, uint8_t line);
+void VM_textwrap(VM_textterm* text, uint8_t position, uint8_t line); // the cursor went to the next line
+void VM_textscroll(VM_textterm* text); // the content moved up a line
+void VM_textforget(VM_textterm* text); // the cells moved, whatever gets written next is printed
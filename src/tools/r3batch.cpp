@@ -0,0 +1,276 @@
+/*
+Headless batch runner. Every manifest line is one job (ROM, input, cycle budget, config), the jobs run on a
+pool of threads with a deque each: a worker takes from the front of its own deque and steals from the back
+of the others once it runs dry. Results are printed as JSON lines in manifest order.
+*/
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../argh.h"
+
+extern "C" {
+#include "../config.h"
+#include "../machine.h"
+#include "../snapshot.h"
+#include "../romimage.h"
+}
+
+struct BATCH_job {
+    std::string name;
+    std::string rom;
+    std::string script;
+    std::string snapshot;
+    uint64_t cycles;
+    VM_machineconfig config;
+    const VM_romimage* image; // shared by every job running the same ROM, NULL with --private-memory
+};
+
+struct BATCH_queue {
+    std::mutex lock;
+    std::deque<size_t> jobs;
+};
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options] <manifest>\n", prog);
+    printf("Manifest: one job per line, '#' starts a comment\n");
+    printf("  <rom.bin> [script=FILE] [snapshot=FILE] [cycles=N] [engine=NAME] [cores=N] [memrows=N] [name=NAME]\n");
+    printf("  relative paths are taken from the manifest's directory\n");
+    printf("Options:\n");
+    printf("  --cycles=N       Default cycle budget per job (default: 1000000)\n");
+    printf("  --engine=NAME    Default engine: reference, predecoded (default: predecoded)\n");
+    printf("  --cores=N        Default number of cores (default: %d)\n", DEFAULT_coreamount);
+    printf("  --memrows=N      Default memory rows (default: %d)\n", DEFAULT_memrows);
+    printf("  --jobs=N         Worker threads (default: hardware threads)\n");
+    printf("  --private-memory Give every job its own copy of the ROM instead of sharing pages until written\n");
+}
+
+static std::string batch_path(const std::string& base, const std::string& path) {
+    return path.empty() || path[0] == '/' ? path : base+path;
+}
+
+static std::string batch_escape(const std::string& text) {
+    std::string out;
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') {out += '\\';}
+        out += ch;
+    }
+    return out;
+}
+
+// 0 on a malformed line, jobs untouched for blank and comment lines
+static bool batch_parseline(char* line, const std::string& base, const BATCH_job& defaults, std::vector<BATCH_job>* jobs) {
+    char* comment = strchr(line, '#');
+    if (comment) {*comment = 0;}
+    char* token = strtok(line, " \t\r\n");
+    if (!token) {return true;}
+
+    BATCH_job job = defaults;
+    job.rom = batch_path(base, token);
+    job.name = token;
+    while ((token = strtok(NULL, " \t\r\n"))) {
+        char* value = strchr(token, '=');
+        if (!value) {return false;}
+        *value++ = 0;
+        if (!strcmp(token, "script")) {job.script = batch_path(base, value);}
+        else if (!strcmp(token, "snapshot")) {job.snapshot = batch_path(base, value);}
+        else if (!strcmp(token, "cycles")) {job.cycles = strtoull(value, NULL, 10);}
+        else if (!strcmp(token, "cores")) {job.config.coreamount = (uint8_t)atoi(value);}
+        else if (!strcmp(token, "memrows")) {job.config.memrows = (uint16_t)atoi(value);}
+        else if (!strcmp(token, "name")) {job.name = value;}
+        else if (!strcmp(token, "engine")) {
+            int engine = VM_findengine(value);
+            if (engine < 0) {return false;}
+            job.config.engine = (uint8_t)engine;
+        }
+        else {return false;}
+    }
+    jobs->push_back(job);
+    return true;
+}
+
+static std::string batch_run(const BATCH_job& job, size_t index) {
+    std::string head = "{\"index\": " + std::to_string(index) + ", \"name\": \"" + batch_escape(job.name) + "\", ";
+    VM_machine* machine = VM_newmachine(&job.config);
+    bool loaded = machine && (job.image ? VM_attachromimage(machine, job.image) : VM_loadrom(machine, job.rom.c_str()));
+    if (!loaded) {
+        VM_delmachine(machine);
+        return head + "\"error\": \"cannot load rom\"}";
+    }
+    if (!job.snapshot.empty()) {
+        VM_snapshotfile snapshot = VM_mapsnapshot(job.snapshot.c_str());
+        bool loaded = VM_loadsnapshot(machine, snapshot.data, snapshot.size);
+        VM_unmapsnapshot(&snapshot);
+        if (!loaded) {
+            VM_delmachine(machine);
+            return head + "\"error\": \"cannot load snapshot\"}";
+        }
+    }
+    VM_inputscript script = {};
+    if (!job.script.empty()) {
+        script = VM_loadinputscript(job.script.c_str());
+        VM_seekinput(&script, machine->instance.cycles);
+        machine->script = &script;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t cycles = VM_runmachine(machine, job.cycles);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+    char line[512];
+    snprintf(line, sizeof(line),
+        "\"engine\": \"%s\", \"cycles\": %llu, \"halted\": %s, \"halt_ip\": %u, \"mips\": %.4f, \"seconds\": %.6f, \"memory_hash\": \"%016llX\", \"framebuffer_hash\": \"%016llX\"}",
+        VM_enginename((VM_enginetype)job.config.engine), (unsigned long long)cycles, machine->instance.halted ? "true" : "false", machine->instance.IP,
+        seconds > 0 ? (double)cycles*job.config.coreamount/seconds/1e6 : 0.0, seconds,
+        (unsigned long long)VM_memoryhash(machine), (unsigned long long)VM_framebufferhash(machine));
+
+    machine->script = NULL;
+    VM_delinputscript(&script);
+    VM_delmachine(machine);
+    return head + line;
+}
+
+int main(int argc, char* argv[]) {
+    argh::parser cmdl(argc, argv);
+    if (cmdl[{"-h", "--help"}] || cmdl.size() < 2) {
+        print_usage(argv[0]);
+        return cmdl.size() < 2 ? 1 : 0;
+    }
+
+    std::string enginename;
+    int coreamount, memrows;
+    unsigned threadamount;
+    BATCH_job defaults = {};
+    defaults.config = VM_defaultconfig();
+    cmdl("--cycles", 1000000) >> defaults.cycles;
+    cmdl("--engine", "predecoded") >> enginename;
+    cmdl("--cores", DEFAULT_coreamount) >> coreamount;
+    cmdl("--memrows", DEFAULT_memrows) >> memrows;
+    cmdl("--jobs", std::thread::hardware_concurrency()) >> threadamount;
+    int engine = VM_findengine(enginename.c_str());
+    if (engine < 0) {
+        fprintf(stderr, "unknown engine '%s'\n", enginename.c_str());
+        return 1;
+    }
+    defaults.config.engine = (uint8_t)engine;
+    defaults.config.coreamount = (uint8_t)coreamount;
+    defaults.config.memrows = (uint16_t)memrows;
+
+    const std::string manifest = cmdl[1];
+    FILE* file = fopen(manifest.c_str(), "r");
+    if (!file) {
+        fprintf(stderr, "cannot open manifest '%s'\n", manifest.c_str());
+        return 2;
+    }
+    size_t slash = manifest.rfind('/');
+    std::string base = slash == std::string::npos ? "" : manifest.substr(0, slash+1);
+    std::vector<BATCH_job> jobs;
+    char line[4096];
+    for (int number=1;fgets(line, sizeof(line), file);number++) {
+        if (!batch_parseline(line, base, defaults, &jobs)) {
+            fprintf(stderr, "%s:%d: bad job line\n", manifest.c_str(), number);
+            fclose(file);
+            return 2;
+        }
+    }
+    fclose(file);
+    if (jobs.empty()) {return 0;}
+
+    // one image per ROM content and memory layout
+    std::vector<VM_romimage*> images;
+    if (!cmdl["--private-memory"]) {
+        std::map<std::string, VM_romimage*> bypath;
+        for (BATCH_job& job : jobs) {
+            std::string key = job.rom + ":" + std::to_string(job.config.memrows) + "x" + std::to_string(job.config.rowsize);
+            if (bypath.count(key)) {
+                job.image = bypath[key];
+                continue;
+            }
+            VM_romimage* image = VM_loadromimage(job.rom.c_str(), job.config.memrows, job.config.rowsize);
+            for (VM_romimage* other : images) { // same program under another name
+                if (image && other->hash == image->hash && other->rows == image->rows && other->rowsize == image->rowsize) {
+                    VM_delromimage(image);
+                    image = other;
+                    break;
+                }
+            }
+            if (image && std::find(images.begin(), images.end(), image) == images.end()) {images.push_back(image);}
+            bypath[key] = image;
+            job.image = image;
+        }
+    }
+
+    // deal the jobs out round robin, neighbours in the manifest end up on different workers
+    if (threadamount == 0) {threadamount = 1;}
+    if (threadamount > jobs.size()) {threadamount = jobs.size();}
+    std::vector<BATCH_queue> queues(threadamount);
+    for (size_t i=0;i<jobs.size();i++) {
+        queues[i%threadamount].jobs.push_back(i);
+    }
+
+    std::vector<std::string> out(jobs.size());
+    std::vector<uint8_t> ready(jobs.size(), 0);
+    std::mutex lock;
+    std::condition_variable cond;
+
+    auto take = [&](unsigned self, size_t* index) {
+        for (unsigned i=0;i<threadamount;i++) {
+            BATCH_queue& queue = queues[(self+i)%threadamount];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.jobs.empty()) {continue;}
+            if (i == 0) {
+                *index = queue.jobs.front();
+                queue.jobs.pop_front();
+            } else { // steal the work its owner would get to last
+                *index = queue.jobs.back();
+                queue.jobs.pop_back();
+            }
+            return true;
+        }
+        return false; // nothing gets added after the start, so every deque is drained
+    };
+    auto worker = [&](unsigned self) {
+        size_t index;
+        while (take(self, &index)) {
+            std::string result = batch_run(jobs[index], index);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                out[index] = std::move(result);
+                ready[index] = 1;
+            }
+            cond.notify_all();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i=0;i<threadamount;i++) {
+        pool.emplace_back(worker, i);
+    }
+
+    int failures = 0;
+    for (size_t i=0;i<jobs.size();i++) {
+        std::string result;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [&]() {return ready[i] != 0;});
+            result = std::move(out[i]);
+        }
+        failures += result.find("\"error\"") != std::string::npos;
+        printf("%s\n", result.c_str());
+        fflush(stdout);
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    for (VM_romimage* image : images) {
+        VM_delromimage(image);
+    }
+    return failures ? 3 : 0;
+}
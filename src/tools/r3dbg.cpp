@@ -0,0 +1,315 @@
+/*
+Command console for the debugger (debugger.h): breakpoints, conditional breakpoints and watchpoints on a
+headless machine. Reads one command per line from stdin, so it can be scripted with a pipe as well.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <signal.h>
+
+#include "../argh.h"
+
+extern "C" {
+#include "../config.h"
+#include "../debugger.h"
+#include "../disassembler.h"
+#include "../snapshot.h"
+#include "../symbols.h"
+#include "../textterm.h"
+}
+
+static VM_debugger* running_debugger;
+static void interrupt_run(int) { // ctrl+c stops a continue instead of the console
+    if (running_debugger) {running_debugger->interrupt = 1;}
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options] <input.bin>\n", prog);
+    printf("Options:\n");
+    printf("  --symbols=FILE   \"<name> 0x<address>\" per line, names work wherever an address goes\n");
+    printf("  --script=FILE    Scripted keyboard input, \"<cycle> <key>\" per line\n");
+    printf("  --snapshot=FILE  Start from this save state (after loading the ROM)\n");
+    printf("  --text-out=FILE  Stream the text the program prints to this file, - for stdout (default: discarded)\n");
+    printf("  --cores=N        Number of cores (default: %d)\n", DEFAULT_coreamount);
+    printf("  --memrows=N      Memory rows (default: %d)\n", DEFAULT_memrows);
+}
+
+static void print_commands() {
+    printf("  break ADDR [if COND]      stop before the instruction at ADDR (when COND holds)\n");
+    printf("  watch FROM[-TO] [r|w|rw]  stop after a ld (r) or st (w) in the range (default: w)\n");
+    printf("  delete ID                 remove a breakpoint or watchpoint\n");
+    printf("  list                      breakpoints and watchpoints with their hits\n");
+    printf("  continue [N]              run until a stop, the halt, N more cycles or ctrl+c\n");
+    printf("  step [N]                  run N core slots (default: 1)\n");
+    printf("  regs                      registers, flags, IP and where the cycle stands\n");
+    printf("  mem ADDR [N]              N words from ADDR with disassembly (default: 8)\n");
+    printf("  print EXPR                evaluate a condition expression\n");
+    printf("  key CHAR|CODE             press a key\n");
+    printf("  quit\n");
+    printf("conditions: C operators over r0..r31, zf sf cf of, ip, cycle, [addr], e.g. \"r3 == 0x20 && !zf\"\n");
+}
+
+static std::string describe_addr(const VM_symbols& symbols, uint16_t addr) {
+    char text[96];
+    const VM_symbol* symbol = VM_findsymbol(&symbols, addr);
+    if (symbol && symbol->addr == addr) {
+        snprintf(text, sizeof(text), "0x%04X <%s>", addr, symbol->name);
+    } else if (symbol) {
+        snprintf(text, sizeof(text), "0x%04X <%s+%u>", addr, symbol->name, addr-symbol->addr);
+    } else {
+        snprintf(text, sizeof(text), "0x%04X", addr);
+    }
+    return text;
+}
+
+static bool parse_addr(const VM_symbols& symbols, const std::string& text, uint16_t* out) {
+    if (text.empty()) {return false;}
+    char* end;
+    unsigned long value = strtoul(text.c_str(), &end, 0);
+    if (*end == 0) {
+        if (value > 0xFFFF) {return false;}
+        *out = (uint16_t)value;
+        return true;
+    }
+    for (uint32_t i=0;i<symbols.amount;i++) {
+        if (text == symbols.entries[i].name) {
+            *out = symbols.entries[i].addr;
+            return true;
+        }
+    }
+    return false;
+}
+
+static VM_word peek(const VM_memory& memory, uint32_t addr) { // without VM_memread, that would trigger io hooks
+    VM_word word = addr <= 0xFFFF ? VM_mempeek(&memory, (uint16_t)addr) : VM_nullword;
+    patchword(&word);
+    return word;
+}
+
+static void print_instruction(const VM_machine* machine, const VM_symbols& symbols, uint16_t addr) {
+    char text[128];
+    VM_word word = peek(machine->instance.memory, addr);
+    VM_disasmto(word, text);
+    printf("  %s  %08X  %s\n", describe_addr(symbols, addr).c_str(), word, text);
+}
+
+static void print_stop(const VM_debugger* debugger, const VM_symbols& symbols) {
+    const VM_vminstance* inst = &debugger->machine->instance;
+    switch (debugger->reason) {
+        case VM_stop_break:
+            printf("breakpoint %u at %s, cycle %llu slot %u\n", debugger->pointid, describe_addr(symbols, debugger->addr).c_str(),
+                (unsigned long long)inst->cycles, debugger->slot);
+            break;
+        case VM_stop_read: case VM_stop_write:
+            printf("watchpoint %u: %s 0x%08X %s %s, cycle %llu slot %u\n", debugger->pointid, debugger->reason == VM_stop_read ? "read" : "wrote",
+                debugger->value, debugger->reason == VM_stop_read ? "from" : "to", describe_addr(symbols, debugger->addr).c_str(),
+                (unsigned long long)inst->cycles, debugger->slot);
+            break;
+        case VM_stop_interrupt:
+            printf("interrupted, cycle %llu slot %u\n", (unsigned long long)inst->cycles, debugger->slot);
+            break;
+        case VM_stop_halt:
+            printf("halted at %s after %llu cycles\n", describe_addr(symbols, (uint16_t)inst->IP).c_str(), (unsigned long long)inst->cycles);
+            return;
+        default:
+            printf("cycle %llu slot %u\n", (unsigned long long)inst->cycles, debugger->slot);
+            break;
+    }
+    print_instruction(debugger->machine, symbols, (uint16_t)inst->IP);
+}
+
+static void print_regs(const VM_debugger* debugger, const VM_symbols& symbols) {
+    const VM_vminstance* inst = &debugger->machine->instance;
+    for (int i=1;i<32;i++) {
+        printf("r%-2d %08X%s", i, inst->regs[i-1], i % 4 == 0 || i == 31 ? "\n" : "  ");
+    }
+    printf("zf %u  sf %u  cf %u  of %u\n", inst->flags & 1, (inst->flags >> 1) & 1, (inst->flags >> 2) & 1, (inst->flags >> 3) & 1);
+    printf("IP %s, cycle %llu, next slot %u of %u%s\n", describe_addr(symbols, (uint16_t)inst->IP).c_str(), (unsigned long long)inst->cycles,
+        debugger->slot, inst->coreamount, inst->halted ? ", halted" : "");
+    if (inst->sch_mode < 2) {
+        printf("pending %s 0x%04X r%u\n", inst->sch_mode == 0 ? "ld" : "st", inst->sch_addr, inst->sch_reg);
+    }
+}
+
+static void print_points(const VM_debugger* debugger, const VM_symbols& symbols) {
+    if (!debugger->amount) {
+        printf("no breakpoints or watchpoints\n");
+        return;
+    }
+    for (uint8_t i=0;i<debugger->amount;i++) {
+        const VM_debugpoint* point = &debugger->points[i];
+        if (!point->watch) {
+            printf("%3u  break  %s%s%s  hits %llu\n", point->id, describe_addr(symbols, point->from).c_str(), point->text[0] ? " if " : "",
+                point->text, (unsigned long long)point->hits);
+        } else {
+            const char* mode = point->watch == (VM_watch_read | VM_watch_write) ? "rw" : point->watch == VM_watch_read ? "r" : "w";
+            printf("%3u  watch  0x%04X-0x%04X %-2s  hits %llu\n", point->id, point->from, point->to, mode, (unsigned long long)point->hits);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    argh::parser cmdl(argc, argv);
+    if (cmdl[{"-h", "--help"}] || cmdl.size() < 2) {
+        print_usage(argv[0]);
+        return cmdl.size() < 2 ? 1 : 0;
+    }
+    std::string symbolpath, scriptpath, snapshotpath, textout;
+    int coreamount, memrows;
+    cmdl("--symbols", "") >> symbolpath;
+    cmdl("--script", "") >> scriptpath;
+    cmdl("--snapshot", "") >> snapshotpath;
+    cmdl("--text-out", "") >> textout;
+    cmdl("--cores", DEFAULT_coreamount) >> coreamount;
+    cmdl("--memrows", DEFAULT_memrows) >> memrows;
+
+    VM_machineconfig config = VM_defaultconfig();
+    config.coreamount = (uint8_t)coreamount;
+    config.memrows = (uint16_t)memrows;
+    config.engine = VM_engine_predecoded; // breakpoints live in its decode path
+    VM_machine* machine = VM_newmachine(&config);
+    if (!machine || !VM_loadrom(machine, cmdl[1].c_str())) {
+        fprintf(stderr, "failed to load '%s'\n", cmdl[1].c_str());
+        return 2;
+    }
+    if (!snapshotpath.empty()) {
+        VM_snapshotfile snapshot = VM_mapsnapshot(snapshotpath.c_str());
+        if (!VM_checksnapshot(snapshot.data, snapshot.size) || !VM_loadsnapshot(machine, snapshot.data, snapshot.size)) {
+            fprintf(stderr, "failed to load snapshot '%s'\n", snapshotpath.c_str());
+            return 2;
+        }
+        VM_unmapsnapshot(&snapshot);
+    }
+    VM_inputscript script = {};
+    if (!scriptpath.empty()) {
+        script = VM_loadinputscript(scriptpath.c_str());
+        VM_seekinput(&script, machine->instance.cycles);
+        machine->script = &script;
+    }
+    FILE* textfile = NULL;
+    if (!textout.empty()) {
+        textfile = textout == "-" ? stdout : fopen(textout.c_str(), "w");
+        if (!textfile) {
+            fprintf(stderr, "failed to open '%s'\n", textout.c_str());
+            return 2;
+        }
+        machine->devices.text = VM_newtextterm(textfile);
+    }
+    VM_symbols symbols = symbolpath.empty() ? VM_symbols{NULL, 0} : VM_loadsymbols(symbolpath.c_str());
+    if (!symbolpath.empty() && symbols.amount == 0) {
+        fprintf(stderr, "failed to load symbols from '%s'\n", symbolpath.c_str());
+    }
+    VM_debugger* debugger = VM_newdebugger(machine);
+    running_debugger = debugger;
+    signal(SIGINT, interrupt_run);
+
+    printf("%s loaded, IP %s. \"help\" lists the commands.\n", cmdl[1].c_str(), describe_addr(symbols, (uint16_t)machine->instance.IP).c_str());
+    char line[512];
+    for (;;) {
+        printf("(r3dbg) ");
+        fflush(stdout);
+        if (!fgets(line, sizeof(line), stdin)) {break;}
+        line[strcspn(line, "\r\n")] = 0;
+        char command[32] = "";
+        int consumed = 0;
+        sscanf(line, " %31s %n", command, &consumed);
+        std::string rest = line+consumed;
+        std::string arg = rest.substr(0, rest.find(' '));
+        std::string after = rest.find(' ') == std::string::npos ? "" : rest.substr(rest.find(' ')+1);
+
+        std::string name = command;
+        if (name.empty()) {
+            continue;
+        } else if (name == "help" || name == "h") {
+            print_commands();
+        } else if (name == "quit" || name == "q") {
+            break;
+        } else if (name == "break" || name == "b") {
+            uint16_t addr;
+            const char* condition = NULL;
+            if (after.compare(0, 3, "if ") == 0) {
+                condition = after.c_str()+3;
+            } else if (!after.empty()) {
+                printf("expected: break ADDR [if COND]\n");
+                continue;
+            }
+            if (!parse_addr(symbols, arg, &addr)) {
+                printf("bad address '%s'\n", arg.c_str());
+                continue;
+            }
+            uint32_t id = VM_addbreakpoint(debugger, addr, condition);
+            if (id) {
+                printf("breakpoint %u at %s\n", id, describe_addr(symbols, addr).c_str());
+            } else {
+                printf(condition ? "bad condition, or too many points\n" : "too many points\n");
+            }
+        } else if (name == "watch" || name == "w") {
+            size_t dash = arg.find('-');
+            uint16_t from, to;
+            if (!parse_addr(symbols, arg.substr(0, dash), &from) || !parse_addr(symbols, dash == std::string::npos ? arg.substr(0, dash) : arg.substr(dash+1), &to)) {
+                printf("bad range '%s'\n", arg.c_str());
+                continue;
+            }
+            uint8_t watch = after.empty() || after == "w" ? VM_watch_write : after == "r" ? VM_watch_read : after == "rw" ? VM_watch_read | VM_watch_write : 0;
+            uint32_t id = watch ? VM_addwatchpoint(debugger, from, to, watch) : 0;
+            if (id) {
+                printf("watchpoint %u on 0x%04X-0x%04X\n", id, from, to);
+            } else {
+                printf("bad mode or range, or too many points\n");
+            }
+        } else if (name == "delete" || name == "d") {
+            if (!VM_removedebugpoint(debugger, (uint32_t)strtoul(arg.c_str(), NULL, 10))) {
+                printf("no point %s\n", arg.c_str());
+            }
+        } else if (name == "list" || name == "l") {
+            print_points(debugger, symbols);
+        } else if (name == "continue" || name == "c") {
+            VM_debugrun(debugger, strtoull(arg.c_str(), NULL, 0), 0);
+            print_stop(debugger, symbols);
+        } else if (name == "step" || name == "s") {
+            uint64_t slots = arg.empty() ? 1 : strtoull(arg.c_str(), NULL, 0);
+            VM_debugrun(debugger, 0, slots ? slots : 1);
+            print_stop(debugger, symbols);
+        } else if (name == "regs" || name == "r") {
+            print_regs(debugger, symbols);
+        } else if (name == "mem" || name == "x") {
+            uint16_t addr;
+            if (!parse_addr(symbols, arg, &addr)) {
+                printf("bad address '%s'\n", arg.c_str());
+                continue;
+            }
+            uint32_t amount = after.empty() ? 8 : (uint32_t)strtoul(after.c_str(), NULL, 0);
+            for (uint32_t i=0;i<amount && addr+i <= 0xFFFF;i++) {
+                print_instruction(machine, symbols, (uint16_t)(addr+i));
+            }
+        } else if (name == "print" || name == "p") {
+            VM_debugexpr expr;
+            if (!VM_parsedebugexpr(rest.c_str(), &expr)) {
+                printf("bad expression\n");
+                continue;
+            }
+            VM_word value = VM_evaldebugexpr(&expr, &machine->instance);
+            printf("%u (0x%08X)\n", value, value);
+        } else if (name == "key" || name == "k") {
+            char key = arg.size() == 1 ? arg[0] : (char)strtol(arg.c_str(), NULL, 0);
+            VM_registerkeypress(&machine->keyboard, key);
+        } else {
+            printf("unknown command '%s', try help\n", command);
+        }
+    }
+
+    running_debugger = NULL;
+    VM_deldebugger(debugger);
+    if (machine->devices.text) {
+        VM_deltextterm(machine->devices.text);
+        machine->devices.text = NULL;
+    }
+    if (textfile && textfile != stdout) {fclose(textfile);}
+    VM_delinputscript(&script);
+    machine->script = NULL;
+    VM_delsymbols(&symbols);
+    VM_delmachine(machine);
+    return 0;
+}
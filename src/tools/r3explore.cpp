@@ -0,0 +1,292 @@
+/*
+Runs many input scripts from one machine state. The state is reached once, then every script
+gets a forked worker that shares guest memory copy-on-write with the parent. Outcomes come back
+over pipes and are printed as JSON lines, in script order.
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../argh.h"
+
+extern "C" {
+#include "../config.h"
+#include "../machine.h"
+#include "../snapshot.h"
+#include "../recording.h"
+#include "../lanes.h"
+}
+
+struct EXPLORE_worker {
+    pid_t pid;
+    int fd;
+    size_t first; // scripts first..first+count-1
+    size_t count;
+    std::string output;
+};
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options] <input.bin> <script.keys>...\n", prog);
+    printf("       %s [options] --replay=FILE <script.keys>...\n", prog);
+    printf("Script cycles count from the fork point.\n");
+    printf("Options:\n");
+    printf("  --snapshot=FILE      Start from this save state (after loading the ROM)\n");
+    printf("  --replay=FILE        Start from a recording instead of a ROM\n");
+    printf("  --replay-to=N        Cycle of the recording to fork at (default: its end)\n");
+    printf("  --prefix-script=FILE Input for the shared prefix\n");
+    printf("  --prefix-cycles=N    Cycles to run before forking (default: 0)\n");
+    printf("  --cycles=N           Cycle budget per worker (default: 1000000)\n");
+    printf("  --jobs=N             Workers running at once (default: online cpus)\n");
+    printf("  --lanes=N            Scripts per worker, run in lockstep in one process (max %d, default: 1)\n", VM_lanemax);
+    printf("  --engine=NAME        Execution engine: reference, predecoded (default: predecoded)\n");
+    printf("  --cores=N            Number of cores (default: %d)\n", DEFAULT_coreamount);
+    printf("  --memrows=N          Memory rows (default: %d)\n", DEFAULT_memrows);
+}
+
+static std::string explore_result(const VM_machine* machine, uint64_t ran, double seconds, const char* extra) {
+    char line[512];
+    snprintf(line, sizeof(line),
+        "\"cycles\": %llu, \"halted\": %s, \"halt_ip\": %u, \"memory_hash\": \"%016llX\", \"framebuffer_hash\": \"%016llX\", \"seconds\": %.6f%s\n",
+        (unsigned long long)ran, machine->instance.halted ? "true" : "false", machine->instance.IP,
+        (unsigned long long)VM_memoryhash(machine), (unsigned long long)VM_framebufferhash(machine), seconds, extra);
+    return line;
+}
+
+// private copy of a script with its cycles moved to the fork point
+static VM_inputscript explore_offsetscript(const VM_inputscript& source, uint64_t base) {
+    VM_inputscript script = source;
+    script.events = (VM_inputevent*)malloc((source.amount ? source.amount : 1)*sizeof(VM_inputevent));
+    for (uint32_t i=0;i<script.amount;i++) {
+        script.events[i] = source.events[i];
+        script.events[i].cycle += base;
+    }
+    script.next = 0;
+    return script;
+}
+
+// runs in the forked child, the machine is the parent's copy-on-write image.
+// writes one result line per script
+static void explore_child(VM_machine* machine, const VM_inputscript* sources, size_t count, uint64_t cycles, bool lanes, int fd) {
+    uint64_t base = machine->instance.cycles;
+    std::string out;
+    if (!lanes) {
+        VM_inputscript script = explore_offsetscript(sources[0], base);
+        machine->script = &script;
+        auto start = std::chrono::steady_clock::now();
+        uint64_t ran = VM_runmachine(machine, cycles);
+        out = explore_result(machine, ran, std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count(), "");
+    } else {
+        // every lane starts as a copy of the fork point
+        std::vector<uint8_t> state(VM_snapshotsize(machine));
+        VM_savesnapshot(machine, state.data(), state.size());
+        std::vector<VM_machine*> machines(count);
+        std::vector<VM_inputscript> scripts(count);
+        for (size_t i=0;i<count;i++) {
+            machines[i] = VM_newmachine(&machine->config);
+            if (!machines[i] || !VM_loadsnapshot(machines[i], state.data(), state.size())) {_exit(5);}
+            scripts[i] = explore_offsetscript(sources[i], base);
+            machines[i]->script = &scripts[i];
+        }
+        VM_lanes* group = VM_newlanes(machines.data(), (uint8_t)count);
+        if (!group) {_exit(5);}
+        auto start = std::chrono::steady_clock::now();
+        VM_runlanes(group, cycles);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        char occupancy[64]; // how well the lanes stayed together
+        snprintf(occupancy, sizeof(occupancy), ", \"lanes_per_group\": %.2f", group->groups ? (double)group->laneinstructions/group->groups : 0.0);
+        for (size_t i=0;i<count;i++) {
+            out += explore_result(machines[i], machines[i]->instance.cycles-base, seconds, occupancy);
+        }
+    }
+    for (size_t done=0;done<out.size();) {
+        ssize_t wrote = write(fd, out.data()+done, out.size()-done);
+        if (wrote <= 0) {_exit(6);}
+        done += wrote;
+    }
+}
+
+static std::string explore_escape(const std::string& text) {
+    std::string out;
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') {out += '\\';}
+        out += ch;
+    }
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    argh::parser cmdl(argc, argv);
+    std::string replaypath;
+    cmdl("--replay", "") >> replaypath;
+    size_t firstscript = replaypath.empty() ? 2 : 1;
+    if (cmdl[{"-h", "--help"}] || cmdl.size() <= firstscript) {
+        print_usage(argv[0]);
+        return cmdl.size() <= firstscript ? 1 : 0;
+    }
+
+    std::string snapshotpath, prefixpath, enginename;
+    uint64_t replayto, prefixcycles, cycles;
+    long jobs;
+    size_t lanes;
+    int coreamount, memrows;
+    cmdl("--snapshot", "") >> snapshotpath;
+    cmdl("--replay-to", 0) >> replayto;
+    cmdl("--prefix-script", "") >> prefixpath;
+    cmdl("--prefix-cycles", 0) >> prefixcycles;
+    cmdl("--cycles", 1000000) >> cycles;
+    cmdl("--jobs", sysconf(_SC_NPROCESSORS_ONLN)) >> jobs;
+    cmdl("--lanes", 1) >> lanes;
+    cmdl("--engine", "predecoded") >> enginename;
+    cmdl("--cores", DEFAULT_coreamount) >> coreamount;
+    cmdl("--memrows", DEFAULT_memrows) >> memrows;
+    if (jobs < 1) {jobs = 1;}
+    if (lanes < 1) {lanes = 1;}
+    if (lanes > VM_lanemax) {lanes = VM_lanemax;}
+    int engine = VM_findengine(enginename.c_str());
+    if (engine < 0) {
+        fprintf(stderr, "unknown engine '%s'\n", enginename.c_str());
+        return 1;
+    }
+
+    // reach the shared state once
+    VM_machine* machine = NULL;
+    VM_replay replay = {};
+    if (!replaypath.empty()) {
+        if (!VM_loadreplay(replaypath.c_str(), &replay)) {
+            fprintf(stderr, "failed to load recording '%s'\n", replaypath.c_str());
+            return 2;
+        }
+        machine = VM_newreplaymachine(&replay, (uint8_t)engine);
+        VM_replayseek(&replay, machine, replayto ? replayto : replay.endcycle);
+        machine->script = NULL;
+    } else {
+        VM_machineconfig config = VM_defaultconfig();
+        config.coreamount = (uint8_t)coreamount;
+        config.memrows = (uint16_t)memrows;
+        config.engine = (uint8_t)engine;
+        machine = VM_newmachine(&config);
+        if (!machine || !VM_loadrom(machine, cmdl[1].c_str())) {
+            fprintf(stderr, "failed to load '%s'\n", cmdl[1].c_str());
+            return 2;
+        }
+        if (!snapshotpath.empty()) {
+            VM_snapshotfile snapshot = VM_mapsnapshot(snapshotpath.c_str());
+            if (!VM_loadsnapshot(machine, snapshot.data, snapshot.size)) {
+                fprintf(stderr, "failed to load snapshot '%s'\n", snapshotpath.c_str());
+                return 2;
+            }
+            VM_unmapsnapshot(&snapshot);
+        }
+    }
+    VM_inputscript prefix = {};
+    if (!prefixpath.empty()) {
+        prefix = VM_loadinputscript(prefixpath.c_str());
+        VM_seekinput(&prefix, machine->instance.cycles);
+        machine->script = &prefix;
+    }
+    VM_runmachine(machine, prefixcycles);
+    machine->script = NULL;
+
+    std::vector<std::string> paths;
+    std::vector<VM_inputscript> scripts;
+    for (size_t i=firstscript;i<cmdl.size();i++) {
+        if (access(cmdl[i].c_str(), R_OK) != 0) { // an empty script is valid, a missing one is a typo
+            fprintf(stderr, "cannot read script '%s'\n", cmdl[i].c_str());
+            return 2;
+        }
+        paths.push_back(cmdl[i]);
+        scripts.push_back(VM_loadinputscript(cmdl[i].c_str()));
+    }
+
+    // keep up to jobs workers alive, print results in script order
+    fflush(stdout);
+    std::vector<std::string> results(paths.size());
+    std::vector<bool> done(paths.size(), false);
+    std::vector<EXPLORE_worker> running;
+    size_t next = 0, printed = 0;
+    int failures = 0;
+    while (printed < paths.size()) {
+        while (next < paths.size() && (long)running.size() < jobs) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                perror("pipe");
+                return 3;
+            }
+            size_t count = paths.size()-next < lanes ? paths.size()-next : lanes;
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                explore_child(machine, &scripts[next], count, cycles, lanes > 1, fds[1]);
+                close(fds[1]);
+                _exit(0);
+            }
+            close(fds[1]);
+            if (pid < 0) {
+                perror("fork");
+                close(fds[0]);
+                return 3;
+            }
+            running.push_back({pid, fds[0], next, count, ""});
+            next += count;
+        }
+
+        std::vector<pollfd> waiting;
+        for (const EXPLORE_worker& worker : running) {
+            waiting.push_back({worker.fd, POLLIN, 0});
+        }
+        poll(waiting.data(), waiting.size(), -1);
+        for (size_t i=running.size();i-- > 0;) {
+            if (!waiting[i].revents) {continue;}
+            EXPLORE_worker& worker = running[i];
+            char buf[1024];
+            ssize_t got = read(worker.fd, buf, sizeof(buf));
+            if (got > 0) {
+                worker.output.append(buf, got);
+                continue;
+            }
+            // EOF, the worker is done
+            close(worker.fd);
+            int status = 0;
+            waitpid(worker.pid, &status, 0);
+            bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            for (size_t k=0;k<worker.count;k++) {
+                size_t index = worker.first+k;
+                size_t end = worker.output.find('\n');
+                std::string& result = results[index];
+                result = "{\"index\": " + std::to_string(index) + ", \"script\": \"" + explore_escape(paths[index]) + "\", ";
+                if (ok && end != std::string::npos) {
+                    result += worker.output.substr(0, end) + "}";
+                    worker.output.erase(0, end+1);
+                } else {
+                    failures ++;
+                    int code = WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status);
+                    result += std::string("\"error\": \"") + (WIFSIGNALED(status) ? "signal " : "exit ") + std::to_string(code) + "\"}";
+                }
+                done[index] = true;
+            }
+            running.erase(running.begin()+i);
+        }
+        while (printed < paths.size() && done[printed]) {
+            printf("%s\n", results[printed++].c_str());
+        }
+        fflush(stdout);
+    }
+
+    for (VM_inputscript& script : scripts) {
+        VM_delinputscript(&script);
+    }
+    VM_delinputscript(&prefix);
+    VM_delmachine(machine);
+    if (!replaypath.empty()) {
+        VM_delreplay(&replay);
+    }
+    return failures ? 4 : 0;
+}
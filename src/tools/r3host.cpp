@@ -0,0 +1,153 @@
+/*
+Hosts many sessions of one ROM on a few threads (see host.h). Every session types the keys of a script
+as the program asks for them, after a think time, which is how interactive users look to the host:
+most sessions sit parked waiting for input most of the time. Prints a JSON summary, --verbose adds a
+line per session.
+*/
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "../argh.h"
+#include "../host.h"
+
+extern "C" {
+#include "../config.h"
+#include "../romimage.h"
+}
+
+struct HOST_user {
+    size_t nextkey;
+};
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options] <input.bin>\n", prog);
+    printf("Options:\n");
+    printf("  --sessions=N     Machines to host (default: 1000)\n");
+    printf("  --threads=N      Scheduler threads (default: hardware threads)\n");
+    printf("  --slice=N        Cycles a machine runs before the next one gets a turn (default: 10000)\n");
+    printf("  --budget=N       Cycle budget per session, 0 for none (default: 0)\n");
+    printf("  --script=FILE    Keys every session types, in order (the cycles in the file are ignored)\n");
+    printf("  --think-ms=N     Delay between the program asking for input and the key (default: 10)\n");
+    printf("  --engine=NAME    Execution engine: reference, predecoded (default: predecoded)\n");
+    printf("  --verbose        One JSON line per session\n");
+}
+
+static double host_cpuseconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec+usage.ru_stime.tv_sec+(usage.ru_utime.tv_usec+usage.ru_stime.tv_usec)/1e6;
+}
+
+int main(int argc, char* argv[]) {
+    argh::parser cmdl(argc, argv);
+    if (cmdl[{"-h", "--help"}] || cmdl.size() < 2) {
+        print_usage(argv[0]);
+        return cmdl.size() < 2 ? 1 : 0;
+    }
+
+    uint64_t sessionamount, slice, budget, thinkms;
+    unsigned threads;
+    std::string scriptpath, enginename;
+    cmdl("--sessions", 1000) >> sessionamount;
+    cmdl("--threads", std::thread::hardware_concurrency()) >> threads;
+    cmdl("--slice", 10000) >> slice;
+    cmdl("--budget", 0) >> budget;
+    cmdl("--script", "") >> scriptpath;
+    cmdl("--think-ms", 10) >> thinkms;
+    cmdl("--engine", "predecoded") >> enginename;
+    int engine = VM_findengine(enginename.c_str());
+    if (engine < 0) {
+        fprintf(stderr, "unknown engine '%s'\n", enginename.c_str());
+        return 1;
+    }
+
+    std::vector<char> keys;
+    if (!scriptpath.empty()) {
+        VM_inputscript script = VM_loadinputscript(scriptpath.c_str());
+        for (uint32_t i=0;i<script.amount;i++) {
+            keys.push_back(script.events[i].key);
+        }
+        VM_delinputscript(&script);
+    }
+
+    VM_machineconfig config = VM_defaultconfig();
+    config.engine = (uint8_t)engine;
+    VM_romimage* image = VM_loadromimage(cmdl[1].c_str(), config.memrows, config.rowsize);
+    if (!image) {
+        fprintf(stderr, "failed to load '%s'\n", cmdl[1].c_str());
+        return 2;
+    }
+
+    VM_host* host = VM_newhost(threads, slice);
+    std::vector<VM_machine*> machines(sessionamount);
+    std::vector<HOST_user> users(sessionamount, HOST_user{0});
+    std::vector<VM_session*> sessions(sessionamount);
+    for (uint64_t i=0;i<sessionamount;i++) {
+        machines[i] = VM_newmachine(&config);
+        if (!machines[i] || !VM_attachromimage(machines[i], image)) {
+            fprintf(stderr, "failed to create session %llu\n", (unsigned long long)i);
+            return 3;
+        }
+        sessions[i] = VM_hostadd(host, machines[i], budget ? budget : UINT64_MAX);
+        sessions[i]->user = &users[i];
+    }
+
+    double cpustart = host_cpuseconds();
+    auto start = std::chrono::steady_clock::now();
+    VM_hoststart(host);
+
+    // play the users until nothing will happen any more: every session halted, out of cycles or out of keys
+    auto think = std::chrono::milliseconds(thinkms);
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        auto now = std::chrono::steady_clock::now();
+        uint64_t settled = 0;
+        for (VM_session* session : sessions) {
+            HOST_user* user = (HOST_user*)session->user;
+            std::unique_lock<std::mutex> guard(session->lock);
+            VM_sessionstate state = session->state;
+            if (state == VM_session_input && user->nextkey < keys.size() && session->input.empty()) {
+                if (now-session->parkedat < think) {continue;}
+                guard.unlock();
+                VM_postkey(host, session, keys[user->nextkey++]);
+                continue;
+            }
+            settled += state != VM_session_runnable;
+        }
+        if (settled == sessionamount) {break;}
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    double cpuseconds = host_cpuseconds()-cpustart;
+
+    uint64_t cycles = 0, resumes = 0, halted = 0, waiting = 0;
+    for (uint64_t i=0;i<sessionamount;i++) {
+        VM_session* session = sessions[i];
+        std::lock_guard<std::mutex> guard(session->lock);
+        cycles += machines[i]->instance.cycles;
+        resumes += session->resumes;
+        halted += session->state == VM_session_halted;
+        waiting += session->state == VM_session_input;
+        if (cmdl["--verbose"]) {
+            printf("{\"session\": %llu, \"state\": \"%s\", \"cycles\": %llu, \"ip\": %u, \"resumes\": %llu, \"memory_hash\": \"%016llX\", \"framebuffer_hash\": \"%016llX\"}\n",
+                (unsigned long long)i, session->state == VM_session_halted ? "halted" : session->state == VM_session_input ? "input" : "budget",
+                (unsigned long long)machines[i]->instance.cycles, machines[i]->instance.IP, (unsigned long long)session->resumes,
+                (unsigned long long)VM_memoryhash(machines[i]), (unsigned long long)VM_framebufferhash(machines[i]));
+        }
+    }
+    printf("{\"sessions\": %llu, \"threads\": %zu, \"halted\": %llu, \"waiting_input\": %llu, \"out_of_budget\": %llu, \"cycles\": %llu, \"resumes\": %llu, \"seconds\": %.3f, \"cpu_seconds\": %.3f, \"mips\": %.3f}\n",
+        (unsigned long long)sessionamount, host->schedulers.size(), (unsigned long long)halted, (unsigned long long)waiting,
+        (unsigned long long)(sessionamount-halted-waiting), (unsigned long long)cycles, (unsigned long long)resumes, seconds, cpuseconds,
+        cpuseconds > 0 ? (double)cycles*config.coreamount/cpuseconds/1e6 : 0.0);
+
+    VM_delhost(host);
+    for (VM_machine* machine : machines) {
+        VM_delmachine(machine);
+    }
+    VM_delromimage(image);
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+Watches emulators started with --stats through their /dev/shm pages (stats.h), never stops them.
+Without a name it lists every page it finds, with one it refreshes a small table until that emulator exits.
+*/
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <signal.h>
+
+#include "../argh.h"
+
+extern "C" {
+#include "../stats.h"
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options] [name]\n", prog);
+    printf("Options:\n");
+    printf("  --interval-ms=N  Refresh interval (default: 500)\n");
+    printf("  --once           Print once and exit\n");
+    printf("  --json           One JSON line per refresh instead of the table\n");
+}
+
+static std::vector<std::string> find_pages() {
+    std::vector<std::string> out;
+    DIR* dir = opendir("/dev/shm");
+    if (!dir) {return out;}
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") {continue;}
+        const VM_statspage* page = VM_openstats(name.c_str());
+        if (page) {
+            out.push_back(name);
+            VM_closestats(page);
+        }
+    }
+    closedir(dir);
+    return out;
+}
+
+static double age_seconds(const VM_stats& stats) {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t nanos = (uint64_t)now.tv_sec*1000000000ull+(uint64_t)now.tv_nsec;
+    return nanos > stats.updated ? (nanos-stats.updated)/1e9 : 0.0;
+}
+
+static void print_json(const std::string& name, int pid, const VM_stats& stats) {
+    printf("{\"name\": \"%s\", \"pid\": %d, \"age\": %.3f, \"cycles\": %llu, \"instructions\": %llu, \"ips\": %.0f, \"frames\": %llu, "
+        "\"frametime_us\": {\"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u}, \"ip\": %u, \"halted\": %s, "
+        "\"trace\": [%llu, %llu], \"mmio_reads\": %llu, \"mmio_writes\": %llu}\n",
+        name.c_str(), pid, age_seconds(stats), (unsigned long long)stats.cycles, (unsigned long long)stats.instructions, stats.ips,
+        (unsigned long long)stats.frames, stats.frametime[0], stats.frametime[1], stats.frametime[2], stats.frametime[3], stats.IP,
+        stats.halted ? "true" : "false", (unsigned long long)stats.tracefill, (unsigned long long)stats.tracesize,
+        (unsigned long long)stats.mmioreads, (unsigned long long)stats.mmiowrites);
+}
+
+static void print_table(const std::string& name, int pid, const VM_stats& stats) {
+    printf("%s (pid %d)%s, updated %.1fs ago\n", name.c_str(), pid, stats.halted ? ", halted" : "", age_seconds(stats));
+    printf("  ips        %14.0f   (%u cores)\n", stats.ips, stats.coreamount);
+    printf("  cycles     %14llu   instructions %llu\n", (unsigned long long)stats.cycles, (unsigned long long)stats.instructions);
+    printf("  frames     %14llu   frame time p50 %.2fms p90 %.2fms p99 %.2fms max %.2fms\n", (unsigned long long)stats.frames,
+        stats.frametime[0]/1e3, stats.frametime[1]/1e3, stats.frametime[2]/1e3, stats.frametime[3]/1e3);
+    printf("  IP         %14u\n", stats.IP);
+    if (stats.tracesize) {
+        printf("  trace      %14llu   of %llu (%.1f%%)\n", (unsigned long long)stats.tracefill, (unsigned long long)stats.tracesize,
+            100.0*stats.tracefill/stats.tracesize);
+    } else {
+        printf("  trace                 off\n");
+    }
+    printf("  mmio       %14llu   reads, %llu writes\n", (unsigned long long)stats.mmioreads, (unsigned long long)stats.mmiowrites);
+}
+
+int main(int argc, char* argv[]) {
+    argh::parser cmdl(argc, argv);
+    if (cmdl[{"-h", "--help"}]) {
+        print_usage(argv[0]);
+        return 0;
+    }
+    uint64_t intervalms;
+    cmdl("--interval-ms", 500) >> intervalms;
+    bool once = cmdl["--once"];
+    bool json = cmdl["--json"];
+
+    if (cmdl.size() < 2) { // overview of everything running
+        std::vector<std::string> names = find_pages();
+        if (names.empty()) {
+            fprintf(stderr, "no emulators with --stats running\n");
+            return 1;
+        }
+        for (const std::string& name : names) {
+            const VM_statspage* page = VM_openstats(name.c_str());
+            VM_stats stats;
+            if (!page) {continue;}
+            if (VM_readstats(page, &stats)) {
+                if (json) {
+                    print_json(name, page->pid, stats);
+                } else {
+                    printf("%-24s pid %-8d %14.0f ips  IP %-6u %s\n", name.c_str(), page->pid, stats.ips, stats.IP, stats.halted ? "halted" : "");
+                }
+            }
+            VM_closestats(page);
+        }
+        return 0;
+    }
+
+    std::string name = cmdl[1];
+    const VM_statspage* page = VM_openstats(name.c_str());
+    if (!page) {
+        fprintf(stderr, "no stats page /dev/shm/%s\n", name.c_str());
+        return 1;
+    }
+    for (;;) {
+        VM_stats stats;
+        if (VM_readstats(page, &stats)) {
+            if (json) {
+                print_json(name, page->pid, stats);
+            } else {
+                if (!once) {printf("\033[H\033[2J");}
+                print_table(name, page->pid, stats);
+            }
+            fflush(stdout);
+            if (stats.halted) {break;}
+        }
+        if (once) {break;}
+        if (kill(page->pid, 0) != 0) { // exited without cleaning up
+            fprintf(stderr, "process %d is gone\n", page->pid);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalms));
+    }
+    VM_closestats(page);
+    return 0;
+}
@@ -0,0 +1,234 @@
+/*
+Lockstep differential checker, runs an engine against the reference interpreter.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "verify.h"
+#include "disassembler.h"
+
+static uint64_t VM_memwords(const VM_machine* machine) {
+    return VM_getsize(machine->instance.memory.rows, machine->instance.memory.rowsize);
+}
+static uint64_t VM_pixels(const VM_machine* machine) {
+    return (8*machine->term.charsnh)*(8*machine->term.charsnv);
+}
+
+static void VM_takecheckpoint(VM_checkpoint* checkpoint, const VM_machine* machine) {
+    checkpoint->instance = machine->instance;
+    memcpy(checkpoint->memory, machine->instance.memory.content, VM_memwords(machine)*sizeof(VM_word));
+    checkpoint->term = machine->term;
+    memcpy(checkpoint->pixbuf, machine->term.pixbuf, VM_pixels(machine));
+    checkpoint->keyboard = machine->keyboard;
+    checkpoint->scriptnext = machine->script ? machine->script->next : 0;
+}
+static void VM_restorecheckpoint(const VM_checkpoint* checkpoint, VM_machine* machine) {
+    machine->instance = checkpoint->instance;
+    memcpy(machine->instance.memory.content, checkpoint->memory, VM_memwords(machine)*sizeof(VM_word));
+    machine->term = checkpoint->term;
+    memcpy(machine->term.pixbuf, checkpoint->pixbuf, VM_pixels(machine));
+    machine->keyboard = checkpoint->keyboard;
+    if (machine->script) {machine->script->next = checkpoint->scriptnext;}
+}
+
+VM_verifier* VM_newverifier(VM_machine* tested, uint64_t interval) {
+    VM_verifier* out = (VM_verifier*)calloc(1, sizeof(VM_verifier));
+    if (!out) {return NULL;}
+    out->interval = interval ? interval : 1;
+
+    VM_machineconfig config = tested->config;
+    config.engine = VM_engine_reference;
+    config.maketracedump = 0;
+    VM_machine* reference = VM_newmachine(&config);
+    if (!reference) {
+        free(out);
+        return NULL;
+    }
+    memcpy(reference->instance.memory.content, tested->instance.memory.content, VM_memwords(tested)*sizeof(VM_word));
+    if (tested->script) {
+        out->script = *tested->script;
+        out->script.events = (VM_inputevent*)malloc(tested->script->amount*sizeof(VM_inputevent) + 1);
+        memcpy(out->script.events, tested->script->events, tested->script->amount*sizeof(VM_inputevent));
+        reference->script = &out->script;
+    }
+    out->machines[0] = reference;
+    out->machines[1] = tested;
+
+    for (int i=0;i<2;i++) {
+        out->checkpoints[i].memory = (VM_word*)malloc(VM_memwords(out->machines[i])*sizeof(VM_word) + 1);
+        out->checkpoints[i].pixbuf = (uint8_t*)malloc(VM_pixels(out->machines[i]) + 1);
+        VM_takecheckpoint(&out->checkpoints[i], out->machines[i]);
+    }
+    out->checkpointcycle = tested->instance.cycles;
+    return out;
+}
+void VM_delverifier(VM_verifier* verifier) {
+    if (!verifier) {return;}
+    for (int i=0;i<2;i++) {
+        free(verifier->checkpoints[i].memory);
+        free(verifier->checkpoints[i].pixbuf);
+    }
+    free(verifier->keylog);
+    VM_delinputscript(&verifier->script);
+    verifier->machines[0]->script = NULL;
+    VM_delmachine(verifier->machines[0]);
+    free(verifier);
+}
+
+void VM_verifykey(VM_verifier* verifier, char key) {
+    if (verifier->keyamount == verifier->keycapacity) {
+        verifier->keycapacity = verifier->keycapacity ? verifier->keycapacity*2 : 64;
+        verifier->keylog = (VM_inputevent*)realloc(verifier->keylog, verifier->keycapacity*sizeof(VM_inputevent));
+    }
+    verifier->keylog[verifier->keyamount].cycle = verifier->machines[1]->instance.cycles;
+    verifier->keylog[verifier->keyamount++].key = key;
+    VM_registerkeypress(&verifier->machines[0]->keyboard, key);
+    VM_registerkeypress(&verifier->machines[1]->keyboard, key);
+}
+
+#define VM_difference(...) do { \
+        if (used < size) {used += snprintf(fields+used, size-used, __VA_ARGS__);} \
+        same = 0; \
+    } while (0)
+
+// fills fields with everything that differs. exact compares memory word by word, otherwise by hash
+static uint8_t VM_comparestate(const VM_machine* reference, const VM_machine* tested, uint8_t exact, char* fields, size_t size) {
+    const VM_vminstance* a = &reference->instance;
+    const VM_vminstance* b = &tested->instance;
+    size_t used = 0;
+    uint8_t same = 1;
+    fields[0] = 0;
+
+    for (uint8_t i=0;i<31;i++) {
+        if (a->regs[i] != b->regs[i]) {VM_difference("r%u: 0x%08X vs 0x%08X\n", i+1, a->regs[i], b->regs[i]);}
+    }
+    if (a->flags != b->flags) {VM_difference("flags: 0x%X vs 0x%X\n", a->flags, b->flags);}
+    if (a->IP != b->IP) {VM_difference("IP: %u vs %u\n", a->IP, b->IP);}
+    if (a->halted != b->halted) {VM_difference("halted: %u vs %u\n", a->halted, b->halted);}
+    if (a->sch_mode != b->sch_mode) {VM_difference("sch_mode: %u vs %u\n", a->sch_mode, b->sch_mode);}
+    if (a->sch_addr != b->sch_addr) {VM_difference("sch_addr: %u vs %u\n", a->sch_addr, b->sch_addr);}
+    if (a->sch_reg != b->sch_reg) {VM_difference("sch_reg: %u vs %u\n", a->sch_reg, b->sch_reg);}
+
+    uint64_t words = VM_memwords(reference);
+    if (exact) {
+        for (uint64_t i=0;i<words;i++) {
+            if (a->memory.content[i] != b->memory.content[i]) {
+                VM_difference("memory[%llu]: 0x%08X vs 0x%08X\n", (unsigned long long)i, a->memory.content[i], b->memory.content[i]);
+                break;
+            }
+        }
+    } else {
+        uint64_t hasha = VM_hashbytes(a->memory.content, words*sizeof(VM_word));
+        uint64_t hashb = VM_hashbytes(b->memory.content, words*sizeof(VM_word));
+        if (hasha != hashb) {VM_difference("memory hash: %016llX vs %016llX\n", (unsigned long long)hasha, (unsigned long long)hashb);}
+    }
+    return same;
+}
+
+static void VM_feedmachine(VM_verifier* verifier, VM_machine* machine, uint64_t cycle, uint32_t* key) {
+    while (*key < verifier->keyamount && verifier->keylog[*key].cycle <= cycle) {
+        VM_registerkeypress(&machine->keyboard, verifier->keylog[(*key)++].key);
+    }
+    if (machine->script) {
+        VM_feedinput(machine->script, cycle, &machine->keyboard);
+    }
+}
+
+// replays from the checkpoint one core slot at a time until the first slot after which the machines differ
+static void VM_bisect(VM_verifier* verifier, uint64_t untilcycle) {
+    VM_divergence* out = &verifier->divergence;
+    VM_machine** machines = verifier->machines;
+    uint32_t keys[2] = {0, 0};
+
+    for (int i=0;i<2;i++) {
+        VM_restorecheckpoint(&verifier->checkpoints[i], machines[i]);
+    }
+    for (uint64_t cycle=verifier->checkpointcycle;cycle<untilcycle;cycle++) {
+        for (int i=0;i<2;i++) {
+            VM_feedmachine(verifier, machines[i], cycle, &keys[i]);
+        }
+        VM_vminstance* reference = &machines[0]->instance;
+        uint8_t coreamount = reference->coreamount;
+        for (uint8_t slot=0;slot<=coreamount;slot++) {
+            VM_word IP = reference->IP & 0xFFFF;
+            out->cycle = cycle;
+            out->slot = slot;
+            out->IP = IP;
+            out->instruction = VM_mempeek(&reference->memory, (uint16_t)IP); // not VM_memread, hooks have side effects
+            out->pendingmode = reference->sch_mode;
+            out->pendingaddr = reference->sch_addr;
+
+            uint8_t running = 1;
+            if (slot < coreamount) {
+                running = VM_engineslot(machines[0]->engine, reference, slot);
+                running &= VM_engineslot(machines[1]->engine, &machines[1]->instance, slot);
+            } else {
+                VM_enginefinish(machines[0]->engine, reference);
+                VM_enginefinish(machines[1]->engine, &machines[1]->instance);
+            }
+            if (!VM_comparestate(machines[0], machines[1], 1, out->fields, sizeof(out->fields))) {
+                return;
+            }
+            if (!running) { // halted, the cycle ends with the last pending ld/st
+                slot = coreamount-1;
+            }
+        }
+    }
+
+    // not reproducible by stepping, report what the checkpoint compare saw
+    out->slot = 0xFF;
+    out->cycle = untilcycle;
+    VM_comparestate(machines[0], machines[1], 0, out->fields, sizeof(out->fields));
+}
+
+uint8_t VM_verifycycle(VM_verifier* verifier) {
+    if (verifier->diverged) {return 0;}
+    for (int i=0;i<2;i++) {
+        VM_machine* machine = verifier->machines[i];
+        if (machine->script) {
+            VM_feedinput(machine->script, machine->instance.cycles, &machine->keyboard);
+        }
+        VM_enginecycle(machine->engine, &machine->instance);
+    }
+
+    uint64_t cycle = verifier->machines[1]->instance.cycles;
+    uint8_t halted = verifier->machines[0]->instance.halted || verifier->machines[1]->instance.halted;
+    if (cycle-verifier->checkpointcycle < verifier->interval && !halted) {return 1;}
+
+    if (VM_comparestate(verifier->machines[0], verifier->machines[1], 0, verifier->divergence.fields, sizeof(verifier->divergence.fields))) {
+        for (int i=0;i<2;i++) {
+            VM_takecheckpoint(&verifier->checkpoints[i], verifier->machines[i]);
+        }
+        verifier->checkpointcycle = cycle;
+        verifier->keyamount = 0;
+        return 1;
+    }
+    VM_bisect(verifier, cycle);
+    verifier->diverged = 1;
+    return 0;
+}
+
+void VM_writedivergence(FILE* out, const VM_verifier* verifier) {
+    const VM_divergence* divergence = &verifier->divergence;
+    if (!verifier->diverged) {
+        fprintf(out, "no divergence\n");
+        return;
+    }
+    fprintf(out, "engine '%s' diverged from the reference", VM_enginename(verifier->machines[1]->engine->type));
+    if (divergence->slot == 0xFF) {
+        fprintf(out, " between cycle %llu and %llu (not reproduced when single stepping)\n",
+            (unsigned long long)verifier->checkpointcycle, (unsigned long long)divergence->cycle);
+    } else {
+        char text[128];
+        VM_disasmto(divergence->instruction, text);
+        if (divergence->slot == verifier->machines[0]->instance.coreamount) {
+            fprintf(out, " at the end of cycle %llu\n", (unsigned long long)divergence->cycle);
+        } else {
+            fprintf(out, " at cycle %llu, core slot %u\n", (unsigned long long)divergence->cycle, divergence->slot);
+            fprintf(out, "instruction: %u: %s (0x%08X)\n", divergence->IP, text, divergence->instruction);
+        }
+        if (divergence->pendingmode < 0x2) {
+            fprintf(out, "pending %s at %u ran first\n", divergence->pendingmode == 0x0 ? "ld" : "st", divergence->pendingaddr);
+        }
+    }
+    fprintf(out, "reference vs engine:\n%s", divergence->fields);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "machine.h"
+
+// lockstep differential checking: a second machine runs the same ROM and input on the reference
+// engine next to the machine under test. registers, flags, IP, the scheduled ld/st and a memory
+// hash get compared every interval cycles. on a mismatch both machines go back to the last
+// matching checkpoint and single step core slot by core slot to find the first divergent instruction.
+
+typedef struct {
+    VM_vminstance instance; // struct copy, the buffers below hold what it points to
+    VM_word* memory;
+    VM_term term;
+    uint8_t* pixbuf;
+    VM_keyboard keyboard;
+    uint32_t scriptnext;
+} VM_checkpoint;
+
+typedef struct {
+    uint64_t cycle;
+    uint8_t slot; // core slot whose step diverged, 0xFF if only seen at the checkpoint
+    VM_word IP; // address of the instruction that slot executed
+    VM_word instruction;
+    uint8_t pendingmode; // sch_mode when the slot started, <2 means it ran a ld/st first
+    uint16_t pendingaddr;
+    char fields[1024]; // what differs, one "name: reference vs engine" per line
+} VM_divergence;
+
+typedef struct {
+    VM_machine* machines[2]; // [0] reference, [1] engine under test (not owned)
+    VM_inputscript script; // copy of the tested machine's script for the reference
+    uint64_t interval;
+    uint64_t checkpointcycle;
+    VM_checkpoint checkpoints[2];
+
+    VM_inputevent* keylog; // keys registered since the checkpoint, for replaying
+    uint32_t keyamount;
+    uint32_t keycapacity;
+
+    uint8_t diverged;
+    VM_divergence divergence;
+} VM_verifier;
+
+// builds the reference machine from tested's config. tested must already have its ROM loaded.
+VM_verifier* VM_newverifier(VM_machine* tested, uint64_t interval);
+void VM_delverifier(VM_verifier* verifier);
+void VM_verifykey(VM_verifier* verifier, char key); // use instead of VM_registerkeypress
+uint8_t VM_verifycycle(VM_verifier* verifier); // one cycle on both machines, 0 once they diverged
+void VM_writedivergence(FILE* out, const VM_verifier* verifier);